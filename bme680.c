@@ -219,6 +219,52 @@ static float calc_heater_res(uint16_t temp, const struct bme680_dev *dev);
  */
 static int8_t read_field_data(struct bme680_field_data *data, struct bme680_dev *dev);
 
+/*!
+ * @brief This internal API is used to extract and compensate the field
+ * data from the raw register block (starting at BME680_FIELD0_ADDR).
+ *
+ * @param[in] buff  :Raw field register data (BME680_FIELD_LENGTH bytes)
+ * @param[out] data :Structure instance to hold the data
+ * @param[in] dev   :Structure instance of bme680_dev.
+ */
+static void calc_field_data(const uint8_t *buff, struct bme680_field_data *data, struct bme680_dev *dev);
+
+/*!
+ * @brief This internal API is used to compensate the ADC values.
+ *
+ * @param[in] raw   :Structure instance with the ADC values
+ * @param[out] data :Structure instance to hold the data
+ * @param[in] dev   :Structure instance of bme680_dev.
+ */
+static void calc_raw_data(const struct bme680_raw_data *raw, struct bme680_field_data *data, struct bme680_dev *dev);
+
+/*!
+ * @brief This internal API is used to precompute the gas_range x
+ * calibration products for each gas range.
+ *
+ * @param[in,out] dev :Structure instance of bme680_dev.
+ */
+static void calc_gas_table(struct bme680_dev *dev);
+
+/*!
+ * @brief This internal API is used to precompute the heater resistance
+ * for each heater temperature at the current ambient temperature.
+ *
+ * @param[in,out] dev :Structure instance of bme680_dev.
+ */
+static void calc_heater_table(struct bme680_dev *dev);
+
+/*!
+ * @brief This internal API is used to look up the heater resistance. The
+ * table is (re)made if not valid or the ambient temperature has changed.
+ *
+ * @param[in] temp  : Contains the target temperature value.
+ * @param[in,out] dev : Structure instance of bme680_dev.
+ *
+ * @return uint8_t heater resistance register value.
+ */
+static uint8_t heater_res(uint16_t temp, struct bme680_dev *dev);
+
 /*!
  * @brief This internal API is used to set the memory page
  * based on register address.
@@ -299,6 +345,10 @@ int8_t bme680_init(struct bme680_dev *dev)
                 if (dev->chip_id == BME680_CHIP_ID) {
                     /* Get the Calibration data */
                     rslt = get_calib_data(dev);
+
+                    /* tables depending on calibration (paulvha) */
+                    if (rslt == BME680_OK)
+                        bme680_calc_tables(dev);
                 } else {
                     rslt = BME680_E_DEV_NOT_FOUND;
                 }
@@ -309,6 +359,35 @@ int8_t bme680_init(struct bme680_dev *dev)
     return rslt;
 }
 
+/*!
+ * @brief This API is an alternative entry point with known calibration data.
+ * added paulvha
+ */
+int8_t bme680_init_calib(const struct bme680_calib_data *calib, struct bme680_dev *dev)
+{
+    int8_t rslt;
+
+    /* Check for null pointer in the device structure*/
+    rslt = null_ptr_check(dev);
+    if (rslt == BME680_OK) {
+        if (calib == NULL)
+            return BME680_E_NULL_PTR;
+
+        /* no soft reset, only confirm there is a BME680 */
+        rslt = bme680_get_regs(BME680_CHIP_ID_ADDR, &dev->chip_id, 1, dev);
+        if (rslt == BME680_OK) {
+            if (dev->chip_id == BME680_CHIP_ID) {
+                dev->calib = *calib;
+                bme680_calc_tables(dev);
+            } else {
+                rslt = BME680_E_DEV_NOT_FOUND;
+            }
+        }
+    }
+
+    return rslt;
+}
+
 /*!
  * @brief This API reads the data from the given register address of the sensor.
  paulvha : change to constant !!
@@ -316,18 +395,21 @@ int8_t bme680_init(struct bme680_dev *dev)
 int8_t bme680_get_regs(const uint8_t reg_addr, uint8_t *reg_data, uint16_t len, struct bme680_dev *dev)
 {
     int8_t rslt;
+    uint8_t addr = reg_addr;
 
     /* Check for null pointer in the device structure*/
     rslt = null_ptr_check(dev);
     if (rslt == BME680_OK) {
-/*        if (dev->intf == BME680_SPI_INTF) {
-            / * Set the memory page * /
+        if (dev->intf == BME680_SPI_INTF) {
+            /* Set the memory page (only written when it changes) */
             rslt = set_mem_page(reg_addr, dev);
-            if (rslt == BME680_OK)
-                reg_addr = reg_addr | BME680_SPI_RD_MSK;
+            if (rslt != BME680_OK)
+                return rslt;
+
+            addr = reg_addr | BME680_SPI_RD_MSK;
         }
-*/
-        dev->com_rslt = dev->read(dev->dev_id, reg_addr, reg_data, len);
+
+        dev->com_rslt = dev->read(dev->dev_id, addr, reg_data, len);
         if (dev->com_rslt != 0)
             rslt = BME680_E_COM_FAIL;
     }
@@ -353,7 +435,7 @@ int8_t bme680_set_regs(const uint8_t *reg_addr, const uint8_t *reg_data, uint8_t
     /* Check for null pointer in the device structure*/
     rslt = null_ptr_check(dev);
     if (rslt == BME680_OK) {
-        if ((len > 0) && (len < BME680_TMP_BUFFER_LENGTH / 2)) {
+        if ((len > 0) && (len <= BME680_TMP_BUFFER_LENGTH / 2)) {
             
             /* Interleave the 2 arrays */
             for (index = 0; index < len; index++) {
@@ -751,6 +833,133 @@ int8_t bme680_get_sensor_data(struct bme680_field_data *data, struct bme680_dev
     return rslt;
 }
 
+/*!
+ * @brief This API checks, without waiting, if a new measurement is available.
+ * added paulvha
+ */
+int8_t bme680_poll_sensor_data(struct bme680_field_data *data, struct bme680_dev *dev)
+{
+    int8_t rslt;
+    uint8_t buff[BME680_FIELD_LENGTH] = { 0 };
+
+    /* Check for null pointer in the device structure*/
+    rslt = null_ptr_check(dev);
+    if (rslt == BME680_OK) {
+
+        /* only read the status register first */
+        rslt = bme680_get_regs(BME680_FIELD0_ADDR, buff, 1, dev);
+
+        if (rslt == BME680_OK) {
+            if (buff[0] & BME680_NEW_DATA_MSK) {
+                /* now read all field data */
+                rslt = bme680_get_regs(BME680_FIELD0_ADDR, buff, (uint16_t) BME680_FIELD_LENGTH, dev);
+
+                if (rslt == BME680_OK) {
+                    calc_field_data(buff, data, dev);
+                    dev->new_fields = 1;
+                }
+            } else {
+                dev->new_fields = 0;
+                rslt = BME680_W_NO_NEW_DATA;
+            }
+        }
+    }
+
+    return rslt;
+}
+
+/*!
+ * @brief This API reads, without waiting, the raw field data in one burst.
+ * added paulvha
+ */
+int8_t bme680_get_raw_field_data(uint8_t *buff, struct bme680_dev *dev)
+{
+    int8_t rslt;
+
+    /* Check for null pointer in the device structure*/
+    rslt = null_ptr_check(dev);
+    if ((rslt == BME680_OK) && (buff != NULL)) {
+
+        rslt = bme680_get_regs(BME680_FIELD0_ADDR, buff, (uint16_t) BME680_FIELD_LENGTH, dev);
+
+        if (rslt == BME680_OK) {
+            if (buff[0] & BME680_NEW_DATA_MSK) {
+                dev->new_fields = 1;
+            } else {
+                dev->new_fields = 0;
+                rslt = BME680_W_NO_NEW_DATA;
+            }
+        }
+    } else if (buff == NULL) {
+        rslt = BME680_E_NULL_PTR;
+    }
+
+    return rslt;
+}
+
+/*!
+ * @brief This API extracts the ADC values from the raw field data.
+ * added paulvha
+ */
+void bme680_parse_raw(const uint8_t *buff, struct bme680_raw_data *raw)
+{
+    // indicate new valid data
+    raw->status = buff[0] & BME680_NEW_DATA_MSK;
+
+    // indicate which of the 10 nb_conv gas values is 
+    // measured
+    raw->gas_index = buff[0] & BME680_GAS_INDEX_MSK;
+
+    // read 0 all the time??
+    raw->meas_index = buff[1];
+
+    /* read the raw data from the sensor */
+    raw->adc_pres = (uint32_t) (((uint32_t) buff[2] * 4096) | ((uint32_t) buff[3] * 16)
+        | ((uint32_t) buff[4] / 16));
+    raw->adc_temp = (uint32_t) (((uint32_t) buff[5] * 4096) | ((uint32_t) buff[6] * 16)
+        | ((uint32_t) buff[7] / 16));
+    raw->adc_hum = (uint16_t) (((uint32_t) buff[8] * 256) | (uint32_t) buff[9]);
+    raw->adc_gas_res = (uint16_t) ((uint32_t) buff[13] * 4 | (((uint32_t) buff[14]) / 64));
+    raw->gas_range = buff[14] & BME680_GAS_RANGE_MSK;
+
+    // 0x2b bit 5 and bit 4 (indicate correct GAS)
+    raw->status |= buff[14] & BME680_GASM_VALID_MSK;
+    raw->status |= buff[14] & BME680_HEAT_STAB_MSK;
+}
+
+/*!
+ * @brief This API compensates the ADC values with the calibration data.
+ * added paulvha
+ */
+int8_t bme680_compensate_adc(const struct bme680_raw_data *raw, struct bme680_field_data *data, struct bme680_dev *dev)
+{
+    /* only the calibration data is needed */
+    if ((dev == NULL) || (raw == NULL) || (data == NULL))
+        return BME680_E_NULL_PTR;
+
+    calc_raw_data(raw, data, dev);
+
+    return BME680_OK;
+}
+
+/*!
+ * @brief This API compensates raw field data.
+ * added paulvha
+ */
+int8_t bme680_compensate_raw(const uint8_t *buff, struct bme680_field_data *data, struct bme680_dev *dev)
+{
+    int8_t rslt;
+
+    /* Check for null pointer in the device structure*/
+    rslt = null_ptr_check(dev);
+    if ((rslt == BME680_OK) && (buff != NULL) && (data != NULL))
+        calc_field_data(buff, data, dev);
+    else
+        rslt = BME680_E_NULL_PTR;
+
+    return rslt;
+}
+
 /*!
  * @brief This internal API is used to read the calibrated data from the sensor.
  */
@@ -848,7 +1057,7 @@ static int8_t set_gas_config(struct bme680_dev *dev)
         if (dev->power_mode == BME680_FORCED_MODE) {
             
             reg_addr[0] = BME680_RES_HEAT0_ADDR;
-            reg_data[0] = calc_heater_res(dev->gas_sett.heatr_temp, dev);
+            reg_data[0] = heater_res(dev->gas_sett.heatr_temp, dev);
             
             reg_addr[1] = BME680_GAS_WAIT0_ADDR;
             reg_data[1] = calc_heater_dur(dev->gas_sett.heatr_dur);
@@ -867,6 +1076,42 @@ static int8_t set_gas_config(struct bme680_dev *dev)
     return rslt;
 }
 
+/*!
+ * @brief This API writes the heater temperature and duration of all
+ * set-points in the profile in one burst write.
+ * added paulvha
+ */
+int8_t bme680_set_heatr_profile(const struct bme680_heatr_prof *prof, struct bme680_dev *dev)
+{
+    int8_t rslt;
+    uint8_t i;
+    uint8_t reg_addr[2 * BME680_HEATR_PROF_MAX];
+    uint8_t reg_data[2 * BME680_HEATR_PROF_MAX];
+
+    /* Check for null pointer in the device structure*/
+    rslt = null_ptr_check(dev);
+    if (rslt == BME680_OK) {
+
+        if (prof == NULL)
+            return BME680_E_NULL_PTR;
+
+        if (prof->len == 0 || prof->len > BME680_HEATR_PROF_MAX)
+            return BME680_E_INVALID_LENGTH;
+
+        for (i = 0; i < prof->len; i++) {
+            reg_addr[i] = BME680_RES_HEAT0_ADDR + i;
+            reg_data[i] = heater_res(prof->heatr_temp[i], dev);
+
+            reg_addr[prof->len + i] = BME680_GAS_WAIT0_ADDR + i;
+            reg_data[prof->len + i] = calc_heater_dur(prof->heatr_dur[i]);
+        }
+
+        rslt = bme680_set_regs(reg_addr, reg_data, 2 * prof->len, dev);
+    }
+
+    return rslt;
+}
+
 /*!
  * @brief This internal API is used to get the gas configuration of the sensor.
  * @note heatr_temp and heatr_dur values are currently register data
@@ -1014,8 +1259,25 @@ static uint32_t calc_gas_resistance(uint16_t gas_res_adc, uint8_t gas_range, con
 {
     int64_t var1;
     uint64_t var2;
-    int64_t var3;
     uint32_t calc_gas_res;
+
+    /* var1 and var3 from the table (paulvha) */
+    var1 = dev->tables.gas_var1[gas_range];
+    var2 = (((int64_t) ((int64_t) gas_res_adc << 15) - (int64_t) (16777216)) + var1);
+    calc_gas_res = (uint32_t) ((dev->tables.gas_var3[gas_range] + ((int64_t) var2 >> 1)) / (int64_t) var2);
+
+    return calc_gas_res;
+}
+
+/*!
+ * @brief This internal API is used to precompute the gas_range x
+ * calibration products.
+ * added paulvha
+ */
+static void calc_gas_table(struct bme680_dev *dev)
+{
+    int64_t var1;
+    uint8_t gas_range;
     /**Look up table 1 for the possible gas range values */
     uint32_t lookupTable1[16] = { UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647),
         UINT32_C(2147483647), UINT32_C(2126008810), UINT32_C(2147483647), UINT32_C(2130303777),
@@ -1027,13 +1289,15 @@ static uint32_t calc_gas_resistance(uint16_t gas_res_adc, uint8_t gas_range, con
         UINT32_C(8000000), UINT32_C(4000000), UINT32_C(2000000), UINT32_C(1000000), UINT32_C(500000),
         UINT32_C(250000), UINT32_C(125000) };
 
-    var1 = (int64_t) ((1340 + (5 * (int64_t) dev->calib.range_sw_err)) *
-        ((int64_t) lookupTable1[gas_range])) >> 16;
-    var2 = (((int64_t) ((int64_t) gas_res_adc << 15) - (int64_t) (16777216)) + var1);
-    var3 = (((int64_t) lookupTable2[gas_range] * (int64_t) var1) >> 9);
-    calc_gas_res = (uint32_t) ((var3 + ((int64_t) var2 >> 1)) / (int64_t) var2);
+    for (gas_range = 0; gas_range < BME680_GAS_RANGES; gas_range++) {
+        var1 = (int64_t) ((1340 + (5 * (int64_t) dev->calib.range_sw_err)) *
+            ((int64_t) lookupTable1[gas_range])) >> 16;
 
-    return calc_gas_res;
+        dev->tables.gas_var1[gas_range] = var1;
+        dev->tables.gas_var3[gas_range] = (((int64_t) lookupTable2[gas_range] * (int64_t) var1) >> 9);
+    }
+
+    dev->tables.valid |= BME680_TABLE_GAS;
 }
 
 /*!
@@ -1172,9 +1436,24 @@ static float calc_humidity(uint16_t hum_adc, const struct bme680_dev *dev)
 static float calc_gas_resistance(uint16_t gas_res_adc, uint8_t gas_range, const struct bme680_dev *dev)
 {
     float calc_gas_res;
+
+    /* var2 and var3 * 0.000000125f * (1 << gas_range) from the table (paulvha) */
+    calc_gas_res = 1.0f / (float)(dev->tables.gas_scale[gas_range] * (((((float)gas_res_adc)
+        - 512.0f)/dev->tables.gas_var2[gas_range]) + 1.0f));
+
+    return calc_gas_res;
+}
+
+/*!
+ * @brief This internal API is used to precompute the gas_range x
+ * calibration products in float format.
+ * added paulvha
+ */
+static void calc_gas_table(struct bme680_dev *dev)
+{
     float var1 = 0;
-    float var2 = 0;
     float var3 = 0;
+    uint8_t gas_range;
 
     const float lookup_k1_range[16] = {
     0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, -0.8,
@@ -1184,13 +1463,15 @@ static float calc_gas_resistance(uint16_t gas_res_adc, uint8_t gas_range, const
     -0.1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
 
     var1 = (1340.0f + (5.0f * dev->calib.range_sw_err));
-    var2 = (var1) * (1.0f + lookup_k1_range[gas_range]/100.0f);
-    var3 = 1.0f + (lookup_k2_range[gas_range]/100.0f);
 
-    calc_gas_res = 1.0f / (float)(var3 * (0.000000125f) * (float)(1 << gas_range) * (((((float)gas_res_adc)
-        - 512.0f)/var2) + 1.0f));
+    for (gas_range = 0; gas_range < BME680_GAS_RANGES; gas_range++) {
+        var3 = 1.0f + (lookup_k2_range[gas_range]/100.0f);
 
-    return calc_gas_res;
+        dev->tables.gas_var2[gas_range] = (var1) * (1.0f + lookup_k1_range[gas_range]/100.0f);
+        dev->tables.gas_scale[gas_range] = var3 * (0.000000125f) * (float)(1 << gas_range);
+    }
+
+    dev->tables.valid |= BME680_TABLE_GAS;
 }
 
 /*!
@@ -1222,6 +1503,51 @@ static float calc_heater_res(uint16_t temp, const struct bme680_dev *dev)
 
 #endif //BME680_FLOAT_POINT_COMPENSATION
 
+/*!
+ * @brief This API (re)makes the tables that depend on the calibration data.
+ * added paulvha
+ */
+void bme680_calc_tables(struct bme680_dev *dev)
+{
+    if (dev == NULL)
+        return;
+
+    dev->tables.valid = 0;
+    calc_gas_table(dev);
+    calc_heater_table(dev);
+}
+
+/*!
+ * @brief This internal API is used to precompute the heater resistance.
+ * added paulvha
+ */
+static void calc_heater_table(struct bme680_dev *dev)
+{
+    uint16_t temp;
+
+    for (temp = 0; temp <= BME680_HEATR_TEMP_MAX; temp++)
+        dev->tables.res_heat[temp] = (uint8_t) calc_heater_res(temp, dev);
+
+    dev->tables.res_heat_amb = dev->amb_temp;
+    dev->tables.valid |= BME680_TABLE_HEATR;
+}
+
+/*!
+ * @brief This internal API is used to look up the heater resistance.
+ * added paulvha
+ */
+static uint8_t heater_res(uint16_t temp, struct bme680_dev *dev)
+{
+    /* only the heater table depends on the ambient temperature */
+    if (! (dev->tables.valid & BME680_TABLE_HEATR) || dev->tables.res_heat_amb != dev->amb_temp)
+        calc_heater_table(dev);
+
+    if (temp > BME680_HEATR_TEMP_MAX) /* Cap temperature */
+        temp = BME680_HEATR_TEMP_MAX;
+
+    return dev->tables.res_heat[temp];
+}
+
 /*!
  * @brief This internal API is used to calculate the Heat duration value.
  */
@@ -1253,11 +1579,6 @@ static int8_t read_field_data(struct bme680_field_data *data, struct bme680_dev
 {
     int8_t rslt;
     uint8_t buff[BME680_FIELD_LENGTH] = { 0 };
-    uint8_t gas_range;
-    uint32_t adc_temp;
-    uint32_t adc_pres;
-    uint16_t adc_hum;
-    uint16_t adc_gas_res;
     uint8_t tries = 10;
 
     /* Check for null pointer in the device structure*/
@@ -1266,36 +1587,12 @@ static int8_t read_field_data(struct bme680_field_data *data, struct bme680_dev
         if (rslt == BME680_OK) {
             rslt = bme680_get_regs(((uint8_t) (BME680_FIELD0_ADDR)), buff, (uint16_t) BME680_FIELD_LENGTH,
                 dev);
-            // indicate new valid data
-            data->status = buff[0] & BME680_NEW_DATA_MSK;
-            
-            // indicate which of the 10 nb_conv gas values is 
-            // measured (the API only uses profile 0)
-            data->gas_index = buff[0] & BME680_GAS_INDEX_MSK;
-            
-            // read 0 all the time??
-            data->meas_index = buff[1];
-
-            /* read the raw data from the sensor */
-            adc_pres = (uint32_t) (((uint32_t) buff[2] * 4096) | ((uint32_t) buff[3] * 16)
-                | ((uint32_t) buff[4] / 16));
-            adc_temp = (uint32_t) (((uint32_t) buff[5] * 4096) | ((uint32_t) buff[6] * 16)
-                | ((uint32_t) buff[7] / 16));
-            adc_hum = (uint16_t) (((uint32_t) buff[8] * 256) | (uint32_t) buff[9]);
-            adc_gas_res = (uint16_t) ((uint32_t) buff[13] * 4 | (((uint32_t) buff[14]) / 64));
-            gas_range = buff[14] & BME680_GAS_RANGE_MSK;
-            
-            // 0x2b bit 5 and bit 4 (indicate correct GAS)
-            data->status |= buff[14] & BME680_GASM_VALID_MSK;
-            data->status |= buff[14] & BME680_HEAT_STAB_MSK;
-
-            if (data->status & BME680_NEW_DATA_MSK) {
-                data->temperature = calc_temperature(adc_temp, dev);
-                data->pressure = calc_pressure(adc_pres, dev);
-                data->humidity = calc_humidity(adc_hum, dev);
-                data->gas_resistance = calc_gas_resistance(adc_gas_res, gas_range, dev);
+
+            calc_field_data(buff, data, dev);
+
+            if (data->status & BME680_NEW_DATA_MSK)
                 break;
-            }
+
             /* Delay to poll the data */
             dev->delay_ms(BME680_POLL_PERIOD_MS);
         }
@@ -1308,9 +1605,48 @@ static int8_t read_field_data(struct bme680_field_data *data, struct bme680_dev
     return rslt;
 }
 
+/*!
+ * @brief This internal API is used to extract and compensate the field
+ * data from the raw register block.
+ */
+static void calc_field_data(const uint8_t *buff, struct bme680_field_data *data, struct bme680_dev *dev)
+{
+    struct bme680_raw_data raw;
+
+    bme680_parse_raw(buff, &raw);
+
+    calc_raw_data(&raw, data, dev);
+}
+
+/*!
+ * @brief This internal API is used to compensate the ADC values.
+ */
+static void calc_raw_data(const struct bme680_raw_data *raw, struct bme680_field_data *data, struct bme680_dev *dev)
+{
+    data->status = raw->status;
+    data->gas_index = raw->gas_index;
+    data->meas_index = raw->meas_index;
+
+    /* e.g. offline with only the calibration data set (paulvha) */
+    if (! (dev->tables.valid & BME680_TABLE_GAS))
+        calc_gas_table(dev);
+
+    if (data->status & BME680_NEW_DATA_MSK) {
+        data->temperature = calc_temperature(raw->adc_temp, dev);
+        data->pressure = calc_pressure(raw->adc_pres, dev);
+        data->humidity = calc_humidity(raw->adc_hum, dev);
+        data->gas_resistance = calc_gas_resistance(raw->adc_gas_res, raw->gas_range, dev);
+    }
+}
+
 /*!
  * @brief This internal API is used to set the memory page based on register address.
- * only SPI.. (not used)
+ * only SPI.
+ *
+ * The page is cached in dev->mem_page (read with get_mem_page() after a
+ * reset), the status register is only written when the page changes.
+ * spi_mem_page is the only writable bit of the status register, so it is
+ * written without reading it first (was a read-modify-write).
  */
 static int8_t set_mem_page(uint8_t reg_addr, struct bme680_dev *dev)
 {
@@ -1327,21 +1663,18 @@ static int8_t set_mem_page(uint8_t reg_addr, struct bme680_dev *dev)
             mem_page = BME680_MEM_PAGE0;
 
         if (mem_page != dev->mem_page) {
-            dev->mem_page = mem_page;
+            reg = mem_page & BME680_MEM_PAGE_MSK;
 
-            dev->com_rslt = dev->read(dev->dev_id, BME680_MEM_PAGE_ADDR | BME680_SPI_RD_MSK, &reg, 1);
-            if (dev->com_rslt != 0)
-                rslt = BME680_E_COM_FAIL;
-
-            if (rslt == BME680_OK) {
-                reg = reg & (~BME680_MEM_PAGE_MSK);
-                reg = reg | (dev->mem_page & BME680_MEM_PAGE_MSK);
+            dev->com_rslt = dev->write(dev->dev_id, BME680_MEM_PAGE_ADDR & BME680_SPI_WR_MSK,
+                &reg, 1);
 
-                dev->com_rslt = dev->write(dev->dev_id, BME680_MEM_PAGE_ADDR & BME680_SPI_WR_MSK,
-                    &reg, 1);
-                if (dev->com_rslt != 0)
-                    rslt = BME680_E_COM_FAIL;
+            /* page not known after an error : write again next time */
+            if (dev->com_rslt != 0) {
+                dev->mem_page = BME680_MEM_PAGE_UNKNOWN;
+                rslt = BME680_E_COM_FAIL;
             }
+            else
+                dev->mem_page = mem_page;
         }
     }
 
@@ -1360,8 +1693,10 @@ static int8_t get_mem_page(struct bme680_dev *dev)
     rslt = null_ptr_check(dev);
     if (rslt == BME680_OK) {
         dev->com_rslt = dev->read(dev->dev_id, BME680_MEM_PAGE_ADDR | BME680_SPI_RD_MSK, &reg, 1);
-        if (dev->com_rslt != 0)
+        if (dev->com_rslt != 0) {
+            dev->mem_page = BME680_MEM_PAGE_UNKNOWN;
             rslt = BME680_E_COM_FAIL;
+        }
         else
             dev->mem_page = reg & BME680_MEM_PAGE_MSK;
     }
@@ -74,6 +74,19 @@ extern "C"
  */
 int8_t bme680_init(struct bme680_dev *dev);
 
+/*!
+ *  @brief This API is an entry point with calibration data saved before
+ *  (e.g. in a file). Only the chip-id is read, there is no soft reset.
+ *  The caller must check that calib belongs to this sensor.
+ *
+ *  @param[in] calib : calibration data as read by bme680_init()
+ *  @param[in,out] dev : Structure instance of bme680_dev
+ *
+ *  @return Result of API execution status
+ *  @retval zero -> Success / +ve value -> Warning / -ve value -> Error
+ */
+int8_t bme680_init_calib(const struct bme680_calib_data *calib, struct bme680_dev *dev);
+
 /*!
  * @brief This API writes the given data to the register address
  * of the sensor.
@@ -177,6 +190,81 @@ void bme680_get_profile_dur(uint16_t *duration, const struct bme680_dev *dev);
  */
 int8_t bme680_get_sensor_data(struct bme680_field_data *data, struct bme680_dev *dev);
 
+/*!
+ * @brief This API checks, without waiting, if the measurement has completed.
+ * Only the status register is read. If new data is indicated, the field data
+ * is read, compensated and stored in the bme680_field_data structure
+ * instance passed by the user.
+ *
+ * @param[out] data: Structure instance to hold the data.
+ * @param[in] dev : Structure instance of bme680_dev.
+ *
+ * @return Result of API execution status
+ * @retval zero -> Success / +ve value -> Warning / -ve value -> Error
+ * @retval BME680_W_NO_NEW_DATA -> measurement not completed yet
+ */
+int8_t bme680_poll_sensor_data(struct bme680_field_data *data, struct bme680_dev *dev);
+
+/*!
+ * @brief This API reads, without waiting, the raw field data registers in
+ * one burst. The data is not compensated, use bme680_compensate_raw() for
+ * that at a later time.
+ *
+ * @param[out] buff : Buffer of BME680_FIELD_LENGTH bytes for the raw data.
+ * @param[in] dev : Structure instance of bme680_dev.
+ *
+ * @return Result of API execution status
+ * @retval zero -> Success / +ve value -> Warning / -ve value -> Error
+ * @retval BME680_W_NO_NEW_DATA -> measurement not completed yet
+ */
+int8_t bme680_get_raw_field_data(uint8_t *buff, struct bme680_dev *dev);
+
+/*!
+ * @brief This API extracts the ADC values from the raw field data, as read
+ * with bme680_get_raw_field_data().
+ *
+ * @param[in] buff : Raw field data (BME680_FIELD_LENGTH bytes).
+ * @param[out] raw : Structure instance to hold the ADC values.
+ */
+void bme680_parse_raw(const uint8_t *buff, struct bme680_raw_data *raw);
+
+/*!
+ * @brief This API compensates the ADC values with the calibration data.
+ * Only dev->calib is used, so this can be used offline (e.g. on captured
+ * data) with a device structure of which only the calibration is set.
+ *
+ * @param[in] raw : Structure instance with the ADC values.
+ * @param[out] data: Structure instance to hold the data.
+ * @param[in] dev : Structure instance of bme680_dev.
+ *
+ * @return Result of API execution status
+ * @retval zero -> Success / -ve value -> Error
+ */
+int8_t bme680_compensate_adc(const struct bme680_raw_data *raw, struct bme680_field_data *data, struct bme680_dev *dev);
+
+/*!
+ * @brief This API (re)makes the gas range and heater resistance tables
+ * in dev->tables from the calibration data. Called by bme680_init(), call
+ * again after changing dev->calib. The heater table is remade
+ * automatically when dev->amb_temp changes.
+ *
+ * @param[in,out] dev : Structure instance of bme680_dev.
+ */
+void bme680_calc_tables(struct bme680_dev *dev);
+
+/*!
+ * @brief This API compensates raw field data, as read with
+ * bme680_get_raw_field_data(), with the calibration data of the device.
+ *
+ * @param[in] buff : Raw field data (BME680_FIELD_LENGTH bytes).
+ * @param[out] data: Structure instance to hold the data.
+ * @param[in] dev : Structure instance of bme680_dev.
+ *
+ * @return Result of API execution status
+ * @retval zero -> Success / -ve value -> Error
+ */
+int8_t bme680_compensate_raw(const uint8_t *buff, struct bme680_field_data *data, struct bme680_dev *dev);
+
 /*!
  * @brief This API is used to set the oversampling, filter and T,P,H, gas selection
  * settings in the sensor.
@@ -206,6 +294,20 @@ int8_t bme680_get_sensor_data(struct bme680_field_data *data, struct bme680_dev
  */
 int8_t bme680_set_sensor_settings(uint16_t desired_settings, struct bme680_dev *dev);
 
+/*!
+ * @brief This API writes the heater temperature and duration of all
+ * set-points in the profile in one burst write (res_heat_x / gas_wait_x).
+ * The set-point to use is selected with bme680_dev.gas_sett.nb_conv and
+ * BME680_NBCONV_SEL in bme680_set_sensor_settings().
+ *
+ * @param[in] prof : heater profile with up to BME680_HEATR_PROF_MAX set-points
+ * @param[in] dev : Structure instance of bme680_dev.
+ *
+ * @return Result of API execution status
+ * @retval zero -> Success / +ve value -> Warning / -ve value -> Error.
+ */
+int8_t bme680_set_heatr_profile(const struct bme680_heatr_prof *prof, struct bme680_dev *dev);
+
 /*!
  * @brief This API is used to get the oversampling, filter and T,P,H, gas selection
  * settings in the sensor.
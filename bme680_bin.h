@@ -0,0 +1,78 @@
+/***********************************************************************
+ *
+ * Binary capture file format for BME680 raw data
+ *
+ * October 2026 / paulvha
+ *
+ * The file starts with a bmeBinHeader, followed by a bmeBinSensor for
+ * each sensor. After that fixed-size bmeBinRecord's follow till the end
+ * of the file. All values are in the byte-order of the capturing system.
+ *
+ * Compensation is done when decoding (bme680dec) with the same Bosch
+ * driver code as used online.
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_BIN_H__
+#define __BME680_BIN_H__
+
+# include <stdint.h>
+# include "bme680_defs.h"
+
+# define BME680_BIN_MAGIC      "BME680R"
+# define BME680_BIN_VERSION    1
+
+/*! file header */
+struct bmeBinHeader
+{
+    char        magic[8];           // BME680_BIN_MAGIC
+    uint16_t    version;            // BME680_BIN_VERSION
+    uint16_t    calib_size;         // sizeof(struct bme680_calib_data)
+    uint16_t    rec_size;           // sizeof(struct bmeBinRecord)
+    uint8_t     sensors;            // number of bmeBinSensor that follow
+    uint8_t     reserved;
+    int64_t     start;              // epoch (ms) of record time 0
+};
+
+/*! sensor header */
+struct bmeBinSensor
+{
+    uint8_t     chip_id;
+    uint8_t     i2c_address;
+    uint8_t     os_temp;            // oversampling (BME680_OS_xxx)
+    uint8_t     os_pres;
+    uint8_t     os_hum;
+    uint8_t     filter;             // filter (BME680_FILTER_SIZE_xxx)
+    uint16_t    heatr_temp;         // heater temperature (C, 0 = gas disabled)
+    uint16_t    heatr_dur;          // heater duration (ms)
+    uint16_t    reserved;
+    struct bme680_calib_data calib; // as read from the sensor
+};
+
+/*! one reading */
+struct bmeBinRecord
+{
+    uint32_t    time;               // ms since header start
+    uint32_t    adc_temp;
+    uint32_t    adc_pres;
+    uint16_t    adc_hum;
+    uint16_t    adc_gas_res;
+    uint8_t     gas_range;
+    uint8_t     status;             // new_data, gasm_valid & heat_stab bits
+    uint8_t     gas_index;          // heater set-point
+    uint8_t     sensor;             // sensor header index
+};
+
+#endif /* __BME680_BIN_H__ */
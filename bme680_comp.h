@@ -0,0 +1,436 @@
+/***********************************************************************
+ *
+ * Compile-time selectable compensation kernels for the BME680
+ *
+ * October 2026 / paulvha
+ *
+ * The formulas are the same as in the Bosch driver (bme680.c, version
+ * 3.5.9), but the kernel is selected as a template parameter instead of
+ * with BME680_FLOAT_POINT_COMPENSATION, so a program can use each of
+ * them. t_fine is passed explicitly, the calibration data is not changed.
+ *
+ *  bmeIntKernel            : int32 / int64 only, no floating point
+ *                            temperature 0.01 C, pressure Pa,
+ *                            humidity 0.001 %, gas resistance Ohm
+ *  bmeRealKernel<float>    : single precision, C, Pa, %, Ohm
+ *  bmeRealKernel<double>   : double precision, C, Pa, %, Ohm
+ *
+ * Usage :
+ *  struct bmeComp<bmeIntKernel> out;
+ *  bme_compensate<bmeIntKernel>(&raw, &calib, &out);
+ *
+ * For large amounts of readings (e.g. captured files) the batch version
+ * bme_compensate_batch() works on columns (structure of arrays). Each
+ * value is computed in a separate loop without aliasing, so the compiler
+ * can vectorize it (-O3, NEON / SSE / AVX), mostly with the float kernel.
+ * The gas range products are computed once per batch (K::gas_table).
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_COMP_H__
+#define __BME680_COMP_H__
+
+# include <stdint.h>
+# include "bme680_defs.h"
+
+/*=======================================================================
+    integer kernel (Bosch integer formulas)
+  -----------------------------------------------------------------------*/
+struct bmeIntKernel
+{
+    typedef int32_t value_t;        // type of the results
+    typedef int32_t fine_t;         // type of t_fine
+
+    /*! temperature in 0.01 C, store t_fine for the other values */
+    static inline value_t temperature(uint32_t temp_adc, const struct bme680_calib_data *c, fine_t *t_fine)
+    {
+        int64_t var1, var2, var3;
+
+        var1 = ((int32_t) temp_adc >> 3) - ((int32_t) c->par_t1 << 1);
+        var2 = (var1 * (int32_t) c->par_t2) >> 11;
+        var3 = ((var1 >> 1) * (var1 >> 1)) >> 12;
+        var3 = ((var3) * ((int32_t) c->par_t3 << 4)) >> 14;
+        *t_fine = (int32_t) (var2 + var3);
+
+        return (int16_t) (((*t_fine * 5) + 128) >> 8);
+    }
+
+    /*! pressure in Pa */
+    static inline value_t pressure(uint32_t pres_adc, const struct bme680_calib_data *c, fine_t t_fine)
+    {
+        int32_t var1, var2, var3, pressure_comp;
+
+        var1 = (((int32_t) t_fine) >> 1) - 64000;
+        var2 = ((((var1 >> 2) * (var1 >> 2)) >> 11) * (int32_t) c->par_p6) >> 2;
+        var2 = var2 + ((var1 * (int32_t) c->par_p5) << 1);
+        var2 = (var2 >> 2) + ((int32_t) c->par_p4 << 16);
+        var1 = (((((var1 >> 2) * (var1 >> 2)) >> 13) * ((int32_t) c->par_p3 << 5)) >> 3) +
+            (((int32_t) c->par_p2 * var1) >> 1);
+        var1 = var1 >> 18;
+        var1 = ((32768 + var1) * (int32_t) c->par_p1) >> 15;
+
+        /* Avoid exception caused by division by zero */
+        if (var1 == 0) return 0;
+
+        pressure_comp = 1048576 - pres_adc;
+        pressure_comp = (int32_t) ((pressure_comp - (var2 >> 12)) * ((uint32_t) 3125));
+        if (pressure_comp >= BME680_MAX_OVERFLOW_VAL)
+            pressure_comp = ((pressure_comp / var1) << 1);
+        else
+            pressure_comp = ((pressure_comp << 1) / var1);
+        var1 = ((int32_t) c->par_p9 * (int32_t) (((pressure_comp >> 3) * (pressure_comp >> 3)) >> 13)) >> 12;
+        var2 = ((int32_t) (pressure_comp >> 2) * (int32_t) c->par_p8) >> 13;
+        var3 = ((int32_t) (pressure_comp >> 8) * (int32_t) (pressure_comp >> 8) *
+            (int32_t) (pressure_comp >> 8) * (int32_t) c->par_p10) >> 17;
+
+        return (int32_t) (pressure_comp) + ((var1 + var2 + var3 + ((int32_t) c->par_p7 << 7)) >> 4);
+    }
+
+    /*! humidity in 0.001 % */
+    static inline value_t humidity(uint16_t hum_adc, const struct bme680_calib_data *c, fine_t t_fine)
+    {
+        int32_t var1, var2, var3, var4, var5, var6;
+        int32_t temp_scaled, calc_hum;
+
+        temp_scaled = (((int32_t) t_fine * 5) + 128) >> 8;
+        var1 = (int32_t) (hum_adc - ((int32_t) ((int32_t) c->par_h1 * 16)))
+            - (((temp_scaled * (int32_t) c->par_h3) / ((int32_t) 100)) >> 1);
+        var2 = ((int32_t) c->par_h2
+            * (((temp_scaled * (int32_t) c->par_h4) / ((int32_t) 100))
+                + (((temp_scaled * ((temp_scaled * (int32_t) c->par_h5) / ((int32_t) 100))) >> 6)
+                    / ((int32_t) 100)) + (int32_t) (1 << 14))) >> 10;
+        var3 = var1 * var2;
+        var4 = (int32_t) c->par_h6 << 7;
+        var4 = ((var4) + ((temp_scaled * (int32_t) c->par_h7) / ((int32_t) 100))) >> 4;
+        var5 = ((var3 >> 14) * (var3 >> 14)) >> 10;
+        var6 = (var4 * var5) >> 1;
+        calc_hum = (((var3 + var6) >> 10) * ((int32_t) 1000)) >> 12;
+
+        if (calc_hum > 100000) /* Cap at 100%rH */
+            calc_hum = 100000;
+        else if (calc_hum < 0)
+            calc_hum = 0;
+
+        return calc_hum;
+    }
+
+    /*! gas resistance in Ohm */
+    static inline value_t gas(uint16_t gas_res_adc, uint8_t gas_range, const struct bme680_calib_data *c)
+    {
+        static const uint32_t lookupTable1[16] = { UINT32_C(2147483647), UINT32_C(2147483647),
+            UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2126008810),
+            UINT32_C(2147483647), UINT32_C(2130303777), UINT32_C(2147483647), UINT32_C(2147483647),
+            UINT32_C(2143188679), UINT32_C(2136746228), UINT32_C(2147483647), UINT32_C(2126008810),
+            UINT32_C(2147483647), UINT32_C(2147483647) };
+        static const uint32_t lookupTable2[16] = { UINT32_C(4096000000), UINT32_C(2048000000),
+            UINT32_C(1024000000), UINT32_C(512000000), UINT32_C(255744255), UINT32_C(127110228),
+            UINT32_C(64000000), UINT32_C(32258064), UINT32_C(16016016), UINT32_C(8000000),
+            UINT32_C(4000000), UINT32_C(2000000), UINT32_C(1000000), UINT32_C(500000),
+            UINT32_C(250000), UINT32_C(125000) };
+        int64_t var1, var3;
+
+        var1 = (int64_t) ((1340 + (5 * (int64_t) c->range_sw_err)) * ((int64_t) lookupTable1[gas_range])) >> 16;
+        var3 = (((int64_t) lookupTable2[gas_range] * (int64_t) var1) >> 9);
+
+        return gas(gas_res_adc, var1, var3);
+    }
+
+    /*! gas resistance with the range products var1 and var3 */
+    static inline value_t gas(uint16_t gas_res_adc, int64_t var1, int64_t var3)
+    {
+        uint64_t var2;
+
+        var2 = (((int64_t) ((int64_t) gas_res_adc << 15) - (int64_t) (16777216)) + var1);
+
+        return (int32_t) ((var3 + ((int64_t) var2 >> 1)) / (int64_t) var2);
+    }
+
+    /*! gas_range x calibration products of all ranges */
+    struct gas_table
+    {
+        int64_t var1[BME680_GAS_RANGES];
+        int64_t var3[BME680_GAS_RANGES];
+    };
+
+    static inline void gas_table_init(const struct bme680_calib_data *c, struct gas_table *t)
+    {
+        static const uint32_t lookupTable1[16] = { UINT32_C(2147483647), UINT32_C(2147483647),
+            UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2147483647), UINT32_C(2126008810),
+            UINT32_C(2147483647), UINT32_C(2130303777), UINT32_C(2147483647), UINT32_C(2147483647),
+            UINT32_C(2143188679), UINT32_C(2136746228), UINT32_C(2147483647), UINT32_C(2126008810),
+            UINT32_C(2147483647), UINT32_C(2147483647) };
+        static const uint32_t lookupTable2[16] = { UINT32_C(4096000000), UINT32_C(2048000000),
+            UINT32_C(1024000000), UINT32_C(512000000), UINT32_C(255744255), UINT32_C(127110228),
+            UINT32_C(64000000), UINT32_C(32258064), UINT32_C(16016016), UINT32_C(8000000),
+            UINT32_C(4000000), UINT32_C(2000000), UINT32_C(1000000), UINT32_C(500000),
+            UINT32_C(250000), UINT32_C(125000) };
+        uint8_t r;
+
+        for (r = 0; r < BME680_GAS_RANGES; r++) {
+            t->var1[r] = (int64_t) ((1340 + (5 * (int64_t) c->range_sw_err)) * ((int64_t) lookupTable1[r])) >> 16;
+            t->var3[r] = (((int64_t) lookupTable2[r] * (int64_t) t->var1[r]) >> 9);
+        }
+    }
+
+    /*! gas resistance in Ohm from the table */
+    static inline value_t gas(uint16_t gas_res_adc, uint8_t gas_range, const struct gas_table *t)
+    {
+        return gas(gas_res_adc, t->var1[gas_range], t->var3[gas_range]);
+    }
+};
+
+/*=======================================================================
+    floating point kernel (Bosch float formulas), R is float or double
+  -----------------------------------------------------------------------*/
+template <typename R>
+struct bmeRealKernel
+{
+    typedef R value_t;              // type of the results
+    typedef R fine_t;               // type of t_fine
+
+    /*! temperature in C, store t_fine for the other values */
+    static inline value_t temperature(uint32_t temp_adc, const struct bme680_calib_data *c, fine_t *t_fine)
+    {
+        R var1, var2;
+
+        var1 = ((((R) temp_adc / R(16384.0)) - ((R) c->par_t1 / R(1024.0))) * ((R) c->par_t2));
+        var2 = ((((R) temp_adc / R(131072.0)) - ((R) c->par_t1 / R(8192.0))) *
+            (((R) temp_adc / R(131072.0)) - ((R) c->par_t1 / R(8192.0)))) * ((R) c->par_t3 * R(16.0));
+
+        *t_fine = var1 + var2;
+
+        return *t_fine / R(5120.0);
+    }
+
+    /*! pressure in Pa */
+    static inline value_t pressure(uint32_t pres_adc, const struct bme680_calib_data *c, fine_t t_fine)
+    {
+        R var1, var2, var3, calc_pres;
+
+        var1 = ((t_fine / R(2.0)) - R(64000.0));
+        var2 = var1 * var1 * (((R) c->par_p6) / R(131072.0));
+        var2 = var2 + (var1 * ((R) c->par_p5) * R(2.0));
+        var2 = (var2 / R(4.0)) + (((R) c->par_p4) * R(65536.0));
+        var1 = ((((R) c->par_p3 * var1 * var1) / R(16384.0)) + ((R) c->par_p2 * var1)) / R(524288.0);
+        var1 = ((R(1.0) + (var1 / R(32768.0))) * ((R) c->par_p1));
+
+        /* Avoid exception caused by division by zero (without a branch,
+         * so the batch loop can be vectorized) */
+        bool zero = (var1 < R(1.0)) & (var1 > R(-1.0));     // (int) var1 == 0
+        var1 = zero ? R(1.0) : var1;
+
+        calc_pres = R(1048576.0) - ((R) pres_adc);
+        calc_pres = (((calc_pres - (var2 / R(4096.0))) * R(6250.0)) / var1);
+        var1 = (((R) c->par_p9) * calc_pres * calc_pres) / R(2147483648.0);
+        var2 = calc_pres * (((R) c->par_p8) / R(32768.0));
+        var3 = ((calc_pres / R(256.0)) * (calc_pres / R(256.0)) * (calc_pres / R(256.0))
+            * ((R) c->par_p10 / R(131072.0)));
+
+        calc_pres = calc_pres + (var1 + var2 + var3 + ((R) c->par_p7 * R(128.0))) / R(16.0);
+
+        return zero ? R(0.0) : calc_pres;
+    }
+
+    /*! humidity in % */
+    static inline value_t humidity(uint16_t hum_adc, const struct bme680_calib_data *c, fine_t t_fine)
+    {
+        R var1, var2, var3, var4, temp_comp, calc_hum;
+
+        temp_comp = t_fine / R(5120.0);
+
+        var1 = (R) hum_adc - (((R) c->par_h1 * R(16.0)) + (((R) c->par_h3 / R(2.0)) * temp_comp));
+        var2 = var1 * (((R) c->par_h2 / R(262144.0)) * (R(1.0) + (((R) c->par_h4 / R(16384.0)) * temp_comp)
+            + (((R) c->par_h5 / R(1048576.0)) * temp_comp * temp_comp)));
+        var3 = (R) c->par_h6 / R(16384.0);
+        var4 = (R) c->par_h7 / R(2097152.0);
+
+        calc_hum = var2 + ((var3 + (var4 * temp_comp)) * var2 * var2);
+
+        if (calc_hum > R(100.0))
+            calc_hum = R(100.0);
+        else if (calc_hum < R(0.0))
+            calc_hum = R(0.0);
+
+        return calc_hum;
+    }
+
+    /*! gas resistance in Ohm */
+    static inline value_t gas(uint16_t gas_res_adc, uint8_t gas_range, const struct bme680_calib_data *c)
+    {
+        static const R lookup_k1_range[16] = {
+            0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, -0.8, 0.0, 0.0, -0.2, -0.5, 0.0, -1.0, 0.0, 0.0 };
+        static const R lookup_k2_range[16] = {
+            0.0, 0.0, 0.0, 0.0, 0.1, 0.7, 0.0, -0.8, -0.1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        R var1, var2, var3;
+
+        var1 = R(1340.0) + (R(5.0) * c->range_sw_err);
+        var2 = var1 * (R(1.0) + lookup_k1_range[gas_range] / R(100.0));
+        var3 = R(1.0) + (lookup_k2_range[gas_range] / R(100.0));
+
+        return R(1.0) / (var3 * R(0.000000125) * (R) (1 << gas_range) *
+            ((((R) gas_res_adc - R(512.0)) / var2) + R(1.0)));
+    }
+
+    /*! range corrected var2 and scale (var3 * 0.000000125 * 2^range) of all ranges */
+    struct gas_table
+    {
+        R var2[BME680_GAS_RANGES];
+        R scale[BME680_GAS_RANGES];
+    };
+
+    static inline void gas_table_init(const struct bme680_calib_data *c, struct gas_table *t)
+    {
+        static const R lookup_k1_range[16] = {
+            0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0, -0.8, 0.0, 0.0, -0.2, -0.5, 0.0, -1.0, 0.0, 0.0 };
+        static const R lookup_k2_range[16] = {
+            0.0, 0.0, 0.0, 0.0, 0.1, 0.7, 0.0, -0.8, -0.1, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        R var1 = R(1340.0) + (R(5.0) * c->range_sw_err);
+        uint8_t r;
+
+        for (r = 0; r < BME680_GAS_RANGES; r++) {
+            t->var2[r] = var1 * (R(1.0) + lookup_k1_range[r] / R(100.0));
+            t->scale[r] = (R(1.0) + (lookup_k2_range[r] / R(100.0))) * R(0.000000125) * (R) (1 << r);
+        }
+    }
+
+    /*! gas resistance in Ohm from the table */
+    static inline value_t gas(uint16_t gas_res_adc, uint8_t gas_range, const struct gas_table *t)
+    {
+        return R(1.0) / (t->scale[gas_range] * ((((R) gas_res_adc - R(512.0)) / t->var2[gas_range]) + R(1.0)));
+    }
+};
+
+/*=======================================================================
+    compensation of one reading with kernel K
+  -----------------------------------------------------------------------*/
+template <typename K>
+struct bmeComp
+{
+    typename K::value_t temperature;
+    typename K::value_t pressure;
+    typename K::value_t humidity;
+    typename K::value_t gas_resistance;
+};
+
+/*!
+ * @brief compensate the ADC values of a reading
+ * @param raw : ADC values (see bme680_parse_raw())
+ * @param c : calibration data of the sensor
+ * @param out : store results (units depend on K)
+ */
+template <typename K>
+static inline void bme_compensate(const struct bme680_raw_data *raw, const struct bme680_calib_data *c,
+    struct bmeComp<K> *out)
+{
+    typename K::fine_t t_fine;
+
+    out->temperature = K::temperature(raw->adc_temp, c, &t_fine);
+    out->pressure = K::pressure(raw->adc_pres, c, t_fine);
+    out->humidity = K::humidity(raw->adc_hum, c, t_fine);
+    out->gas_resistance = K::gas(raw->adc_gas_res, raw->gas_range, c);
+}
+
+/*=======================================================================
+    batch compensation on columns (structure of arrays)
+  -----------------------------------------------------------------------*/
+
+/*! ADC values of n readings */
+struct bmeAdcColumns
+{
+    const uint32_t  *adc_temp;
+    const uint32_t  *adc_pres;
+    const uint16_t  *adc_hum;
+    const uint16_t  *adc_gas_res;
+    const uint8_t   *gas_range;
+};
+
+/*! results of n readings (units depend on K) */
+template <typename K>
+struct bmeCompColumns
+{
+    typename K::value_t *temperature;
+    typename K::value_t *pressure;
+    typename K::value_t *humidity;
+    typename K::value_t *gas_resistance;
+    typename K::fine_t  *t_fine;        // needed for pressure and humidity
+};
+
+/*!
+ * @brief compensate n readings of one sensor
+ * @param n : number of readings
+ * @param in : ADC columns (a NULL column is skipped)
+ * @param c : calibration data of the sensor
+ * @param out : result columns, t_fine must be provided. A NULL result
+ *              column is skipped
+ *
+ * The columns must not overlap.
+ */
+template <typename K>
+static inline void bme_compensate_batch(uint32_t n, const struct bmeAdcColumns *in,
+    const struct bme680_calib_data *c, const struct bmeCompColumns<K> *out)
+{
+    typedef typename K::value_t value_t;
+    typedef typename K::fine_t fine_t;
+
+    const struct bme680_calib_data cal = *c;
+    fine_t * __restrict__ t_fine = out->t_fine;
+    uint32_t i;
+
+    /* temperature and t_fine, always needed */
+    {
+        const uint32_t * __restrict__ adc = in->adc_temp;
+        value_t * __restrict__ res = out->temperature;
+
+        if (res != NULL) {
+            for (i = 0; i < n; i++)
+                res[i] = K::temperature(adc[i], &cal, &t_fine[i]);
+        }
+        else {
+            for (i = 0; i < n; i++)
+                (void) K::temperature(adc[i], &cal, &t_fine[i]);
+        }
+    }
+
+    if (in->adc_pres != NULL && out->pressure != NULL) {
+        const uint32_t * __restrict__ adc = in->adc_pres;
+        value_t * __restrict__ res = out->pressure;
+
+        for (i = 0; i < n; i++)
+            res[i] = K::pressure(adc[i], &cal, t_fine[i]);
+    }
+
+    if (in->adc_hum != NULL && out->humidity != NULL) {
+        const uint16_t * __restrict__ adc = in->adc_hum;
+        value_t * __restrict__ res = out->humidity;
+
+        for (i = 0; i < n; i++)
+            res[i] = K::humidity(adc[i], &cal, t_fine[i]);
+    }
+
+    if (in->adc_gas_res != NULL && in->gas_range != NULL && out->gas_resistance != NULL) {
+        const uint16_t * __restrict__ adc = in->adc_gas_res;
+        const uint8_t * __restrict__ range = in->gas_range;
+        value_t * __restrict__ res = out->gas_resistance;
+        typename K::gas_table tab;
+
+        /* range products once per batch instead of per reading */
+        K::gas_table_init(&cal, &tab);
+
+        for (i = 0; i < n; i++)
+            res[i] = K::gas(adc[i], range[i] & BME680_GAS_RANGE_MSK, &tab);
+    }
+}
+
+#endif /* __BME680_COMP_H__ */
@@ -214,6 +214,7 @@
 /** SPI memory page settings */
 #define BME680_MEM_PAGE0    UINT8_C(0x10)
 #define BME680_MEM_PAGE1    UINT8_C(0x00)
+#define BME680_MEM_PAGE_UNKNOWN UINT8_C(0xff)
 
 /** Ambient humidity shift value for compensation */
 #define BME680_HUM_REG_SHIFT_VAL    UINT8_C(4)
@@ -243,6 +244,15 @@
 #define BME680_NBCONV_MIN       UINT8_C(0)
 #define BME680_NBCONV_MAX       UINT8_C(10)
 
+/** Number of heater set-points (paulvha) */
+#define BME680_HEATR_PROF_MAX   UINT8_C(10)
+
+/** Precomputed tables (paulvha) */
+#define BME680_HEATR_TEMP_MAX   UINT16_C(400)
+#define BME680_GAS_RANGES       UINT8_C(16)
+#define BME680_TABLE_GAS        UINT8_C(1)
+#define BME680_TABLE_HEATR      UINT8_C(2)
+
 /** Mask definitions */
 #define BME680_GAS_MEAS_MSK UINT8_C(0x30)
 #define BME680_NBCONV_MSK   UINT8_C(0X0F)
@@ -352,7 +362,7 @@
  * @param[in/out] reg_data: Data array to read/write
  * @param[in] len: Length of the data array
  */
-typedef int8_t (*bme680_com_fptr_t)(uint8_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
+typedef int8_t (*bme680_com_fptr_t)(uint16_t dev_id, uint8_t reg_addr, uint8_t *data, uint16_t len);
 
 /*!
  * Delay function pointer
@@ -405,6 +415,28 @@ struct  bme680_field_data {
 
 };
 
+/*!
+ * @brief Raw (not compensated) field data (paulvha)
+ */
+struct  bme680_raw_data {
+    /*! Contains new_data, gasm_valid & heat_stab */
+    uint8_t status;
+    /*! The index of the heater profile used */
+    uint8_t gas_index;
+    /*! Measurement index to track order */
+    uint8_t meas_index;
+    /*! Gas resistance range */
+    uint8_t gas_range;
+    /*! Temperature ADC value (20 bits) */
+    uint32_t adc_temp;
+    /*! Pressure ADC value (20 bits) */
+    uint32_t adc_pres;
+    /*! Humidity ADC value */
+    uint16_t adc_hum;
+    /*! Gas resistance ADC value (10 bits) */
+    uint16_t adc_gas_res;
+};
+
 /*!
  * @brief Structure to hold the Calibration data
  */
@@ -503,6 +535,39 @@ struct  bme680_gas_sett {
     uint16_t heatr_dur;
 };
 
+/*!
+ * @brief BME680 heater profile with up to 10 set-points (paulvha)
+ */
+struct  bme680_heatr_prof {
+    /*! Number of set-points used (1 - BME680_HEATR_PROF_MAX) */
+    uint8_t len;
+    /*! Heater temperature of each set-point in degree C */
+    uint16_t heatr_temp[BME680_HEATR_PROF_MAX];
+    /*! Heating duration of each set-point in ms */
+    uint16_t heatr_dur[BME680_HEATR_PROF_MAX];
+};
+
+/*!
+ * @brief Tables precomputed from the calibration data (paulvha)
+ */
+struct  bme680_tables {
+#ifndef BME680_FLOAT_POINT_COMPENSATION
+    /*! gas_range x calibration products (var1 and var3) per gas range */
+    int64_t gas_var1[BME680_GAS_RANGES];
+    int64_t gas_var3[BME680_GAS_RANGES];
+#else
+    /*! range corrected var2 and scale per gas range */
+    float gas_var2[BME680_GAS_RANGES];
+    float gas_scale[BME680_GAS_RANGES];
+#endif
+    /*! res_heat register value for heater temperature 0 - 400 C */
+    uint8_t res_heat[BME680_HEATR_TEMP_MAX + 1];
+    /*! Ambient temperature the res_heat table was made with */
+    int8_t res_heat_amb;
+    /*! Valid tables (BME680_TABLE_GAS | BME680_TABLE_HEATR) */
+    uint8_t valid;
+};
+
 /*!
  * @brief BME680 device structure
  */
@@ -510,7 +575,7 @@ struct  bme680_dev {
     /*! Chip Id */
     uint8_t chip_id;
     /*! Device Id */
-    uint8_t dev_id;
+    uint16_t dev_id;
     /*! SPI/I2C interface */
     enum bme680_intf intf;
     /*! Memory page used */
@@ -537,6 +602,8 @@ struct  bme680_dev {
     bme680_delay_fptr_t delay_ms;
     /*! Communication function result */
     int8_t com_rslt;
+    /*! Precomputed tables (paulvha) */
+    struct bme680_tables tables;
 };
 
 
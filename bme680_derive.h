@@ -0,0 +1,232 @@
+/***********************************************************************
+ *
+ * Derived values of a BME680 reading : altitude and dew point
+ *
+ * October 2026 / paulvha
+ *
+ * The values are calculated from an existing reading, no new
+ * conversion is done. Each one has an exact version (pow() / log(), as
+ * used before) and a fast version with tables made once
+ * (bme_derive_init()), plus a batch version over arrays for
+ * reprocessing captured readings.
+ *
+ *  altitude : 44330 * (1 - (pressure / sea level) ^ 0.190284)
+ *     fast  : linear interpolation in a table of the power function over
+ *             the ratio BME680_ALT_RMIN - BME680_ALT_RMAX (pow() outside).
+ *             Largest difference with pow() 0.12 m for 300 - 1100 hPa
+ *             at sea level 1013.25 hPa (BME680_ALT_ERROR).
+ *
+ *  dew point : Magnus formula, ln(humidity / 100) per reading
+ *     fast   : ln from the float exponent and a table of log2 over the
+ *             mantissa. Largest difference with log() 0.0001 C for
+ *             1 - 100 % and -40 - 85 C (BME680_DEW_ERROR).
+ *
+ * Usage :
+ *  struct bmeDerive d;
+ *  bme_derive_init(&d);
+ *  alt = bme_altitude_fast(&d, pressure, seaLevel);
+ *  bme_dewpoint_batch(n, temp, hum, dew, &d);     // NULL = exact
+ *
+ * bme680bench compares the time and difference on the target CPU.
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_DERIVE_H__
+#define __BME680_DERIVE_H__
+
+# include <stdint.h>
+# include <string.h>
+# include <math.h>
+
+/*! altitude table : ratio pressure / sea level pressure */
+# define BME680_ALT_RMIN    0.25f
+# define BME680_ALT_RMAX    1.25f
+# define BME680_ALT_STEPS   256         // intervals over RMIN - RMAX
+# define BME680_ALT_ERROR   0.12f       // m, 300 - 1100 hPa
+
+/*! dew point : log2 table over the mantissa (1 - 2) */
+# define BME680_LOG_BITS    8
+# define BME680_LOG_STEPS   (1 << BME680_LOG_BITS)
+# define BME680_DEW_ERROR   0.0001f     // C
+
+struct bmeDerive
+{
+    float   alt[BME680_ALT_STEPS + 1];  // ratio ^ 0.190284
+    float   log2m[BME680_LOG_STEPS + 1];// log2(1 + i / BME680_LOG_STEPS)
+};
+
+/*********************************************************************
+ * @brief : make the tables for the fast versions
+ * @param d : store tables
+ *********************************************************************/
+static inline void bme_derive_init(struct bmeDerive *d)
+{
+    int i;
+
+    for (i = 0; i <= BME680_ALT_STEPS; i++)
+        d->alt[i] = (float) pow(BME680_ALT_RMIN + (double) i * (BME680_ALT_RMAX - BME680_ALT_RMIN) /
+            BME680_ALT_STEPS, 0.190284);
+
+    for (i = 0; i <= BME680_LOG_STEPS; i++)
+        d->log2m[i] = (float) log2(1.0 + (double) i / BME680_LOG_STEPS);
+}
+
+/*********************************************************************
+ * @brief : altitude with pow()
+ * @param pressure : atmospheric pressure in Pascal
+ * @param seaLevel : sea-level pressure in Pascal
+ *
+ * @return : altitude in meters
+ *********************************************************************/
+static inline float bme_altitude(float pressure, float seaLevel)
+{
+    // Equation taken from BMP180 datasheet (page 16):
+    //  http://www.adafruit.com/datasheets/BST-BMP180-DS000-09.pdf
+
+    // Note that using the equation from wikipedia can give bad results
+    // at high altitude. See this thread for more information:
+    //  http://forums.adafruit.com/viewtopic.php?f=22&t=58064
+
+    return 44330.0 * (1.0 - pow(pressure / seaLevel, 0.190284));
+}
+
+/*********************************************************************
+ * @brief : altitude with the table
+ * @param d : tables (bme_derive_init())
+ * @param pressure : atmospheric pressure in Pascal
+ * @param seaLevel : sea-level pressure in Pascal
+ *
+ * @return : altitude in meters
+ *********************************************************************/
+static inline float bme_altitude_fast(const struct bmeDerive *d, float pressure, float seaLevel)
+{
+    float   x = (pressure / seaLevel - BME680_ALT_RMIN) *
+                (BME680_ALT_STEPS / (BME680_ALT_RMAX - BME680_ALT_RMIN));
+    int     i;
+
+    /* also catches NAN */
+    if (! (x >= 0 && x < BME680_ALT_STEPS)) return(bme_altitude(pressure, seaLevel));
+
+    i = (int) x;
+    x -= i;
+
+    return 44330.0f * (1.0f - (d->alt[i] + x * (d->alt[i + 1] - d->alt[i])));
+}
+
+/*********************************************************************
+ * @brief : dew point with log(), Augst-Roche-Magnus approximation
+ * @param temp : temperature in celsius
+ * @param hum : relative humidity in %
+ *
+ * @return : dew point in celsius
+ *********************************************************************/
+static inline float bme_dewpoint(float temp, float hum)
+{
+    float td, H;
+
+    H = log(hum/100) + ((17.625 * temp) / (243.12 + temp));
+    td = 243.04 * H / (17.625 - H);
+
+    return(td);
+}
+
+/*********************************************************************
+ * @brief : natural logarithm with the table
+ * @param d : tables (bme_derive_init())
+ * @param x : value > 0, normal float
+ *********************************************************************/
+static inline float bme_log_fast(const struct bmeDerive *d, float x)
+{
+    uint32_t bits, m;
+    float    f;
+    int      e, i;
+
+    memcpy(&bits, &x, sizeof(bits));
+
+    e = (int) ((bits >> 23) & 0xff) - 127;
+    m = bits & 0x7fffff;
+    i = m >> (23 - BME680_LOG_BITS);
+    f = (float) (m & ((1 << (23 - BME680_LOG_BITS)) - 1)) * (1.0f / (1 << (23 - BME680_LOG_BITS)));
+
+    return(((float) e + d->log2m[i] + f * (d->log2m[i + 1] - d->log2m[i])) * 0.69314718f);
+}
+
+/*********************************************************************
+ * @brief : dew point with the table
+ * @param d : tables (bme_derive_init())
+ * @param temp : temperature in celsius
+ * @param hum : relative humidity in %
+ *
+ * @return : dew point in celsius
+ *********************************************************************/
+static inline float bme_dewpoint_fast(const struct bmeDerive *d, float temp, float hum)
+{
+    float H;
+
+    /* 0, negative, NAN, denormal or infinite */
+    if (! (hum >= 1e-30f && hum <= 1e30f)) return(bme_dewpoint(temp, hum));
+
+    H = bme_log_fast(d, hum * 0.01f) + ((17.625f * temp) / (243.12f + temp));
+
+    return(243.04f * H / (17.625f - H));
+}
+
+/*********************************************************************
+ * @brief : altitude of a set of readings
+ * @param n : number of readings
+ * @param pressure : atmospheric pressures in Pascal
+ * @param seaLevel : sea-level pressure in Pascal
+ * @param alt : store altitudes in meters
+ * @param d : tables (bme_derive_init()) or NULL to use pow()
+ *********************************************************************/
+static inline void bme_altitude_batch(uint32_t n, const float * __restrict pressure, float seaLevel,
+    float * __restrict alt, const struct bmeDerive *d)
+{
+    uint32_t i;
+
+    if (d == NULL)
+    {
+        for (i = 0; i < n; i++) alt[i] = bme_altitude(pressure[i], seaLevel);
+    }
+    else
+    {
+        for (i = 0; i < n; i++) alt[i] = bme_altitude_fast(d, pressure[i], seaLevel);
+    }
+}
+
+/*********************************************************************
+ * @brief : dew point of a set of readings
+ * @param n : number of readings
+ * @param temp : temperatures in celsius
+ * @param hum : relative humidities in %
+ * @param dew : store dew points in celsius
+ * @param d : tables (bme_derive_init()) or NULL to use log()
+ *********************************************************************/
+static inline void bme_dewpoint_batch(uint32_t n, const float * __restrict temp, const float * __restrict hum,
+    float * __restrict dew, const struct bmeDerive *d)
+{
+    uint32_t i;
+
+    if (d == NULL)
+    {
+        for (i = 0; i < n; i++) dew[i] = bme_dewpoint(temp[i], hum[i]);
+    }
+    else
+    {
+        for (i = 0; i < n; i++) dew[i] = bme_dewpoint_fast(d, temp[i], hum[i]);
+    }
+}
+
+#endif /* __BME680_DERIVE_H__ */
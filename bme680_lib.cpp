@@ -63,54 +63,275 @@
 
 
 #include "rasp_BME680.h"
+#include "bme680_comp.h"
+#include "bme680_derive.h"
+#include <sys/file.h>
 
 /* debug messages */
 int _bme_debug=0;
 
-/* global constructor for I2C (hardware of software) */
-TwoWire TWI;
+/* I2C trace (make TRACE=1), without it the I2C callbacks have no debug code */
+#ifdef BME680_TRACE
+#define BME680_TRACE_I2C(bme, reg, len, write, result, retry) \
+    (bme)->trace(reg, len, write, result, retry)
+#else
+#define BME680_TRACE_I2C(bme, reg, len, write, result, retry)
+#endif
+
+/* I2C channels (hardware or software), shared by the instances on the
+ * same interface and GPIO's */
+struct bmeBus
+{
+    TwoWire     TWI;
+    bool        I2C_interface;      // hard_I2C or soft_I2C
+    uint8_t     sda;                // SDA GPIO (soft_I2C only)
+    uint8_t     scl;                // SCL GPIO (soft_I2C only)
+    int         users;              // instances using this channel
+    uint16_t    baudrate;           // clock in Khz (hard_I2C only, else 0)
+    uint8_t     errors;             // NACK / clock stretch in a row above BME680_SPEED
+};
+
+static void bus_clock(struct bmeBus *bus, uint16_t khz);
+
+static struct bmeBus _buses[BME680_MAX_BUSES];
+
+/* instances that have been started, index is the Bosch dev_id */
+static rasp_BME680 *_instances[BME680_MAX_DEVICES];
+
+/* the SPI channel, shared by the instances on either chip select */
+static int _spiUsers = 0;
+static uint32_t _spiHz = 0;            // clock that was set last
 
 /* Our hardware interface functions */
-static int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
-static int8_t i2c_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
 static void delay_msec(uint32_t ms);
 static unsigned long millis();
+static uint32_t micros_mono();
 
 // needed for millis()
 struct timeval tv, tv_s;
+static bool tv_s_set = false;
 
-/* holds the I2C information */
-struct bmeI2C_p I2Csettings;
+/*! tables for the fast altitude and dew point, shared by all instances */
+static struct bmeDerive _derive;
+static bool _deriveSet = false;
 
 /*********************************************************************
  PUBLIC FUNCTIONS
  *********************************************************************/
 
 /*********************************************************************
- *    @brief  Instantiates sensor with Hardware I2C.
+ *    @brief  Instantiates sensor with default soft I2C settings.
  *********************************************************************/
 rasp_BME680::rasp_BME680() {
-    I2Csettings.sda = DEF_SDA;
-    I2Csettings.scl = DEF_SCL;
-    I2Csettings.I2C_interface = soft_I2C;
-    I2Csettings.I2C_Address = BME680_DEFAULT_ADDRESS;
-    I2Csettings.baudrate = BME680_SPEED;
+    _i2c.hw_initialized = false;
+    _i2c.sda = DEF_SDA;
+    _i2c.scl = DEF_SCL;
+    _i2c.I2C_interface = soft_I2C;
+    _i2c.I2C_Address = BME680_DEFAULT_ADDRESS;
+    _i2c.baudrate = BME680_SPEED;
+    _bus = NULL;
+    _backend = BME680_BUS_I2C;
+    _replayFile = NULL;
+    _replaySpeed = 1.0;
+    _sim = NULL;
+    _spiCs = BME680_SPI_CS;
+    _spiSpeed = BME680_SPI_SPEED;
+    _spiOpen = false;
 
   _filterEnabled = _tempEnabled = _humEnabled = _presEnabled = _gasEnabled = false;
+  _meas_end = 0;
+  _ring = NULL;
+  _ringSize = _ringHead = _ringCount = 0;
+  _ringOverrun = 0;
+  _profile.len = _heatrStep = 0;
+  _dirty = 0;
+  _idle = false;
+  memset(_shadow, 0x0, sizeof(_shadow));
+  memset(&gas_sensor, 0x0, sizeof(gas_sensor));
+  memset(&_raw, 0x0, sizeof(_raw));
+  memset(&_stats, 0x0, sizeof(_stats));
+  _tBegin = 0;
+  memset(&_timing, 0x0, sizeof(_timing));
+  _tConfigEnd = 0;
+  _startTrans = _startBytes = 0;
+  _sampleTrans = _sampleBytes = 0;
+  _calibFile = NULL;
+  _fastDerived = false;
+  _iaqEnabled = false;
+  memset(&_iaq, 0x0, sizeof(_iaq));
+  _adaptive = _convTrack = false;
+  _convDev = 0;
+  _convEst = 0;
+  _convN = _convProbe = 0;
+  _tPoll = 0;
+  _dutyGas = 0;
+  _gasPlanned = _lastGasSet = false;
+  _gasDue = _lastGasTime = 0;
+  _lastGas = 0;
+  _lastGasIndex = 0;
+#ifdef BME680_TRACE
+  _traceHead = _traceCount = 0;
+#endif
+}
+
+/*********************************************************************
+ *    @brief  release instance
+ *********************************************************************/
+rasp_BME680::~rasp_BME680() {
+    hw_close();
+}
+
+/*********************************************************************
+ * @brief  set calibration cache file. Call before begin()
+ * @param file : file name or NULL for none
+ *
+ * With a cache file begin() does not reset the BME680 and read the
+ * calibration, but reads the chip id and coefficient block 2 to check
+ * the cached record for this interface / address is still valid.
+ *********************************************************************/
+void rasp_BME680::setCalibFile(const char *file) {
+    _calibFile = file;
+}
+
+/*********************************************************************
+ * @brief  enable or disable the adaptive conversion wait
+ * @param enable : true = wait the learned conversion time
+ *
+ * The estimate of bme680_get_profile_dur() is a fixed formula and the
+ * BME680 is typically ready well before it. In adaptive mode the status
+ * is polled before the estimate and the moment new data is seen is kept
+ * as an EWMA of the deviation from the estimate. Once learned, the wait
+ * is the estimate + deviation + margin, never longer than the estimate.
+ * Every BME680_CONV_PROBE readings wait below the learned time to follow
+ * a shorter conversion, a longer one is found with status polls.
+ *********************************************************************/
+void rasp_BME680::setAdaptiveWait(bool enable) {
+    _adaptive = enable;
+    _convN = 0;
+}
+
+/*********************************************************************
+ * @brief  select the calculation of altitude and dew point
+ * @param enable : true = tables (bme680_derive.h), false = pow() / log()
+ *
+ * The tables are made on the first enable. Call before sampling starts
+ * when instances are used from more than one thread.
+ *********************************************************************/
+void rasp_BME680::setFastDerived(bool enable) {
+
+    if (enable && ! _deriveSet) {
+        bme_derive_init(&_derive);
+        _deriveSet = true;
+    }
+
+    _fastDerived = enable;
+}
+
+/*********************************************************************
+ * @brief  select the bus backend. Call before begin()
+ * @param backend : BME680_BUS_I2C, _SPI, _SIM or _REPLAY
+ * @param file : capture file to replay (bme680m -X)
+ * @param speed : replay speed, 1 = as captured, 0 = as fast as possible
+ *
+ * SPI and a simulated BME680 need no I2C channel, the I2C settings are
+ * not used. See setSPIsettings() and bme680_sim.h
+ *********************************************************************/
+void rasp_BME680::setBackend(uint8_t backend, const char *file, float speed) {
+    _backend = backend;
+    _replayFile = file;
+    _replaySpeed = speed;
+}
+
+/*********************************************************************
+ * @brief  set SPI chip select and clock. Call before begin()
+ * @param cs : BCM2835_SPI_CS0 or BCM2835_SPI_CS1
+ * @param speed_hz : SPI clock (BME680 maximum 10 MHz)
+ *
+ * Used with setBackend(BME680_BUS_SPI), the I2C settings are not used.
+ *********************************************************************/
+void rasp_BME680::setSPIsettings(uint8_t cs, uint32_t speed_hz) {
+    _spiCs = cs;
+    _spiSpeed = speed_hz;
+}
+
+/*********************************************************************
+ * @brief  set I2C interface, GPIO, address and speed. Call before begin()
+ * @param settings : I2C settings to use
+ *********************************************************************/
+void rasp_BME680::setI2Csettings(struct bmeI2C_p *settings) {
+    _i2c = *settings;
+    _i2c.hw_initialized = false;
+}
+
+/*********************************************************************
+ * @brief  obtain I2C settings of this instance
+ * @param settings : store the I2C settings
+ *********************************************************************/
+void rasp_BME680::getI2Csettings(struct bmeI2C_p *settings) {
+    *settings = _i2c;
 }
 
 /********************************************************************
  * @brief  close Hardware correctly on the Raspberry Pi
+ * 
+ * The I2C or SPI channel is only closed when the last instance using
+ * it is closed.
  ********************************************************************/
 void rasp_BME680::hw_close( void ) {
-    TWI.close();
+
+    stopStream();
+
+    if (_i2c.hw_initialized) {
+        _instances[gas_sensor.dev_id] = NULL;
+        _i2c.hw_initialized = false;
+    }
+
+    if (_sim != NULL) {
+        bme_sim_close(_sim);
+        _sim = NULL;
+    }
+
+    if (_spiOpen) {
+        _spiOpen = false;
+
+        if (--_spiUsers == 0) {
+            bcm2835_spi_end();
+            _spiHz = 0;
+
+            /* keep the BCM2835 library for a hard_I2C channel */
+            for (int i = 0; i < BME680_MAX_BUSES; i++) {
+                if (_buses[i].users > 0) return;
+            }
+
+            bcm2835_close();
+        }
+    }
+
+    if (_bus == NULL) return;
+
+    if (--_bus->users == 0) _bus->TWI.close();
+
+    _bus = NULL;
 }
 
 /*********************************************************************
  * @brief  Strictly software reset.  Run .begin() afterwards
  *******************************************************************/
 void rasp_BME680::reset( void ) {
-    bme680_soft_reset(&gas_sensor);
+    uint8_t cmd = BME680_SOFT_RESET_CMD;
+
+    /* simulated : no need for the reset wait of the Bosch driver */
+    if (_sim != NULL && _instances[gas_sensor.dev_id] == this)
+        bme_sim_write(_sim, BME680_SOFT_RESET_ADDR, &cmd, 1);
+    else
+        bme680_soft_reset(&gas_sensor);
+
+    /* all registers are back to default (0x0) */
+    memset(_shadow, 0x0, sizeof(_shadow));
+    _dirty = BME680_OST_SEL | BME680_OSP_SEL | BME680_OSH_SEL | BME680_FILTER_SEL |
+             BME680_GAS_SENSOR_SEL;
+    _idle = true;
+    _meas_end = 0;
 }
 
 /*********************************************************************
@@ -133,18 +354,79 @@ void rasp_BME680::setDebug( int level ) {
 /*********************************************************************/
 bool rasp_BME680::begin() {
 
-    if (TWI.begin(I2Csettings.I2C_interface,I2Csettings.sda,I2Csettings.scl))
-    {
-        p_printf(RED,(char *) "Error during starting I2C\n");
+    uint16_t i;
+
+    /* set start time for millis(), shared by all instances */
+    if (! tv_s_set) {
+        gettimeofday(&tv_s, NULL);
+        tv_s_set = true;
+    }
+
+    /* in case of restart */
+    hw_close();
+
+    if (_backend == BME680_BUS_I2C && ! openBus()) return(false);
+    if (_backend == BME680_BUS_SPI && ! openSPI()) return(false);
+
+    /* register the instance, index is used as dev_id by the Bosch driver */
+    for (i = 0; i < BME680_MAX_DEVICES; i++) {
+        if (_instances[i] == NULL) break;
+    }
+
+    if (i == BME680_MAX_DEVICES) {
+        p_printf(RED,(char *) "Too many BME680 instances (max %d)\n", BME680_MAX_DEVICES);
+        hw_close();
         return(false);
     }
 
+    _instances[i] = this;
+    _i2c.hw_initialized = true;
+
+    gas_sensor.dev_id = i;
     gas_sensor.read = &i2c_read;
     gas_sensor.write = &i2c_write;
-    gas_sensor.delay_ms = &delay_msec;
+
     gas_sensor.intf= BME680_I2C_INTF;   // set I2C
 
-    if (bme680_init(&gas_sensor) != BME680_OK) return false;
+    if (_backend == BME680_BUS_SPI) {
+        gas_sensor.read = &spi_read;
+        gas_sensor.write = &spi_write;
+        gas_sensor.intf = BME680_SPI_INTF;
+
+        /* read from the BME680 on the first register access */
+        gas_sensor.mem_page = BME680_MEM_PAGE_UNKNOWN;
+    }
+
+    /* simulated BME680 instead of I2C */
+    else if (_backend != BME680_BUS_I2C) {
+
+        if ((_sim = bme_sim_open(_backend, i, _replayFile, _replaySpeed)) == NULL) {
+            hw_close();
+            return(false);
+        }
+
+        gas_sensor.read = &sim_read;
+        gas_sensor.write = &sim_write;
+    }
+    gas_sensor.delay_ms = &delay_msec;
+
+    /* calibration from the cache file if it is the same sensor, else
+     * reset the BME680 and read (and save) the calibration */
+    if (initCached()) {
+        /* state left by a previous program is not known */
+        _idle = false;
+    }
+    else {
+        if (bme680_init(&gas_sensor) != BME680_OK) {
+            hw_close();
+            return false;
+        }
+
+        /* after soft reset in bme680_init() the BME680 is in sleep mode */
+        _idle = true;
+
+        if (_calibFile != NULL) calibSave();
+    }
 
     if (_bme_debug)
     {
@@ -176,6 +458,18 @@ bool rasp_BME680::begin() {
         printf("SW Error = %d\n",gas_sensor.calib.range_sw_err);
     }
 
+    /* obtain the current configuration registers for the shadow */
+    if (bme680_get_regs(BME680_CONF_HEAT_CTRL_ADDR, _shadow, BME680_REG_BUFFER_LENGTH, &gas_sensor) != BME680_OK) {
+        hw_close();
+        return false;
+    }
+
+    _meas_end = 0;
+
+    /* write all settings on first reading */
+    _dirty = BME680_OST_SEL | BME680_OSP_SEL | BME680_OSH_SEL | BME680_FILTER_SEL |
+             BME680_GAS_SENSOR_SEL;
+
     /* set default values and enable */
     setTemperatureOversampling(BME680_OS_8X);
     setHumidityOversampling(BME680_OS_2X);
@@ -186,228 +480,1554 @@ bool rasp_BME680::begin() {
     /* don't do anything till we request a reading */
     gas_sensor.power_mode = BME680_FORCED_MODE;
 
-    /* set start time for millis() */
-    gettimeofday(&tv_s, NULL);
-
     return true;
 }
 
-/*********************************************************************/
+/********************************************************************/
 /*!
-    @brief Performs a reading and returns the ambient temperature.
-    @return Temperature in degrees Centigrade
+    @brief open the SPI channel for this instance
+
+    The SPI channel is shared by all SPI instances, each selects its
+    own chip select and clock on a transfer.
+
+    @return True on success. False on failure.
 */
 /*********************************************************************/
-uint32_t rasp_BME680::readGas(void) {
-  performReading();
-  return(gas_resistance);
+bool rasp_BME680::openSPI() {
+
+    if (_spiCs != BCM2835_SPI_CS0 && _spiCs != BCM2835_SPI_CS1) {
+        p_printf(RED,(char *) "Invalid SPI chip select %d\n", _spiCs);
+        return(false);
+    }
+
+    if (_spiUsers == 0) {
+
+        if (! bcm2835_init()) {
+            p_printf(RED,(char *) "Can not initialize the BCM2835 library\n");
+            return(false);
+        }
+
+        if (! bcm2835_spi_begin()) {
+            p_printf(RED,(char *) "Error during starting SPI (root permission ?)\n");
+            return(false);
+        }
+
+        bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+        bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+        bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
+        bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS1, LOW);
+        _spiHz = 0;
+    }
+
+    _spiUsers++;
+    _spiOpen = true;
+
+    return(true);
 }
 
-/*********************************************************************/
+/********************************************************************/
 /*!
-    @brief Performs a reading and returns the ambient temperature.
-    @return Temperature in degrees Celcius
+    @brief open the I2C channel for this instance
+
+    An I2C channel that was already opened by another instance on the
+    same interface (and for soft_I2C the same GPIO's) is shared. The
+    hard_I2C clock is the lowest baudrate of the instances using it.
+
+    @return True on success. False on failure.
 */
 /*********************************************************************/
-float rasp_BME680::readTemperature(void) {
-  performReading();
-  return(temperature);
+bool rasp_BME680::openBus() {
+
+    int i, empty = -1;
+
+    if (_i2c.I2C_interface == hard_I2C &&
+       (_i2c.baudrate < 1 || _i2c.baudrate > BME680_SPEED_FAST)) {
+        p_printf(RED,(char *) "Invalid I2C speed %d Khz (1 - %d)\n", _i2c.baudrate, BME680_SPEED_FAST);
+        return(false);
+    }
+
+    for (i = 0; i < BME680_MAX_BUSES; i++) {
+
+        if (_buses[i].users == 0) {
+            if (empty == -1) empty = i;
+            continue;
+        }
+
+        if (_buses[i].I2C_interface != _i2c.I2C_interface) continue;
+
+        /* there is only one hard_I2C channel */
+        if (_i2c.I2C_interface == hard_I2C ||
+           (_buses[i].sda == _i2c.sda && _buses[i].scl == _i2c.scl)) {
+            _bus = &_buses[i];
+            _bus->users++;
+
+            if (_i2c.I2C_interface == hard_I2C && _i2c.baudrate < _bus->baudrate)
+                bus_clock(_bus, _i2c.baudrate);
+
+            return(true);
+        }
+    }
+
+    if (empty == -1) {
+        p_printf(RED,(char *) "Too many I2C channels (max %d)\n", BME680_MAX_BUSES);
+        return(false);
+    }
+
+    if (_buses[empty].TWI.begin(_i2c.I2C_interface,_i2c.sda,_i2c.scl))
+    {
+        p_printf(RED,(char *) "Error during starting I2C\n");
+        return(false);
+    }
+
+    _bus = &_buses[empty];
+    _bus->I2C_interface = _i2c.I2C_interface;
+    _bus->sda = _i2c.sda;
+    _bus->scl = _i2c.scl;
+    _bus->users = 1;
+    _bus->baudrate = 0;
+
+    /* soft_I2C : bit-banged with the timing of the twowire library */
+    if (_i2c.I2C_interface == hard_I2C) bus_clock(_bus, _i2c.baudrate);
+
+    return(true);
+}
+
+/*********************************************************************
+    @brief fill the key of a file record of this sensor
+    @param key : key to fill
+    @param magic : BME680_CALIB_MAGIC or BME680_IAQ_MAGIC
+    @param version : version of the record
+**********************************************************************/
+void rasp_BME680::recKey(struct bmeRecKey *key, const char *magic, uint8_t version) {
+
+  memset(key, 0x0, sizeof(struct bmeRecKey));
+  memcpy(key->magic, magic, sizeof(key->magic));
+  key->version = version;
+  key->interface = _i2c.I2C_interface;
+  key->address = _i2c.I2C_Address;
+
+  if (_i2c.I2C_interface == soft_I2C) {
+    key->sda = _i2c.sda;
+    key->scl = _i2c.scl;
+  }
+
+  /* SPI or simulated : not the same sensor as on I2C. A simulated
+   * sensor is keyed by its instance (dev_id, up to 16 bits) */
+  if (_backend != BME680_BUS_I2C) {
+    key->interface = BME680_KEY_BUS + _backend;
+    key->scl = 0;
+
+    if (_backend == BME680_BUS_SPI) {
+      key->address = _spiCs;
+      key->sda = 0;
+    }
+    else {
+      key->address = gas_sensor.dev_id & 0xff;
+      key->sda = gas_sensor.dev_id >> 8;
+    }
+  }
+}
+
+/* largest file record (struct bmeCalibRec) */
+# define BME680_REC_MAX 128
+
+/*********************************************************************
+    @brief find the record with the key in a file (shared lock)
+    @param file : file name
+    @param rec : record, starts with the key to find. Store the record
+    @param size : record size
+
+    @return True if found, False if not (or no file)
+**********************************************************************/
+static bool rec_load(const char *file, void *rec, size_t size) {
+
+  uint8_t buf[BME680_REC_MAX];
+  bool found = false;
+  FILE *fp;
+
+  if (size > BME680_REC_MAX) return(false);
+
+  fp = fopen(file, "rb");
+  if (fp == NULL) return(false);
+
+  flock(fileno(fp), LOCK_SH);
+
+  while (fread(buf, size, 1, fp) == 1) {
+    if (memcmp(buf, rec, sizeof(struct bmeRecKey)) == 0) {
+      memcpy(rec, buf, size);
+      found = true;
+      break;
+    }
+  }
+
+  fclose(fp);
+
+  return(found);
+}
+
+/*********************************************************************
+    @brief replace the record with the same key in a file, else add it
+    (exclusive lock)
+    @param file : file name
+    @param rec : record, starts with the key
+    @param size : record size
+    @param what : file description for the messages
+
+    @return True if OK, False on error (reported)
+**********************************************************************/
+static bool rec_save(const char *file, const void *rec, size_t size, const char *what) {
+
+  uint8_t buf[BME680_REC_MAX];
+  long pos = 0;
+  bool ok;
+  FILE *fp;
+
+  if (size > BME680_REC_MAX) return(false);
+
+  fp = fopen(file, "r+b");
+  if (fp == NULL) fp = fopen(file, "w+b");
+
+  if (fp == NULL) {
+    p_printf(RED, (char *) "Can not open %s file %s\n", what, file);
+    return(false);
+  }
+
+  flock(fileno(fp), LOCK_EX);
+
+  while (fread(buf, size, 1, fp) == 1) {
+    if (memcmp(buf, rec, sizeof(struct bmeRecKey)) == 0) break;
+    pos++;
+  }
+
+  ok = fseek(fp, pos * (long) size, SEEK_SET) == 0 && fwrite(rec, size, 1, fp) == 1;
+
+  if (fclose(fp) != 0) ok = false;
+
+  if (! ok) p_printf(RED, (char *) "Issue during writing %s file %s\n", what, file);
+
+  return(ok);
+}
+
+/*********************************************************************
+    @brief initialize with the calibration from the cache file
+
+    The record for this interface / address is only used if the chip id
+    and coefficient block 2 read from the sensor match (1 + 16 bytes),
+    else another BME680 might have been connected.
+
+    @return True if initialized, False if not (no cache, no record or
+    no match)
+**********************************************************************/
+bool rasp_BME680::initCached(void) {
+
+  struct bmeCalibRec rec;
+  uint8_t check[BME680_COEFF_ADDR2_LEN];
+
+  if (_calibFile == NULL) return(false);
+
+  recKey(&rec.key, BME680_CALIB_MAGIC, BME680_CALIB_VERSION);
+
+  if (! rec_load(_calibFile, &rec, sizeof(struct bmeCalibRec))) return(false);
+
+  if (bme680_get_regs(BME680_COEFF_ADDR2, check, BME680_COEFF_ADDR2_LEN, &gas_sensor) != BME680_OK)
+    return(false);
+
+  if (memcmp(check, rec.check, BME680_COEFF_ADDR2_LEN) != 0) {
+    if (_bme_debug) printf("Calibration in %s is for another sensor\n", _calibFile);
+    return(false);
+  }
+
+  if (bme680_init_calib(&rec.calib, &gas_sensor) != BME680_OK || gas_sensor.chip_id != rec.chip_id)
+    return(false);
+
+  if (_bme_debug) printf("Calibration from %s\n", _calibFile);
+
+  return(true);
+}
+
+/*********************************************************************
+    @brief save the calibration (after bme680_init()) in the cache file
+
+    The record with the same interface / address is replaced, else the
+    record is added.
+**********************************************************************/
+void rasp_BME680::calibSave(void) {
+
+  struct bmeCalibRec rec;
+
+  memset(&rec, 0x0, sizeof(struct bmeCalibRec));
+  recKey(&rec.key, BME680_CALIB_MAGIC, BME680_CALIB_VERSION);
+  rec.chip_id = gas_sensor.chip_id;
+  rec.calib = gas_sensor.calib;
+
+  if (bme680_get_regs(BME680_COEFF_ADDR2, rec.check, BME680_COEFF_ADDR2_LEN, &gas_sensor) != BME680_OK)
+    return;
+
+  rec_save(_calibFile, &rec, sizeof(struct bmeCalibRec), "calibration");
 }
 
 /*********************************************************************/
 /*!
-    @brief Performs a reading and returns the barometric pressure.
-    @return Barometic pressure in Pascals
+    @brief Performs a single reading and returns all the results.
+
+    Temperature, pressure, humidity and gas are all taken from the same
+    forced-mode conversion. Altitude and dewpoint are derived from
+    these values without an additional reading.
+
+    sealevel is like 101325 NOT 1013.25 !!
+
+    @param s : store the results
+    @param seaLevel : Sea-level pressure (0 = do not calculate altitude)
+
+    @return True on success, False on failure
 */
 /*********************************************************************/
-float rasp_BME680::readPressure(void) {
-  performReading();
-  return(pressure);
+bool rasp_BME680::sample(struct bmeSample &s, float seaLevel) {
+
+    if (! performReading()) return(false);
+
+    fillSample(s, seaLevel, millis());
+
+    return(true);
 }
 
 /*********************************************************************/
 /*!
-    @brief Performs a reading and returns the relative humidity.
-    @return Relative humidity as floating point
+    @brief copy the latest measurement values and calculate the
+    derived values
+
+    @param s : store the results
+    @param seaLevel : Sea-level pressure (0 = do not calculate altitude)
+    @param time : getMillis() when the results were read
 */
 /*********************************************************************/
-float rasp_BME680::readHumidity(void) {
-  performReading();
-  return(humidity);
+void rasp_BME680::fillSample(struct bmeSample &s, float seaLevel, unsigned long time) {
+
+    s.temperature = temperature;
+    s.pressure = pressure;
+    s.humidity = humidity;
+    s.gas_resistance = (uint32_t) gas_resistance;
+    s.status = _status;
+    s.gas_index = _gas_index;
+    s.gas_age = 0;
+    s.time = time;
+    s.raw = _raw;
+    s.i2c_transactions = _sampleTrans;
+    s.i2c_bytes = _sampleBytes;
+
+    if (seaLevel > 0 && ! isnan(pressure))
+        s.altitude = calc_altitude(pressure, seaLevel);
+    else
+        s.altitude = 0;
+
+    if (! isnan(temperature) && ! isnan(humidity))
+        s.dewpoint = calc_dewpoint(temperature, humidity);
+    else
+        s.dewpoint = NAN;
+
+    /* duty cycle : the last gas reading between gas conversions */
+    if (gas_resistance > 0) {
+        _lastGas = (uint32_t) gas_resistance;
+        _lastGasIndex = _gas_index;
+        _lastGasTime = time;
+        _lastGasSet = true;
+    }
+    else if (_dutyGas > 0 && _gasEnabled && _lastGasSet && ! (_status & BME680_GASM_VALID_MSK)) {
+        s.gas_resistance = _lastGas;
+        s.gas_index = _lastGasIndex;
+        s.gas_age = time - _lastGasTime;
+    }
+
+    /* only a new gas reading (gas_resistance) updates the estimate */
+    iaqUpdate(time);
+
+    s.iaq = _iaq.state == BME680_IAQ_READY ? _iaq.iaq : NAN;
 }
 
 /*********************************************************************/
 /*!
-    @brief Calculates the altitude (in meters).
+    @brief enable or disable the air quality estimate
 
-    Reads the current atmostpheric pressure (in hPa) from the sensor
-    and calculates via the provided sea-level pressure (in hPa).
-
-    sealevel is like 101325 NOT 1013.25 !!
+    The estimate needs gas readings (setGasHeater()). Only heater stable
+    readings at the first set-point (gas index 0) are used.
 
-    @param  seaLevel      Sea-level pressure in hPa
-    @return Altitude in meters
+    @param enable : true = update the estimate with each sample
 */
 /*********************************************************************/
-float rasp_BME680::readAltitude(float seaLevel) {
-    // Equation taken from BMP180 datasheet (page 16):
-    //  http://www.adafruit.com/datasheets/BST-BMP180-DS000-09.pdf
+void rasp_BME680::setAirQuality(bool enable) {
+    _iaqEnabled = enable;
+}
 
-    // Note that using the equation from wikipedia can give bad results
-    // at high altitude. See this thread for more information:
-    //  http://forums.adafruit.com/viewtopic.php?f=22&t=58064
+/*********************************************************************/
+/*!
+    @brief state of the air quality estimate
 
-    float atmospheric = readPressure();
-    return 44330.0 * (1.0 - pow(atmospheric / seaLevel, 0.190284));
+    @param q : store the state
+*/
+/*********************************************************************/
+void rasp_BME680::getAirQuality(struct bmeIaq *q) {
+    *q = _iaq;
 }
 
-/*********************************************************************
-    @brief Set sensor parameters and begin reading.
+/*********************************************************************/
+/*!
+    @brief update the air quality estimate with the latest reading
 
-    @return expected time for reading to be complete
-**********************************************************************/
-unsigned long rasp_BME680::beginReading(void) {
+    Constant time and memory per reading. The gas resistance is first
+    compensated for humidity (ln(R) is about linear with humidity). The
+    baseline is an EWMA of that, with a time constant that depends on
+    the time between the readings (any sample rate) :
 
-  uint8_t set_required_settings = 0;
-  uint16_t meas_period;
+    burn-in : BME680_IAQ_TAU_BURNIN, no estimate during BME680_IAQ_BURNIN
+    ready   : BME680_IAQ_TAU_UP when the air is cleaner than the baseline,
+              BME680_IAQ_TAU_DOWN when worse, so the baseline stays close
+              to the clean air resistance
 
-  if (_meas_end != 0) {
-    /* A measurement is already in progress */
-    return _meas_end;
-  }
+    score = gas part up to (100 - BME680_IAQ_HUM_WEIGHT) for a resistance
+    at or above the baseline + humidity part up to BME680_IAQ_HUM_WEIGHT
+    at BME680_IAQ_HUM_REF. IAQ = (100 - score) * 5, 0 (good) - 500.
 
-  /* Select the power mode */
-  /* Must be set before writing the sensor configuration */
-  gas_sensor.power_mode = BME680_FORCED_MODE;
+    @param time : getMillis() when the results were read
+*/
+/*********************************************************************/
+void rasp_BME680::iaqUpdate(unsigned long time) {
 
-  /* Set the requested sensor settings */
-  if (_tempEnabled)
-    set_required_settings |= BME680_OST_SEL;
-  if (_humEnabled)
-    set_required_settings |= BME680_OSH_SEL;
-  if (_presEnabled)
-    set_required_settings |= BME680_OSP_SEL;
-  if (_filterEnabled)
-    set_required_settings |= BME680_FILTER_SEL;
-  if (_gasEnabled)
-    set_required_settings |= BME680_GAS_SENSOR_SEL;
-
-  if (_bme_debug) printf("Setting sensor settings\n");
-
-  if (bme680_set_sensor_settings(set_required_settings, &gas_sensor) != BME680_OK)
-  {
-    if (_bme_debug) p_printf(RED, (char *) "ERROR during setting sensor settings\n");
-    return (false);
-  }
+    float dt, tau, gas, hum;
 
-  /* Set the power mode to trigger start of measurement cycle */
-  if (_bme_debug) printf("Setting power mode\n");
+    if (! _iaqEnabled || gas_resistance <= 0 || _gas_index != 0 || isnan(humidity)) return;
 
-  if (bme680_set_sensor_mode(&gas_sensor) != BME680_OK)
-  {
-    if (_bme_debug) p_printf(RED, (char *) "ERROR during setting power mode\n");
-    return (false);
+    _iaq.gas_comp = gas_resistance * expf(BME680_IAQ_HUM_COEF * (humidity - BME680_IAQ_HUM_REF));
+
+    /* seconds since the last update (0 for the first) */
+    dt = _iaq.last == 0 ? 0 : (float) (time - _iaq.last) / 1000;
+    _iaq.last = time == 0 ? 1 : time;
+
+    if (_iaq.state != BME680_IAQ_READY) {
+
+        if (_iaq.state == BME680_IAQ_OFF || _iaq.baseline <= 0) {
+            _iaq.baseline = _iaq.gas_comp;
+            _iaq.state = BME680_IAQ_BURN;
+        }
+        else
+            _iaq.baseline += (_iaq.gas_comp - _iaq.baseline) * dt / (BME680_IAQ_TAU_BURNIN + dt);
+
+        _iaq.burnin += (uint32_t) (dt * 1000);
+
+        if (_iaq.burnin < BME680_IAQ_BURNIN * 1000UL) return;
+
+        _iaq.state = BME680_IAQ_READY;
+    }
+    else {
+        tau = _iaq.gas_comp > _iaq.baseline ? BME680_IAQ_TAU_UP : BME680_IAQ_TAU_DOWN;
+        _iaq.baseline += (_iaq.gas_comp - _iaq.baseline) * dt / (tau + dt);
+    }
+
+    /* gas part */
+    gas = _iaq.gas_comp / _iaq.baseline;
+    if (gas > 1) gas = 1;
+    gas *= 100 - BME680_IAQ_HUM_WEIGHT;
+
+    /* humidity part : distance to the reference */
+    if (humidity < BME680_IAQ_HUM_REF)
+        hum = humidity / BME680_IAQ_HUM_REF;
+    else
+        hum = (100 - humidity) / (100 - BME680_IAQ_HUM_REF);
+
+    if (hum < 0) hum = 0;
+    hum *= BME680_IAQ_HUM_WEIGHT;
+
+    _iaq.score = gas + hum;
+    _iaq.iaq = (100 - _iaq.score) * 5;
+}
+
+/*********************************************************************
+    @brief save the air quality baseline in a state file
+
+    The record with the same interface / address is replaced, else the
+    record is added. Nothing is saved before the first gas reading.
+
+    @param file : state file
+
+    @return true if OK (or nothing to save), false on error
+**********************************************************************/
+bool rasp_BME680::saveAirQuality(const char *file) {
+
+  struct bmeIaqRec rec;
+
+  if (_iaq.state == BME680_IAQ_OFF) return(true);
+
+  memset(&rec, 0x0, sizeof(struct bmeIaqRec));
+  recKey(&rec.key, BME680_IAQ_MAGIC, BME680_IAQ_VERSION);
+  rec.state = _iaq.state;
+  rec.saved = (int64_t) ::time(NULL);
+  rec.baseline = _iaq.baseline;
+  rec.burnin = _iaq.burnin;
+
+  return(rec_save(file, &rec, sizeof(struct bmeIaqRec), "air quality"));
+}
+
+/*********************************************************************
+    @brief restore the air quality baseline from a state file
+
+    A record older than BME680_IAQ_MAXAGE is not used (burn-in again).
+
+    @param file : state file
+
+    @return true if restored, false if no (recent) record for this
+    interface / address
+**********************************************************************/
+bool rasp_BME680::loadAirQuality(const char *file) {
+
+  struct bmeIaqRec rec;
+  bool found;
+
+  recKey(&rec.key, BME680_IAQ_MAGIC, BME680_IAQ_VERSION);
+  found = rec_load(file, &rec, sizeof(struct bmeIaqRec));
+
+  if (! found || rec.baseline <= 0 || rec.state == BME680_IAQ_OFF ||
+      (int64_t) ::time(NULL) - rec.saved > BME680_IAQ_MAXAGE)
+    return(false);
+
+  _iaq.state = rec.state;
+  _iaq.baseline = rec.baseline;
+  _iaq.burnin = rec.burnin;
+  _iaq.last = 0;
+
+  if (_bme_debug) printf("Air quality baseline %.0f Ohm from %s\n", rec.baseline, file);
+
+  return(true);
+}
+
+/*********************************************************************/
+/*!
+    @brief Perform a reading, results in integer units
+
+    The compensation is done with the integer kernel (no floating point),
+    independent of BME680_FLOAT_POINT_COMPENSATION.
+
+    @param s : store the results
+
+    @return True on success, False on failure
+*/
+/*********************************************************************/
+bool rasp_BME680::sampleInt(struct bmeSampleInt &s) {
+
+    if (! performReading()) return false;
+
+    /* no new data */
+    if (! (_status & BME680_NEW_DATA_MSK)) return false;
+
+    compensateInt(&_raw, s);
+
+    return true;
+}
+
+/*********************************************************************/
+/*!
+    @brief compensate ADC values in integer units
+
+    @param raw : ADC values of a reading (e.g. from bmeSample.raw)
+    @param s : store the results
+*/
+/*********************************************************************/
+void rasp_BME680::compensateInt(const struct bme680_raw_data *raw, struct bmeSampleInt &s) {
+
+    struct bmeComp<bmeIntKernel> out;
+
+    s.status = raw->status;
+    s.gas_index = raw->gas_index;
+
+    if (! (raw->status & BME680_NEW_DATA_MSK)) {
+        s.temperature = s.pressure = s.humidity = s.gas_resistance = 0;
+        return;
+    }
+
+    bme_compensate<bmeIntKernel>(raw, &gas_sensor.calib, &out);
+
+    s.temperature = _tempEnabled ? out.temperature : 0;
+    s.pressure = _presEnabled ? out.pressure : 0;
+    s.humidity = _humEnabled ? out.humidity : 0;
+
+    /* Avoid using measurements from an unstable heating setup */
+    if (_gasEnabled && (raw->status & BME680_HEAT_STAB_MSK))
+        s.gas_resistance = out.gas_resistance;
+    else
+        s.gas_resistance = 0;
+}
+
+/*********************************************************************/
+/*!
+    @brief Performs a reading and returns the gas resistance.
+    @return gas resistance in Ohm
+*/
+/*********************************************************************/
+uint32_t rasp_BME680::readGas(void) {
+  struct bmeSample s;
+
+  if (! sample(s)) return(0);
+  return(s.gas_resistance);
+}
+
+/*********************************************************************/
+/*!
+    @brief Performs a reading and returns the ambient temperature.
+    @return Temperature in degrees Celcius
+*/
+/*********************************************************************/
+float rasp_BME680::readTemperature(void) {
+  struct bmeSample s;
+
+  if (! sample(s)) return(NAN);
+  return(s.temperature);
+}
+
+/*********************************************************************/
+/*!
+    @brief Performs a reading and returns the barometric pressure.
+    @return Barometic pressure in Pascals
+*/
+/*********************************************************************/
+float rasp_BME680::readPressure(void) {
+  struct bmeSample s;
+
+  if (! sample(s)) return(NAN);
+  return(s.pressure);
+}
+
+/*********************************************************************/
+/*!
+    @brief Performs a reading and returns the relative humidity.
+    @return Relative humidity as floating point
+*/
+/*********************************************************************/
+float rasp_BME680::readHumidity(void) {
+  struct bmeSample s;
+
+  if (! sample(s)) return(NAN);
+  return(s.humidity);
+}
+
+/*********************************************************************/
+/*!
+    @brief Calculates the altitude (in meters).
+
+    Reads the current atmostpheric pressure (in hPa) from the sensor
+    and calculates via the provided sea-level pressure (in hPa).
+
+    sealevel is like 101325 NOT 1013.25 !!
+
+    @param  seaLevel      Sea-level pressure in hPa
+    @return Altitude in meters
+*/
+/*********************************************************************/
+float rasp_BME680::readAltitude(float seaLevel) {
+  struct bmeSample s;
+
+  if (! sample(s, seaLevel)) return(NAN);
+  return(s.altitude);
+}
+
+/*********************************************************************/
+/*!
+    @brief Calculates the altitude (in meters) from a pressure reading
+
+    No new reading is done (see readAltitude()). With setFastDerived()
+    a table is used instead of pow().
+
+    @param  pressure   current atmospheric pressure in Pascal
+    @param  seaLevel   Sea-level pressure in Pascal
+    @return Altitude in meters
+*/
+/*********************************************************************/
+float rasp_BME680::calc_altitude(float pressure, float seaLevel) {
+
+    if (_fastDerived) return(bme_altitude_fast(&_derive, pressure, seaLevel));
+
+    return(bme_altitude(pressure, seaLevel));
+}
+
+/*********************************************************************
+    @brief Set sensor parameters and begin reading.
+
+    @return expected time for reading to be complete
+**********************************************************************/
+unsigned long rasp_BME680::beginReading(void) {
+
+  uint16_t meas_period;
+
+  if (_meas_end != 0) {
+    /* A measurement is already in progress */
+    return _meas_end;
   }
 
+  /* I2C usage and timing of this reading starts here */
+  _startTrans = _stats.transactions;
+  _startBytes = _stats.bytes;
+  memset(&_timing, 0x0, sizeof(_timing));
+  _tBegin = micros_mono();
+
+  /* other oversampling : learned conversion time no longer valid */
+  if (_dirty & (BME680_OST_SEL | BME680_OSP_SEL | BME680_OSH_SEL)) _convN = 0;
+
+  /* Select the power mode */
+  gas_sensor.power_mode = BME680_FORCED_MODE;
+
+  if (_gasEnabled && _profile.len > 0) {
+    /* heater profile was written with setHeaterProfile(),
+     * only select the set-point */
+    if (gas_sensor.gas_sett.nb_conv != _heatrStep) _dirty |= BME680_NBCONV_SEL;
+    gas_sensor.gas_sett.nb_conv = _heatrStep;
+    gas_sensor.gas_sett.heatr_temp = _profile.heatr_temp[_heatrStep];
+    gas_sensor.gas_sett.heatr_dur = _profile.heatr_dur[_heatrStep];
+  }
+
+  /* gas on this conversion or only temperature, pressure and humidity */
+  if (_gasEnabled && _dutyGas > 0) dutyPlan();
+
+  /* write changed settings and trigger start of measurement cycle */
+  if (_bme_debug) printf("Setting sensor settings and power mode\n");
+
+  if (! writeConfig())
+  {
+    if (_bme_debug) p_printf(RED, (char *) "ERROR during setting sensor settings\n");
+    return (0);
+  }
+
+  /* conversion wait starts */
+  _tConfigEnd = micros_mono();
+
   /* Get the total measurement duration so as to sleep or wait till the
    * measurement is complete */
 
   bme680_get_profile_dur(&meas_period, &gas_sensor);
+  _convEst = meas_period;
+
+  /* learned conversion time instead of the estimate */
+  if (_adaptive) meas_period = (uint16_t) ((convWait() + 999) / 1000);
+
   _meas_end = millis() + meas_period;
 
-  return _meas_end;
-}
+  /* 0 is used to indicate error / no measurement */
+  if (_meas_end == 0) _meas_end = 1;
+
+  return _meas_end;
+}
+
+/*********************************************************************
+    @brief write the changed configuration and start forced mode
+
+    The configuration registers are kept in a shadow copy. Only the
+    settings that changed since the last reading are written, followed
+    by ctrl_meas with forced mode in the same write (changes to ctrl_hum
+    only become effective after writing ctrl_meas). In steady state
+    this is a single register write.
+
+    @return True on success, False on failure
+**********************************************************************/
+bool rasp_BME680::writeConfig(void) {
+
+  uint8_t reg_addr[BME680_REG_BUFFER_LENGTH];
+  uint8_t reg_data[BME680_REG_BUFFER_LENGTH];
+  uint8_t count = 0, data;
+  struct bme680_heatr_prof prof;
+  uint32_t t = micros_mono(), t1;
+
+  /* BME680 must be in sleep before changing the configuration.
+   * If we do not know for sure, confirm with the driver */
+  if (! _idle) {
+    gas_sensor.power_mode = BME680_SLEEP_MODE;
+
+    if (bme680_set_sensor_mode(&gas_sensor) != BME680_OK) return false;
+
+    gas_sensor.power_mode = BME680_FORCED_MODE;
+
+    /* re-read the shadow in case it was changed by the driver */
+    if (bme680_get_regs(BME680_CONF_HEAT_CTRL_ADDR, _shadow, BME680_REG_BUFFER_LENGTH, &gas_sensor) != BME680_OK)
+      return false;
+
+    _idle = true;
+  }
+
+  /* end of mode set stage */
+  t1 = micros_mono();
+  _timing.mode_us = t1 - t;
+
+  /* heater set-points (from setGasHeater() or setHeaterProfile()) */
+  if ((_dirty & BME680_GAS_MEAS_SEL) && _gasEnabled) {
+
+    if (_profile.len > 0) {
+      if (bme680_set_heatr_profile(&_profile, &gas_sensor) != BME680_OK) return false;
+    }
+    else {
+      prof.len = 1;
+      prof.heatr_temp[0] = gas_sensor.gas_sett.heatr_temp;
+      prof.heatr_dur[0] = gas_sensor.gas_sett.heatr_dur;
+      gas_sensor.gas_sett.nb_conv = 0;
+
+      if (bme680_set_heatr_profile(&prof, &gas_sensor) != BME680_OK) return false;
+    }
+  }
+
+  /* ctrl_gas_1 : run_gas and set-point */
+  if (_dirty & (BME680_RUN_GAS_SEL | BME680_NBCONV_SEL)) {
+    data = BME680_SET_BITS(_shadow[BME680_REG_RUN_GAS_INDEX], BME680_RUN_GAS, gas_sensor.gas_sett.run_gas);
+    data = BME680_SET_BITS_POS_0(data, BME680_NBCONV, gas_sensor.gas_sett.nb_conv);
+
+    if (data != _shadow[BME680_REG_RUN_GAS_INDEX]) {
+      reg_addr[count] = BME680_CONF_ODR_RUN_GAS_NBC_ADDR;
+      reg_data[count++] = data;
+    }
+  }
+
+  /* ctrl_hum : humidity oversampling */
+  if (_dirty & BME680_OSH_SEL) {
+    data = BME680_SET_BITS_POS_0(_shadow[BME680_REG_HUM_INDEX], BME680_OSH, gas_sensor.tph_sett.os_hum);
+
+    if (data != _shadow[BME680_REG_HUM_INDEX]) {
+      reg_addr[count] = BME680_CONF_OS_H_ADDR;
+      reg_data[count++] = data;
+    }
+  }
+
+  /* config : filter */
+  if (_dirty & BME680_FILTER_SEL) {
+    data = BME680_SET_BITS(_shadow[BME680_REG_FILTER_INDEX], BME680_FILTER, gas_sensor.tph_sett.filter);
+
+    if (data != _shadow[BME680_REG_FILTER_INDEX]) {
+      reg_addr[count] = BME680_CONF_ODR_FILT_ADDR;
+      reg_data[count++] = data;
+    }
+  }
+
+  /* ctrl_meas : temperature, pressure oversampling and forced mode
+   * always written as last, as this starts the measurement */
+  data = BME680_SET_BITS(_shadow[BME680_REG_TEMP_INDEX], BME680_OST, gas_sensor.tph_sett.os_temp);
+  data = BME680_SET_BITS(data, BME680_OSP, gas_sensor.tph_sett.os_pres);
+  data = (data & ~BME680_MODE_MSK) | BME680_FORCED_MODE;
+
+  reg_addr[count] = BME680_CONF_T_P_MODE_ADDR;
+  reg_data[count++] = data;
+
+  if (bme680_set_regs(reg_addr, reg_data, count, &gas_sensor) != BME680_OK) {
+    /* state of BME680 is unknown now */
+    _idle = false;
+    return false;
+  }
+
+  /* update shadow */
+  while (count-- > 0)
+    _shadow[reg_addr[count] - BME680_CONF_HEAT_CTRL_ADDR] = reg_data[count];
+
+  /* forced mode returns to sleep after the measurement */
+  _shadow[BME680_REG_TEMP_INDEX] &= ~BME680_MODE_MSK;
+
+  _dirty = 0;
+  _idle = false;
+
+  _timing.config_us = micros_mono() - t1;
+
+  return true;
+}
+
+/*********************************************************************
+    @brief expected time the current reading is ready
+
+    @return time in milli-seconds or 0 if no reading was started
+**********************************************************************/
+unsigned long rasp_BME680::getMeasEnd(void) {
+    return(_meas_end);
+}
+
+/*********************************************************************
+    @brief current time in milli-seconds since begin()
+**********************************************************************/
+unsigned long rasp_BME680::getMillis(void) {
+    return(millis());
+}
+
+/*********************************************************************
+    @brief chip id and calibration data as read during begin()
+
+    @param chip_id : store chip id
+    @param calib : store calibration data
+**********************************************************************/
+void rasp_BME680::getCalibration(uint8_t *chip_id, struct bme680_calib_data *calib) {
+    *chip_id = gas_sensor.chip_id;
+    *calib = gas_sensor.calib;
+}
+
+/*********************************************************************
+    @brief I2C usage since begin()
+
+    @param transactions : store number of I2C transactions
+    @param bytes : store number of bytes (register address and data)
+**********************************************************************/
+void rasp_BME680::getI2Ccount(uint32_t *transactions, uint32_t *bytes) {
+    *transactions = _stats.transactions;
+    *bytes = _stats.bytes;
+}
+
+/*********************************************************************
+    @brief I2C read and write retries since begin()
+**********************************************************************/
+uint32_t rasp_BME680::getI2Cretries(void) {
+    return(_stats.retries[BME680_ST_NACK] + _stats.retries[BME680_ST_CLKSTR] +
+           _stats.retries[BME680_ST_DATA] + _stats.retries[BME680_ST_OTHER]);
+}
+
+/*********************************************************************
+    @brief counters since the instance was created
+
+    @param st : store counters
+**********************************************************************/
+void rasp_BME680::getStats(struct bmeStats *st) {
+    *st = _stats;
+}
+
+/*********************************************************************
+    @brief count an I2C transfer that failed
+
+    @param result : result of the transfer
+    @param retry : the transfer will be retried
+**********************************************************************/
+void rasp_BME680::statI2Cerror(Wstatus result, bool retry) {
+
+    uint8_t code;
+
+    switch(result) {
+      case I2C_SDA_NACK:    code = BME680_ST_NACK; _stats.nacks++; break;
+      case I2C_SCL_CLKSTR:  code = BME680_ST_CLKSTR; _stats.clock_stretch++; break;
+      case I2C_SDA_DATA:    code = BME680_ST_DATA; break;
+      default:              code = BME680_ST_OTHER; break;
+    }
+
+    if (retry) _stats.retries[code]++;
+    else _stats.errors++;
+
+    /* a fast clock that is not reliable (bus capacitance, pull-ups,
+     * clock stretching) : back to standard mode */
+    if (_bus != NULL && _bus->baudrate > BME680_SPEED &&
+       (result == I2C_SDA_NACK || result == I2C_SCL_CLKSTR) &&
+       ++_bus->errors >= BME680_SPEED_FALLBACK) {
+
+        if (_bme_debug)
+            printf("I2C clock %d Khz not reliable, now %d Khz\n", _bus->baudrate, BME680_SPEED);
+
+        bus_clock(_bus, BME680_SPEED);
+        _stats.clock_fallbacks++;
+    }
+}
+
+/*********************************************************************
+    @brief effective I2C clock of the channel of this instance
+
+    @return clock in Khz, 0 = not set (soft_I2C, SPI or simulated)
+**********************************************************************/
+uint16_t rasp_BME680::getI2Cclock(void) {
+    if (_bus == NULL) return(0);
+    return(_bus->baudrate);
+}
+
+/*********************************************************************
+    @brief count a collected reading and its latency since beginReading()
+**********************************************************************/
+void rasp_BME680::statReading(void) {
+
+    uint32_t ms = (micros_mono() - _tBegin) / 1000;
+    uint8_t b = 0;
+
+    /* bucket 0 : < 1 ms, bucket i : 2^(i-1) - 2^i ms */
+    while (ms > 0 && b < BME680_LAT_BUCKETS - 1) {
+        ms >>= 1;
+        b++;
+    }
+
+    _stats.readings++;
+    _stats.latency[b]++;
+}
+
+#ifdef BME680_TRACE
+/*********************************************************************
+    @brief add an I2C transfer to the trace, the oldest is overwritten
+
+    @param reg : first register
+    @param len : data bytes
+    @param write : 1 = write, 0 = read
+    @param result : result of the transfer
+    @param retry : 0 = first attempt, 1.. = retry
+**********************************************************************/
+void rasp_BME680::trace(uint8_t reg, uint16_t len, uint8_t write, Wstatus result, uint8_t retry) {
+
+    struct bmeTrace *t = &_trace[_traceHead];
+
+    t->time_us = micros_mono();
+    t->reg = reg;
+    t->write = write;
+    t->len = len;
+    t->result = (uint8_t) result;
+    t->retry = retry;
+
+    if (++_traceHead == BME680_TRACE_SIZE) _traceHead = 0;
+    if (_traceCount < BME680_TRACE_SIZE) _traceCount++;
+}
+
+/*********************************************************************
+    @brief copy the traced I2C transfers, oldest first
+
+    @param t : array to store transfers
+    @param max : maximum number of transfers to store in t
+
+    @return number of transfers stored in t
+**********************************************************************/
+uint16_t rasp_BME680::getTrace(struct bmeTrace *t, uint16_t max) {
+
+    uint16_t i, n = _traceCount < max ? _traceCount : max;
+
+    /* the newest n transfers */
+    uint16_t tail = (_traceHead + BME680_TRACE_SIZE - n) % BME680_TRACE_SIZE;
+
+    for (i = 0; i < n; i++)
+        t[i] = _trace[(tail + i) % BME680_TRACE_SIZE];
+
+    return(n);
+}
+
+/*********************************************************************
+    @brief display the traced I2C transfers and clear the trace
+
+    @param fp : where to display
+**********************************************************************/
+void rasp_BME680::dumpTrace(FILE *fp) {
+
+    struct bmeTrace t[BME680_TRACE_SIZE];
+    uint16_t i, n = getTrace(t, BME680_TRACE_SIZE);
+
+    fprintf(fp, "I2C trace address 0x%x, %d transfers\n", _i2c.I2C_Address, n);
+
+    for (i = 0; i < n; i++)
+        fprintf(fp, "%10u us %s reg 0x%02x len %3d result %d%s\n", t[i].time_us,
+            t[i].write ? "write" : "read ", t[i].reg, t[i].len, t[i].result,
+            t[i].retry ? " (retry)" : "");
+
+    _traceHead = _traceCount = 0;
+}
+#endif
+
+/*********************************************************************
+    @brief learned conversion time for the current settings
+
+    @return micro-seconds from forced mode till new data, 0 = not learned
+**********************************************************************/
+uint32_t rasp_BME680::getConvTime(void) {
+
+    int32_t us = (int32_t) _convEst * 1000 + _convDev;
+
+    if (! _adaptive || _convN < BME680_CONV_LEARN || us < 0) return(0);
+
+    return((uint32_t) us);
+}
+
+/*********************************************************************
+    @brief conversion wait of the next reading (adaptive mode)
+
+    @return micro-seconds after forced mode to start polling the status
+**********************************************************************/
+uint32_t rasp_BME680::convWait(void) {
+
+    int32_t est = (int32_t) _convEst * 1000, w;
+
+    /* learning : poll from half the estimate */
+    _convTrack = true;
+    if (_convN < BME680_CONV_LEARN) return(est / 2);
+
+    /* regularly probe below the learned time */
+    if (++_convProbe >= BME680_CONV_PROBE) {
+        _convProbe = 0;
+        w = est + _convDev - BME680_CONV_MARGIN_US;
+    }
+    else {
+        _convTrack = false;
+        w = est + _convDev + BME680_CONV_MARGIN_US;
+    }
+
+    if (w < 0) w = 0;
+    if (w > est) w = est;
+
+    return((uint32_t) w);
+}
+
+/*********************************************************************
+    @brief new data was seen, update the learned conversion time
+
+    With an earlier status poll without new data the conversion ended
+    between that poll and this one, the middle is used. Without, only
+    readings that waited below the learned time are used (else the
+    learned time would creep up with the margin).
+
+    @param t : start of the status read that found new data
+**********************************************************************/
+void rasp_BME680::convCollected(uint32_t t) {
+
+    uint32_t us;
+    int32_t dev;
+
+    if (! _adaptive) return;
+
+    if (_timing.polls > 0)
+        us = (_tPoll - _tConfigEnd) + (t - _tPoll) / 2;
+    else if (_convTrack)
+        us = t - _tConfigEnd;
+    else
+        return;
+
+    dev = (int32_t) us - (int32_t) _convEst * 1000;
+
+    /* EWMA, alpha 1/8 */
+    if (_convN == 0) _convDev = dev;
+    else _convDev += (dev - _convDev) / 8;
+
+    if (_convN < BME680_CONV_LEARN) _convN++;
+}
+
+/*********************************************************************
+    @brief time spent in each stage of the last reading
+
+    @param t : store stage times (CLOCK_MONOTONIC, micro-seconds)
+**********************************************************************/
+void rasp_BME680::getTiming(struct bmeTiming *t) {
+    *t = _timing;
+}
+
+/*********************************************************************
+    @brief check (without waiting) the measurement has completed
+
+    Only the status register is read.
+
+    @return true if new data is available
+**********************************************************************/
+bool rasp_BME680::poll(void) {
+
+    uint8_t status;
+
+    if (bme680_get_regs(BME680_FIELD0_ADDR, &status, 1, &gas_sensor) != BME680_OK)
+        return(false);
+
+    return(status & BME680_NEW_DATA_MSK);
+}
+
+/*********************************************************************
+    @brief Collect the results of a reading started with beginReading()
+
+    Does not wait. There is no I2C access before the expected end of the
+    measurement has passed. After that only the status register is read
+    until new data is indicated.
+
+    @param s : store the results
+    @param seaLevel : Sea-level pressure (0 = do not calculate altitude)
+
+    @return BME680_OK : results in s
+            BME680_W_NO_NEW_DATA : not ready yet, try again later
+            BME680_E_NOT_TRIGGERED : no reading was started
+            other : error
+**********************************************************************/
+int8_t rasp_BME680::tryCollect(struct bmeSample &s, float seaLevel) {
+
+    struct bme680_field_data data;
+    int8_t rslt;
+
+    if (_meas_end == 0) return(BME680_E_NOT_TRIGGERED);
+
+    /* not expected to be ready yet */
+    if ((long) (millis() - _meas_end) < 0) return(BME680_W_NO_NEW_DATA);
+
+    rslt = readField(&data);
+
+    if (rslt == BME680_W_NO_NEW_DATA) return(rslt);
+
+    _meas_end = 0; /* Allow new measurement to begin */
+
+    if (rslt != BME680_OK) {
+        if (_bme_debug) p_printf(RED, (char *) "ERROR during collecting data\n");
+        return(rslt);
+    }
+
+    /* measurement done : BME680 is back in sleep */
+    _idle = true;
+
+    _sampleTrans = _stats.transactions - _startTrans;
+    _sampleBytes = _stats.bytes - _startBytes;
+
+    storeResults(&data);
+    fillSample(s, seaLevel, millis());
+
+    return(BME680_OK);
+}
+
+/*********************************************************************
+    @brief start streaming
+
+    A reading is started directly. Each time a reading is collected with
+    streamService() the next reading is started before anything else is
+    done, so the BME680 converts while the results are processed.
+
+    @param capacity : number of readings the stream buffer can hold
+
+    @return True on success, False on failure
+**********************************************************************/
+bool rasp_BME680::startStream(uint16_t capacity) {
+
+    if (capacity == 0) return(false);
+
+    stopStream();
+
+    /* allocate once, no allocation per reading */
+    _ring = (struct bmeRaw *) malloc(capacity * sizeof(struct bmeRaw));
+
+    if (_ring == NULL) {
+        p_printf(RED, (char *) "Can not allocate stream buffer\n");
+        return(false);
+    }
+
+    _ringSize = capacity;
+    _ringHead = _ringCount = 0;
+    _ringOverrun = 0;
+
+    if (beginReading() == 0) {
+        stopStream();
+        return(false);
+    }
+
+    return(true);
+}
+
+/*********************************************************************
+    @brief stop streaming and release the stream buffer
+**********************************************************************/
+void rasp_BME680::stopStream(void) {
+
+    if (_ring == NULL) return;
+
+    free(_ring);
+    _ring = NULL;
+    _ringSize = _ringHead = _ringCount = 0;
+}
+
+/*********************************************************************
+    @brief collect a completed reading and start the next
+
+    There is no I2C access before the expected end of the measurement.
+    The raw field registers are read in one burst and stored with a
+    time stamp. If the buffer is full the oldest reading is overwritten.
+
+    @return BME680_OK : reading stored in the buffer
+            BME680_W_NO_NEW_DATA : not ready yet, try again later
+            BME680_E_NOT_TRIGGERED : not streaming
+            other : error
+**********************************************************************/
+int8_t rasp_BME680::streamService(void) {
+
+    uint8_t buff[BME680_FIELD_LENGTH];
+    struct bmeRaw *r;
+    uint32_t t;
+    int8_t rslt;
+
+    if (_ring == NULL) return(BME680_E_NOT_TRIGGERED);
+
+    /* restart after an earlier error */
+    if (_meas_end == 0) {
+        if (beginReading() == 0) return(BME680_E_COM_FAIL);
+        return(BME680_W_NO_NEW_DATA);
+    }
+
+    /* not expected to be ready yet */
+    if ((long) (millis() - _meas_end) < 0) return(BME680_W_NO_NEW_DATA);
+
+    t = micros_mono();
+    rslt = bme680_get_raw_field_data(buff, &gas_sensor);
+
+    if (rslt == BME680_W_NO_NEW_DATA) {
+        _timing.polls++;
+        _stats.polls++;
+        _tPoll = t;
+        return(rslt);
+    }
+
+    _meas_end = 0; /* Allow new measurement to begin */
+
+    if (rslt != BME680_OK) {
+        if (_bme_debug) p_printf(RED, (char *) "ERROR during collecting stream data\n");
+        return(rslt);
+    }
+
+    convCollected(t);
+
+    statReading();
+
+    r = &_ring[(_ringHead + _ringCount) % _ringSize];
+    memcpy(r->field, buff, BME680_FIELD_LENGTH);
+    r->time = millis();
+
+    /* measurement done : BME680 is back in sleep */
+    _idle = true;
+
+    /* keep the sensor busy */
+    if (beginReading() == 0) rslt = BME680_E_COM_FAIL;
+
+    if (_ringCount < _ringSize) _ringCount++;
+    else {
+        /* buffer full : the oldest reading was overwritten */
+        _ringHead = (_ringHead + 1) % _ringSize;
+        _ringOverrun++;
+    }
+
+    return(rslt);
+}
+
+/*********************************************************************
+    @brief number of readings in the stream buffer
+**********************************************************************/
+uint16_t rasp_BME680::streamAvailable(void) {
+    return(_ringCount);
+}
+
+/*********************************************************************
+    @brief number of readings lost as the stream buffer was full
+**********************************************************************/
+uint32_t rasp_BME680::getStreamOverrun(void) {
+    return(_ringOverrun);
+}
+
+/*********************************************************************
+    @brief take readings from the stream buffer and compensate them
+
+    The latest result is also available with readTemperature() etc.
+
+    @param s : array to store the results
+    @param max : maximum number of results to store in s
+    @param seaLevel : Sea-level pressure (0 = do not calculate altitude)
+
+    @return number of results stored in s
+**********************************************************************/
+uint16_t rasp_BME680::streamRead(struct bmeSample *s, uint16_t max, float seaLevel) {
+
+    struct bme680_field_data data;
+    uint16_t cnt = 0;
+
+    while (cnt < max && _ringCount > 0) {
+
+        bme680_parse_raw(_ring[_ringHead].field, &_raw);
+
+        if (bme680_compensate_adc(&_raw, &data, &gas_sensor) != BME680_OK)
+            break;
+
+        storeResults(&data);
+        fillSample(s[cnt++], seaLevel, _ring[_ringHead].time);
+
+        _ringHead = (_ringHead + 1) % _ringSize;
+        _ringCount--;
+    }
+
+    return(cnt);
+}
+
+/*********************************************************************/
+/*!
+    @brief calculate dew point
+    @param temp : current temperature in celsius
+    @param hum : current humidity
+
+    using the Augst-Roche-Magnus Approximation. No new reading is done.
+    With setFastDerived() a table is used instead of log().
+
+    @return dewpoint
+ *********************************************************************/
+float rasp_BME680::calc_dewpoint(float temp, float hum) {
+
+    if (_fastDerived) return(bme_dewpoint_fast(&_derive, temp, hum));
+
+    return(bme_dewpoint(temp, hum));
+}
+
+/*********************************************************************/
+/*!
+    @brief Performs a full reading of all 4 sensors in the BME680.
+
+    Assigns the internal #temperature, #pressure, #humidity
+    and #gas_resistance member variables
+
+    @return True on success, False on failure
+*/
+/*********************************************************************/
+
+bool rasp_BME680::performReading(void) {
+
+    struct bme680_field_data data;
+    int8_t rslt;
+    uint16_t tries = 10;
+
+    /* trigger start reading */
+    unsigned long meas_end = beginReading();
+
+    if (meas_end == 0) {
+        if (_bme_debug) p_printf(RED, (char *) "ERROR during begin reading\n");
+        return(false);
+    }
+
+    unsigned long now = millis();
+
+    if ((long) (meas_end - now) > 0) {
+        unsigned long meas_period = meas_end - now;
+
+        if (_bme_debug)  printf("Waiting (ms) %ld\n",meas_period);
+
+        /* Delay till the measurement is expected to be ready */
+        gas_sensor.delay_ms(meas_period);
+    }
+
+    /* adaptive : fine polling from the learned time, up to the estimate
+     * + the same 100 ms as with normal polling */
+    if (_adaptive) tries = _convEst + 10 * BME680_POLL_PERIOD_MS;
+
+    /* poll the status till the new data is available */
+    while ((rslt = readField(&data)) == BME680_W_NO_NEW_DATA) {
+
+        if (--tries == 0) break;
+
+        gas_sensor.delay_ms(_adaptive ? BME680_CONV_POLL_MS : BME680_POLL_PERIOD_MS);
+    }
+
+    _meas_end = 0; /* Allow new measurement to begin */
 
-/*********************************************************************/
-/*!
-    @brief calculate dew point
-    @param temp : current temperature in celsius
-    @param hum : current humidity
+    /* communication error */
+    if (rslt < BME680_OK) return false;
 
-    using the Augst-Roche-Magnus Approximation.
+    /* if NO new fields */
+    if (rslt == BME680_W_NO_NEW_DATA) {
+        /* readField() did not fill data : status and gas_index 0 */
+        memset(&data, 0x0, sizeof(data));
+        _stats.no_new_data++;
+    }
 
-    @return dewpoint
- *********************************************************************/
-float rasp_BME680::calc_dewpoint(float temp, float hum) {
+    /* measurement done : BME680 is back in sleep */
+    else _idle = true;
 
-    float td, H;
+    _sampleTrans = _stats.transactions - _startTrans;
+    _sampleBytes = _stats.bytes - _startBytes;
 
-    H = log(hum/100) + ((17.625 * temp) / (243.12 + temp));
-    td = 243.04 * H / (17.625 - H);
+    storeResults(&data);
 
-    return(td);
+    return true;
 }
 
 /*********************************************************************/
 /*!
-    @brief Performs a full reading of all 4 sensors in the BME680.
+    @brief read and compensate new field data
 
-    Assigns the internal #temperature, #pressure, #humidity
-    and #gas_resistance member variables
+    Only the status register is read, the field data is read and
+    compensated when new data is indicated. The ADC values are kept.
 
-    @return True on success, False on failure
+    @param data : store the compensated results
+
+    @return BME680_OK : results in data
+            BME680_W_NO_NEW_DATA : not ready yet
+            other : error
 */
 /*********************************************************************/
+int8_t rasp_BME680::readField(struct bme680_field_data *data) {
 
-bool rasp_BME680::performReading(void) {
+    uint8_t buff[BME680_FIELD_LENGTH];
+    int8_t rslt;
+    uint32_t t = micros_mono(), t1;
 
-    struct bme680_field_data data;
+    /* only read the status register first */
+    rslt = bme680_get_regs(BME680_FIELD0_ADDR, buff, 1, &gas_sensor);
 
-    /* trigger start reading */
-    unsigned long meas_end = beginReading();
+    if (rslt != BME680_OK) return(rslt);
 
-    if (meas_end == 0) {
-        if (_bme_debug) p_printf(RED, (char *) "ERROR during begin reading\n");
-        return(false);
+    if (! (buff[0] & BME680_NEW_DATA_MSK)) {
+        _timing.polls++;
+        _stats.polls++;
+        _tPoll = t;
+        return(BME680_W_NO_NEW_DATA);
     }
 
-    unsigned long now = millis();
+    rslt = bme680_get_raw_field_data(buff, &gas_sensor);
 
-    if (meas_end > now) {
-        unsigned long meas_period = meas_end - now;
+    if (rslt != BME680_OK) return(rslt);
 
-        if (_bme_debug)  printf("Waiting (ms) %ld\n",meas_period);
+    convCollected(t);
 
-        /* Delay 2 x waiting timing till the measurement is expected to beready */
-        gas_sensor.delay_ms(meas_period * 2);
-    }
+    /* conversion wait (incl. polls) ends with the successful status read */
+    t1 = micros_mono();
+    statReading();
+    _timing.wait_us = t - _tConfigEnd;
+    _timing.read_us = t1 - t;
 
-    _meas_end = 0; /* Allow new measurement to begin */
+    bme680_parse_raw(buff, &_raw);
 
-    if(bme680_get_sensor_data(&data, &gas_sensor) != BME680_OK)
-        return false;
+    rslt = bme680_compensate_adc(&_raw, data, &gas_sensor);
+
+    _timing.comp_us = micros_mono() - t1;
+
+    return(rslt);
+}
+
+/*********************************************************************/
+/*!
+    @brief store the results of a reading
+
+    Assigns the internal #temperature, #pressure, #humidity
+    and #gas_resistance member variables
+
+    @param data : results from the Bosch driver
+*/
+/*********************************************************************/
+void rasp_BME680::storeResults(struct bme680_field_data *data) {
+
+    _status = data->status;
+    _gas_index = data->gas_index;
 
     /* if NO new fields */
-    if ( (! data.status) & (BME680_NEW_DATA_MSK))
+    if (! (data->status & BME680_NEW_DATA_MSK))
     {
         if (_bme_debug)  printf("No new fields\n");
         temperature = pressure = humidity = NAN;
         gas_resistance = 0;
-        return (true);
+        return;
     }
 
-    if (_tempEnabled)  temperature = data.temperature / 100.0;
+    if (_tempEnabled)  temperature = data->temperature / 100.0;
     else temperature = NAN;
 
-    if (_humEnabled)   humidity = data.humidity / 1000.0;
+    /* ambient temperature for the heater resistance (1 C hysteresis).
+     * The driver remakes its heater table, the set-points are written
+     * again with the next reading */
+    if (_tempEnabled && fabs(temperature - gas_sensor.amb_temp) >= 1.0) {
+        gas_sensor.amb_temp = (int8_t) lround(temperature);
+        _dirty |= BME680_GAS_MEAS_SEL;
+    }
+
+    if (_humEnabled)   humidity = data->humidity / 1000.0;
     else humidity = NAN;
 
-    if (_presEnabled)  pressure = data.pressure;
+    if (_presEnabled)  pressure = data->pressure;
     else pressure = NAN;
 
     /* Avoid using measurements from an unstable heating setup */
     if (_gasEnabled) {
 
         // if heater was stable
-        if (data.status & BME680_HEAT_STAB_MSK) {
-          gas_resistance = data.gas_resistance;
+        if (data->status & BME680_HEAT_STAB_MSK) {
+          gas_resistance = data->gas_resistance;
         } else {
             gas_resistance = 0;
-            //printf("Gas reading unstable!\n");
+
+            /* not counted : no gas conversion (setDutyCycle()) */
+            if (_dutyGas == 0 || (data->status & BME680_GASM_VALID_MSK))
+                _stats.heater_unstable++;
         }
     }
-
-    return true;
+    else gas_resistance = 0;
 }
 
 /*********************************************************************/
@@ -424,6 +2044,10 @@ bool rasp_BME680::setGasHeater(uint16_t heaterTemp, uint16_t heaterTime) {
   gas_sensor.gas_sett.heatr_temp = heaterTemp;
   gas_sensor.gas_sett.heatr_dur = heaterTime;
 
+  /* back to single set-point */
+  _profile.len = _heatrStep = 0;
+  _dirty |= BME680_GAS_SENSOR_SEL;
+
   if ( (heaterTemp == 0) || (heaterTime == 0) ) {
     // disabled!
     gas_sensor.gas_sett.run_gas = BME680_DISABLE_GAS_MEAS;
@@ -435,6 +2059,184 @@ bool rasp_BME680::setGasHeater(uint16_t heaterTemp, uint16_t heaterTime) {
   return true;
 }
 
+/*********************************************************************/
+/*!
+    @brief  Enable gas reading with a heater profile of up to 10 set-points
+
+    All set-points are written to the BME680 in one burst. Each reading
+    with sampleHeaterProfile() will then only select the next set-point.
+
+    @param  heaterTemp array with desired temperature in degrees Centigrade
+    @param  heaterTime array with time to keep heater on in milliseconds
+    @param  len number of set-points (1 - 10)
+
+    @return True on success, False on failure
+*/
+/*********************************************************************/
+bool rasp_BME680::setHeaterProfile(const uint16_t *heaterTemp, const uint16_t *heaterTime, uint8_t len) {
+
+  uint8_t i;
+
+  if (len == 0 || len > BME680_HEATR_PROF_MAX) return false;
+
+  for (i = 0; i < len; i++) {
+    if (heaterTemp[i] == 0 || heaterTemp[i] > 400) return false;
+    if (heaterTime[i] == 0 || heaterTime[i] > 4032) return false;
+
+    _profile.heatr_temp[i] = heaterTemp[i];
+    _profile.heatr_dur[i] = heaterTime[i];
+  }
+
+  _profile.len = len;
+  _heatrStep = 0;
+
+  if (bme680_set_heatr_profile(&_profile, &gas_sensor) != BME680_OK) {
+    if (_bme_debug) p_printf(RED, (char *) "ERROR during setting heater profile\n");
+    _profile.len = 0;
+    return false;
+  }
+
+  gas_sensor.gas_sett.heatr_temp = heaterTemp[0];
+  gas_sensor.gas_sett.heatr_dur = heaterTime[0];
+  gas_sensor.gas_sett.run_gas = BME680_ENABLE_GAS_MEAS;
+  _gasEnabled = true;
+
+  /* res_heat_x / gas_wait_x have been written already */
+  _dirty &= ~BME680_GAS_MEAS_SEL;
+  _dirty |= BME680_RUN_GAS_SEL | BME680_NBCONV_SEL;
+
+  return true;
+}
+
+/*********************************************************************/
+/*!
+    @brief  run the gas heater only every gasPeriod ms
+
+    Most of a conversion with gas is the heater time (default 150 ms),
+    without it a conversion takes a few ms (bme680_get_profile_dur()).
+    The first conversion after this call runs the heater, the next ones
+    follow at gasPeriod intervals from it (no drift with the sample
+    period). Other conversions return the last gas reading in bmeSample
+    with its age in gas_age, the member gas_resistance and the air
+    quality estimate only get new gas readings.
+
+    @param  gasPeriod ms between gas conversions, 0 = every conversion
+*/
+/*********************************************************************/
+void rasp_BME680::setDutyCycle(uint32_t gasPeriod) {
+
+  _dutyGas = gasPeriod;
+  _gasPlanned = false;
+
+  /* back to gas on every conversion */
+  if (gasPeriod == 0 && _gasEnabled && gas_sensor.gas_sett.run_gas != BME680_ENABLE_GAS_MEAS) {
+    gas_sensor.gas_sett.run_gas = BME680_ENABLE_GAS_MEAS;
+    _dirty |= BME680_RUN_GAS_SEL;
+  }
+}
+
+/*********************************************************************/
+/*!
+    @brief  enable or disable run_gas for the conversion that starts
+*/
+/*********************************************************************/
+void rasp_BME680::dutyPlan(void) {
+
+  unsigned long now = millis();
+  uint8_t run = BME680_DISABLE_GAS_MEAS;
+
+  if (! _gasPlanned || (long) (now - _gasDue) >= 0) {
+    run = BME680_ENABLE_GAS_MEAS;
+
+    /* keep the interval, unless more than a period was missed */
+    if (_gasPlanned && now - _gasDue < _dutyGas) _gasDue += _dutyGas;
+    else _gasDue = now + _dutyGas;
+
+    _gasPlanned = true;
+  }
+
+  if (gas_sensor.gas_sett.run_gas != run) {
+    gas_sensor.gas_sett.run_gas = run;
+    _dirty |= BME680_RUN_GAS_SEL;
+  }
+}
+
+/*********************************************************************/
+/*!
+    @brief  select the lowest oversampling that meets a noise budget
+
+    The RMS noise of a value is taken as BME680_NOISE_x at 1x and drops
+    with the square root of the oversampling (2x : / 1.41 .. 16x : / 4).
+    The IIR filter lowers it further, that is not taken into account.
+    Lower oversampling is a shorter conversion and less energy.
+
+    @param  temp : temperature budget in degrees Celsius (0 = keep)
+    @param  pres : pressure budget in Pascal (0 = keep)
+    @param  hum : humidity budget in % (0 = keep)
+
+    @return True on success, False if a budget can not be met (nothing set)
+*/
+/*********************************************************************/
+bool rasp_BME680::setNoiseBudget(float temp, float pres, float hum) {
+
+  const float budget[3] = { temp, pres, hum };
+  const float noise[3] = { BME680_NOISE_T, BME680_NOISE_P, BME680_NOISE_H };
+  uint8_t os[3];
+  int i;
+
+  for (i = 0; i < 3; i++) {
+
+    os[i] = 0;
+    if (budget[i] <= 0) continue;
+
+    /* BME680_OS_1X (1) .. BME680_OS_16X (5) : 2 ^ (os - 1) samples */
+    for (os[i] = BME680_OS_1X; os[i] <= BME680_OS_16X; os[i]++) {
+      if (noise[i] / sqrtf((float) (1 << (os[i] - 1))) <= budget[i]) break;
+    }
+
+    if (os[i] > BME680_OS_16X) return false;
+  }
+
+  if (os[0] > 0) setTemperatureOversampling(os[0]);
+  if (os[1] > 0) setPressureOversampling(os[1]);
+  if (os[2] > 0) setHumidityOversampling(os[2]);
+
+  return true;
+}
+
+/*********************************************************************/
+/*!
+    @brief  perform a reading for each set-point in the heater profile
+
+    @param s : array to store results (at least the profile length)
+    @param seaLevel : Sea-level pressure (0 = do not calculate altitude)
+
+    @return number of results stored in s
+*/
+/*********************************************************************/
+uint8_t rasp_BME680::sampleHeaterProfile(struct bmeSample *s, float seaLevel) {
+
+  uint8_t i;
+
+  if (_profile.len == 0) {
+    if (! sample(s[0], seaLevel)) return 0;
+    return 1;
+  }
+
+  for (i = 0; i < _profile.len; i++) {
+
+    _heatrStep = i;
+
+    if (! performReading()) break;
+
+    fillSample(s[i], seaLevel, millis());
+  }
+
+  _heatrStep = 0;
+
+  return i;
+}
+
 /*********************************************************************/
 /*!
     @brief  Setter for Temperature oversampling
@@ -451,6 +2253,7 @@ bool rasp_BME680::setTemperatureOversampling(uint8_t oversample) {
   if (oversample > BME680_OS_16X) return false;
 
   gas_sensor.tph_sett.os_temp = oversample;
+  _dirty |= BME680_OST_SEL;
 
   if (oversample == BME680_OS_NONE)
     _tempEnabled = false;
@@ -477,6 +2280,7 @@ bool rasp_BME680::setHumidityOversampling(uint8_t oversample) {
   if (oversample > BME680_OS_16X) return false;
 
   gas_sensor.tph_sett.os_hum = oversample;
+  _dirty |= BME680_OSH_SEL;
 
   if (oversample == BME680_OS_NONE)
     _humEnabled = false;
@@ -501,6 +2305,7 @@ bool rasp_BME680::setPressureOversampling(uint8_t oversample) {
   if (oversample > BME680_OS_16X) return false;
 
   gas_sensor.tph_sett.os_pres = oversample;
+  _dirty |= BME680_OSP_SEL;
 
   if (oversample == BME680_OS_NONE)
     _presEnabled = false;
@@ -528,6 +2333,7 @@ bool rasp_BME680::setIIRFilterSize(uint8_t filtersize) {
   if (filtersize > BME680_FILTER_SIZE_127) return false;
 
   gas_sensor.tph_sett.filter = filtersize;
+  _dirty |= BME680_FILTER_SEL;
 
   if (filtersize == BME680_FILTER_SIZE_0)
     _filterEnabled = false;
@@ -540,7 +2346,7 @@ bool rasp_BME680::setIIRFilterSize(uint8_t filtersize) {
 /*********************************************************************/
 /*!
     @brief Reads 8 bit values over I2C
-    @param  dev_id : not used, but maintained for compatibility
+    @param  dev_id : index of the instance (set in begin())
     @param reg_addr : start register to read from
     @param reg_data : store the data read
     @param len : total amount of bytes to be read.
@@ -548,71 +2354,70 @@ bool rasp_BME680::setIIRFilterSize(uint8_t filtersize) {
     @return 0 = good, 1 = error
 */
 /*********************************************************************/
-int8_t i2c_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+int8_t rasp_BME680::i2c_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
 
     Wstatus result;
-    int retry = 3, i;
+    int retry = 3;
     char addr = (char) reg_addr;
+    rasp_BME680 *bme;
 
-    if (_bme_debug) printf("Reading from register 0x%x, %d bytes\n",reg_addr, len);
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
 
     /* set slave address */
-    TWI.setSlave(I2Csettings.I2C_Address);
+    bme->_bus->TWI.setSlave(bme->_i2c.I2C_Address);
 
     while(1)
     {
-        /* first write the register we want to read */
-        if (TWI.i2c_write(&addr, 1) != I2C_OK)
+        if (bme->_bus->I2C_interface == hard_I2C)
         {
-            if (_bme_debug) p_printf(RED,(char *) "Error during reading register %d\n",addr);
-            return(1);
+            /* register write and read in one transfer (repeated start) */
+            switch (bcm2835_i2c_read_register_rs(&addr, (char *) reg_data, len)) {
+              case BCM2835_I2C_REASON_OK:         result = I2C_OK; break;
+              case BCM2835_I2C_REASON_ERROR_NACK: result = I2C_SDA_NACK; break;
+              case BCM2835_I2C_REASON_ERROR_CLKT: result = I2C_SCL_CLKSTR; break;
+              case BCM2835_I2C_REASON_ERROR_DATA: result = I2C_SDA_DATA; break;
+              default:                            result = (Wstatus) 0xff; break;   // counted as other
+            }
+
+            bme->_stats.transactions++;
         }
+        else
+        {
+            /* first write the register we want to read */
+            if ((result = bme->_bus->TWI.i2c_write(&addr, 1)) != I2C_OK)
+            {
+                bme->statI2Cerror(result, false);
+                BME680_TRACE_I2C(bme, reg_addr, 0, 1, result, 3 - retry);
+                return(1);
+            }
 
-        /* read results from I2C */
-        result = TWI.i2c_read((char *) reg_data, len);
+            /* read results from I2C */
+            result = bme->_bus->TWI.i2c_read((char *) reg_data, len);
 
-        /* if failure, then retry as long as retrycount has not been reached */
-        if (result != I2C_OK)
-        {
-            if (_bme_debug)
-                p_printf(YELLOW, (char *) " read retrying %d\n%d\n", result);
-            if (retry-- > 0) continue;
+            bme->_stats.transactions += 2;
         }
 
-        /* process result */
-        switch(result)
-        {
-            case I2C_OK:
-                if (_bme_debug) {
-                    printf("data read :");
-                    for (i=0 ;i < len ; i++) printf(" 0x%x ", reg_data[i]);
-                    printf("\n");
-                }
-                return(0);
-
-            case I2C_SDA_NACK :
-                if (_bme_debug) p_printf(RED, (char *) "Read NACK error\n");
-                return(1);
-
-            case I2C_SCL_CLKSTR :
-                if (_bme_debug) p_printf(RED, (char *) "Read Clock stretch error\n");
-                return(1);
+        bme->_stats.bytes += 1 + len;
 
-            case I2C_SDA_DATA :
-                if (_bme_debug) p_printf(RED, (char *) "not all data has been read\n");
-                return(1);
+        BME680_TRACE_I2C(bme, reg_addr, len, 0, result, 3 - retry);
 
-            default:
-                if (_bme_debug) p_printf(RED, (char *) "unkown return code\n");
-                return(1);
+        if (result == I2C_OK) {
+            bme->_bus->errors = 0;
+            return(0);
         }
+
+        /* retry as long as retrycount has not been reached */
+        bme->statI2Cerror(result, retry > 0);
+
+        if (retry-- <= 0) return(1);
     }
 }
 
 /*********************************************************************/
 /*!
     @brief Writes 8 bit values over I2C
-    @param dev_id : not used, but maintained for compatibility
+    @param dev_id : index of the instance (set in begin())
     @param reg_addr : first register to write to
     @param data : data to write. data[0] is data for reg_addr. This can
                    be followed with a sequence of the next reg_addr and data
@@ -621,29 +2426,21 @@ int8_t i2c_read(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t le
     @return 0 = good, 1 = error
 */
 /**********************************************************************/
-int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+int8_t rasp_BME680::i2c_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
 
     int retry = 3, i;
     Wstatus result;
     char tmp[BME680_TMP_BUFFER_LENGTH +1];
+    rasp_BME680 *bme;
+
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
 
     /* exceeding buffer during copy */
     if (len > BME680_TMP_BUFFER_LENGTH) return(1);
 
-    if (_bme_debug){
-
-        printf("\twriting to regaddrs 0x%x, data : 0x%x\n",reg_addr, reg_data[0]);
-
-        // the BME680 allows for multiple register write in one go
-        for (i = 1; i < len; i++)
-        {
-            printf("\twriting to regaddrs 0x%x, data :",reg_data[i++]);
-            printf(" 0x%x\n",reg_data[i]);
-        }
-    }
-
     /* set slave address */
-    TWI.setSlave(I2Csettings.I2C_Address);
+    bme->_bus->TWI.setSlave(bme->_i2c.I2C_Address);
 
     /* copy register address and data in single buffer*/
     tmp[0] = reg_addr;
@@ -652,37 +2449,182 @@ int8_t i2c_write(uint8_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t l
     while (1)
     {
         // perform a write of data
-        result = TWI.i2c_write(tmp, (uint8_t) len +1);
+        result = bme->_bus->TWI.i2c_write(tmp, (uint8_t) len +1);
 
-        // if error, perform retry (if not exceeded)
-        if (result != I2C_OK)
-        {
-            if (_bme_debug) printf(" send retrying %d\n", (int) result);
-            if (retry-- > 0) continue;
+        bme->_stats.transactions++;
+        bme->_stats.bytes += 1 + len;
+
+        BME680_TRACE_I2C(bme, reg_addr, len, 1, result, 3 - retry);
+
+        if (result == I2C_OK) {
+            bme->_bus->errors = 0;
+            return(0);
         }
 
-        switch(result)
-        {
-            case I2C_OK:
-                return(0);
+        // if error, perform retry (if not exceeded)
+        bme->statI2Cerror(result, retry > 0);
 
-            case I2C_SDA_NACK :
-                if (_bme_debug) p_printf(RED, (char *) "write NACK error\n");
-                return(1);
+        if (retry-- <= 0) return(1);
+    }
+}
 
-            case I2C_SCL_CLKSTR :
-                if (_bme_debug) p_printf(RED, (char *) "write Clock stretch error\n");
-                return(1);
+/*********************************************************************/
+/*!
+    @brief set the clock of a hard_I2C channel
+    @param bus : channel
+    @param khz : clock in Khz
+*/
+/*********************************************************************/
+static void bus_clock(struct bmeBus *bus, uint16_t khz) {
 
-            case I2C_SDA_DATA :
-                if (_bme_debug) p_printf(RED, (char *) "write not all data has been sent\n");
-                return(1);
+    bcm2835_i2c_set_baudrate((uint32_t) khz * 1000);
+    bus->baudrate = khz;
+    bus->errors = 0;
+}
 
-            default :
-                if (_bme_debug) p_printf(RED, (char *) "Unkown error during writing\n");
-                return(1);
-        }
+/*********************************************************************/
+/*!
+    @brief select chip and clock of an instance on the SPI channel
+*/
+/*********************************************************************/
+static void spi_select(uint8_t cs, uint32_t speed_hz) {
+
+    if (_spiHz != speed_hz) {
+        bcm2835_spi_set_speed_hz(speed_hz);
+        _spiHz = speed_hz;
     }
+
+    bcm2835_spi_chipSelect(cs);
+}
+
+/*********************************************************************/
+/*!
+    @brief Reads 8 bit values over SPI
+    @param  dev_id : index of the instance (set in begin())
+    @param reg_addr : start register to read from, read bit set by the
+                      Bosch driver (memory page selected)
+    @param reg_data : store the data read
+    @param len : total amount of bytes to be read.
+
+    @return 0 = good, 1 = error
+*/
+/*********************************************************************/
+int8_t rasp_BME680::spi_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+
+    char buf[BME680_SPI_BUFFER + 1];
+    rasp_BME680 *bme;
+
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
+
+    if (len > BME680_SPI_BUFFER) return(1);
+
+    /* register address, then clock out the data in the same frame */
+    buf[0] = reg_addr;
+    memset(buf + 1, 0x0, len);
+
+    spi_select(bme->_spiCs, bme->_spiSpeed);
+    bcm2835_spi_transfernb(buf, buf, len + 1);
+
+    memcpy(reg_data, buf + 1, len);
+
+    bme->_stats.transactions++;
+    bme->_stats.bytes += 1 + len;
+
+    BME680_TRACE_I2C(bme, reg_addr, len, 0, I2C_OK, 0);
+
+    return(0);
+}
+
+/*********************************************************************/
+/*!
+    @brief Writes 8 bit values over SPI
+    @param dev_id : index of the instance (set in begin())
+    @param reg_addr : first register to write to (memory page selected)
+    @param data : data to write. data[0] is data for reg_addr. This can
+                   be followed with a sequence of the next reg_addr and data
+    @param len : total amount of bytes in data.
+
+    @return 0 = good, 1 = error
+*/
+/**********************************************************************/
+int8_t rasp_BME680::spi_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+
+    char buf[BME680_TMP_BUFFER_LENGTH + 1];
+    rasp_BME680 *bme;
+
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
+
+    /* exceeding buffer during copy */
+    if (len > BME680_TMP_BUFFER_LENGTH) return(1);
+
+    /* register and data pairs in one frame */
+    buf[0] = reg_addr;
+    memcpy(buf + 1, reg_data, len);
+
+    spi_select(bme->_spiCs, bme->_spiSpeed);
+    bcm2835_spi_transfernb(buf, buf, len + 1);
+
+    bme->_stats.transactions++;
+    bme->_stats.bytes += 1 + len;
+
+    BME680_TRACE_I2C(bme, reg_addr, len, 1, I2C_OK, 0);
+
+    return(0);
+}
+
+/*********************************************************************/
+/*!
+    @brief Reads registers of a simulated BME680
+    @param dev_id : index of the instance (set in begin())
+    @param reg_addr : start register to read from
+    @param reg_data : store the data read
+    @param len : total amount of bytes to be read.
+
+    @return 0 = good, 1 = error
+*/
+/*********************************************************************/
+int8_t rasp_BME680::sim_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+
+    rasp_BME680 *bme;
+
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
+
+    bme_sim_read(bme->_sim, reg_addr, reg_data, len);
+
+    /* counted as a repeated-start read on hard I2C */
+    bme->_stats.transactions++;
+    bme->_stats.bytes += 1 + len;
+
+    return(0);
+}
+
+/*********************************************************************/
+/*!
+    @brief Writes registers of a simulated BME680
+    @param dev_id : index of the instance (set in begin())
+    @param reg_addr : first register to write to
+    @param data : data for reg_addr, optional followed by register and data pairs
+    @param len : total amount of bytes in data.
+
+    @return 0 = good, 1 = error
+*/
+/**********************************************************************/
+int8_t rasp_BME680::sim_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len) {
+
+    rasp_BME680 *bme;
+
+    if (dev_id >= BME680_MAX_DEVICES || _instances[dev_id] == NULL) return(1);
+    bme = _instances[dev_id];
+
+    bme_sim_write(bme->_sim, reg_addr, reg_data, len);
+
+    bme->_stats.transactions++;
+    bme->_stats.bytes += 1 + len;
+
+    return(0);
 }
 
 /*********************************************************************
@@ -698,6 +2640,18 @@ static unsigned long millis() {
     return(calc);
 }
 
+/*********************************************************************
+ * @brief get micro-seconds from the monotonic clock (stage timing)  *
+ * @return Micro-seconds (wraps after 71 minutes)
+ *********************************************************************/
+static uint32_t micros_mono() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return((uint32_t) ((uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000));
+}
+
 /*********************************************************************
  * @brief delay for requested milli seconds                         *
  * @param milliseconds to wait                                      *
@@ -0,0 +1,219 @@
+/***********************************************************************
+ *
+ * Shared-memory segment with the latest BME680 samples (bme680m -Y)
+ *
+ * October 2026 / paulvha
+ *
+ * bme680m publishes each sample into a POSIX shared-memory segment: the
+ * latest sample of each sensor and a ring with the last samples of all
+ * sensors. Clients map the segment read-only and copy a sample without
+ * I2C access, system call or lock.
+ *
+ * The segment is protected with a seqlock : the writer makes seq odd,
+ * updates, and makes seq even again. A reader copies the data between
+ * two reads of seq and retries if seq changed or was odd.
+ *
+ * Reader :
+ *    struct bmeShmSegment *seg = bme_shm_open("/bme680");
+ *    struct bmeShmSample s;
+ *
+ *    if (seg != NULL && bme_shm_latest(seg, 0, &s)) ... use s ...
+ *    bme_shm_close(seg);
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_SHM_H__
+#define __BME680_SHM_H__
+
+# include <stdint.h>
+# include <string.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+
+# define BME680_SHM_MAGIC      "BME680S"
+# define BME680_SHM_VERSION    1
+# define BME680_SHM_SENSORS    32      // latest sample of max sensors
+# define BME680_SHM_HISTORY    256     // samples in the ring (power of 2)
+
+/*! one sample */
+struct bmeShmSample
+{
+    int64_t     time;               // epoch (ms) of the reading
+    float       temperature;        // C
+    float       humidity;           // %
+    float       pressure;           // Pa
+    float       altitude;           // meter (0 = sea level pressure not set)
+    float       dewpoint;           // C
+    uint32_t    gas_resistance;     // Ohm (0 = heater unstable / disabled)
+    uint8_t     sensor;             // sensor index (bme680m order)
+    uint8_t     gas_index;          // heater set-point
+    uint8_t     status;             // new_data, gasm_valid & heat_stab bits
+    uint8_t     reserved;
+};
+
+/*! the segment */
+struct bmeShmSegment
+{
+    char        magic[8];           // BME680_SHM_MAGIC
+    uint16_t    version;            // BME680_SHM_VERSION
+    uint16_t    sample_size;        // sizeof(struct bmeShmSample)
+    uint16_t    history;            // BME680_SHM_HISTORY
+    uint8_t     sensors;            // sensors published
+    uint8_t     reserved;
+    int32_t     pid;                // process id of the writer
+    uint32_t    seq;                // seqlock : odd = update in progress
+    uint32_t    count;              // samples published (ring head)
+    uint32_t    sensor_count[BME680_SHM_SENSORS]; // samples per sensor (0 = none yet)
+    struct bmeShmSample latest[BME680_SHM_SENSORS];
+    struct bmeShmSample ring[BME680_SHM_HISTORY];
+};
+
+/*********************************************************************
+ * @brief : writer, start an update
+ *********************************************************************/
+static inline void bme_shm_write_begin(struct bmeShmSegment *seg)
+{
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*********************************************************************
+ * @brief : writer, end an update
+ *********************************************************************/
+static inline void bme_shm_write_end(struct bmeShmSegment *seg)
+{
+    __atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************
+ * @brief : writer, publish a sample
+ * @param seg : segment
+ * @param s : sample (s->sensor < BME680_SHM_SENSORS)
+ *********************************************************************/
+static inline void bme_shm_publish(struct bmeShmSegment *seg, const struct bmeShmSample *s)
+{
+    bme_shm_write_begin(seg);
+
+    seg->latest[s->sensor] = *s;
+    seg->sensor_count[s->sensor]++;
+    seg->ring[seg->count % BME680_SHM_HISTORY] = *s;
+    seg->count++;
+
+    bme_shm_write_end(seg);
+}
+
+/*********************************************************************
+ * @brief : open and check a segment for reading
+ * @param name : shared-memory name (e.g. "/bme680")
+ *
+ * @return : segment or NULL if error
+ *********************************************************************/
+static inline struct bmeShmSegment *bme_shm_open(const char *name)
+{
+    struct bmeShmSegment *seg;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) return(NULL);
+
+    seg = (struct bmeShmSegment *) mmap(NULL, sizeof(struct bmeShmSegment),
+        PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (seg == MAP_FAILED) return(NULL);
+
+    if (memcmp(seg->magic, BME680_SHM_MAGIC, sizeof(seg->magic)) != 0 ||
+        seg->version != BME680_SHM_VERSION ||
+        seg->sample_size != sizeof(struct bmeShmSample) ||
+        seg->history != BME680_SHM_HISTORY)
+    {
+        munmap(seg, sizeof(struct bmeShmSegment));
+        return(NULL);
+    }
+
+    return(seg);
+}
+
+/*********************************************************************
+ * @brief : release a segment from bme_shm_open()
+ *********************************************************************/
+static inline void bme_shm_close(struct bmeShmSegment *seg)
+{
+    if (seg != NULL) munmap(seg, sizeof(struct bmeShmSegment));
+}
+
+/*********************************************************************
+ * @brief : reader, copy the latest sample of a sensor
+ * @param seg : segment
+ * @param sensor : sensor index
+ * @param s : store sample
+ *
+ * @return : true if OK, false if no sample of this sensor (yet)
+ *********************************************************************/
+static inline bool bme_shm_latest(const struct bmeShmSegment *seg, uint8_t sensor,
+    struct bmeShmSample *s)
+{
+    uint32_t seq, cnt;
+
+    if (sensor >= BME680_SHM_SENSORS) return(false);
+
+    do {
+        seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+
+        cnt = seg->sensor_count[sensor];
+        *s = seg->latest[sensor];
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    } while ((seq & 1) || seq != __atomic_load_n(&seg->seq, __ATOMIC_RELAXED));
+
+    return(cnt > 0);
+}
+
+/*********************************************************************
+ * @brief : reader, copy the last samples of all sensors, oldest first
+ * @param seg : segment
+ * @param s : array to store samples
+ * @param max : maximum number of samples to store in s
+ *
+ * @return : number of samples stored in s
+ *********************************************************************/
+static inline uint16_t bme_shm_history(const struct bmeShmSegment *seg,
+    struct bmeShmSample *s, uint16_t max)
+{
+    uint32_t seq, cnt, i, n;
+
+    if (max > BME680_SHM_HISTORY) max = BME680_SHM_HISTORY;
+
+    do {
+        seq = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE);
+
+        cnt = seg->count;
+        n = cnt < max ? cnt : max;
+
+        for (i = 0; i < n; i++)
+            s[i] = seg->ring[(cnt - n + i) % BME680_SHM_HISTORY];
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    } while ((seq & 1) || seq != __atomic_load_n(&seg->seq, __ATOMIC_RELAXED));
+
+    return((uint16_t) n);
+}
+
+#endif /* __BME680_SHM_H__ */
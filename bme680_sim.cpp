@@ -0,0 +1,526 @@
+/***********************************************************************
+ *
+ * Simulated BME680 for running without hardware (bme680_sim.h)
+ *
+ * October 2026 / paulvha
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+
+#include "rasp_BME680.h"
+#include "bme680_sim.h"
+#include "bme680_comp.h"
+
+/* register map */
+# define SIM_FIELD_ADDR     BME680_FIELD0_ADDR
+# define SIM_FIELD_END      (BME680_FIELD0_ADDR + BME680_FIELD_LENGTH)
+# define SIM_RESET_FIRST    BME680_FIELD0_ADDR          // cleared by soft reset
+# define SIM_RESET_LAST     BME680_CONF_ODR_FILT_ADDR
+# define SIM_CONF_FIRST     UINT8_C(0x50)               // idac_heat_0, first writable
+
+/* ctrl_meas mode and meas_status_0 bits */
+# define SIM_MEASURING      UINT8_C(0x20)
+# define SIM_GAS_MEASURING  UINT8_C(0x40)
+
+/* capture file for BME680_BUS_REPLAY, shared by all instances */
+static struct
+{
+    char        file[256];
+    struct bmeBinHeader hdr;
+    struct bmeBinSensor *sensors;
+    struct bmeBinRecord *rec;
+    uint32_t    count;              // records
+    int         users;              // instances replaying the file
+} _replay;
+
+static uint64_t sim_micros();
+static bool replay_load(const char *file);
+static void set_field(struct bmeSim *sim);
+
+/*********************************************************************
+ * @brief create a simulated BME680
+ * @param backend : BME680_BUS_SIM or BME680_BUS_REPLAY
+ * @param id : instance number
+ * @param file : capture file (BME680_BUS_REPLAY)
+ * @param speed : replay speed (1 = as captured, 0 = as fast as possible)
+ *
+ * @return simulated BME680 or NULL if error
+ *********************************************************************/
+struct bmeSim *bme_sim_open(uint8_t backend, uint16_t id, const char *file, float speed) {
+
+    struct bme680_calib_data c;
+    struct bmeSim *sim;
+
+    if (backend == BME680_BUS_REPLAY && ! replay_load(file)) return(NULL);
+
+    sim = (struct bmeSim *) malloc(sizeof(struct bmeSim));
+
+    if (sim == NULL) {
+        p_printf(RED,(char *) "can not allocate memory for simulated BME680\n");
+        if (backend == BME680_BUS_REPLAY) _replay.users--;
+        return(NULL);
+    }
+
+    memset(sim, 0x0, sizeof(struct bmeSim));
+    sim->backend = backend;
+    sim->id = id;
+    sim->seed = 12345 + id * 7919;
+    sim->speed = speed;
+
+    if (backend == BME680_BUS_REPLAY) {
+        sim->sensor = id % _replay.hdr.sensors;
+        sim->regs[BME680_CHIP_ID_ADDR] = _replay.sensors[sim->sensor].chip_id;
+        bme_sim_set_calib(sim, &_replay.sensors[sim->sensor].calib);
+        return(sim);
+    }
+
+    /* typical calibration */
+    memset(&c, 0x0, sizeof(c));
+    c.par_t1 = 26095;  c.par_t2 = 26422;  c.par_t3 = 3;
+    c.par_p1 = 36282;  c.par_p2 = -10398; c.par_p3 = 88;
+    c.par_p4 = 7183;   c.par_p5 = -126;   c.par_p6 = 30;
+    c.par_p7 = 57;     c.par_p8 = -2827;  c.par_p9 = -1575;
+    c.par_p10 = 30;
+    c.par_h1 = 754;    c.par_h2 = 1018;   c.par_h3 = 0;
+    c.par_h4 = 45;     c.par_h5 = 20;     c.par_h6 = 120;
+    c.par_h7 = -100;
+    c.par_gh1 = -30;   c.par_gh2 = -5969; c.par_gh3 = 18;
+    c.res_heat_range = 1;
+    c.res_heat_val = 46;
+    c.range_sw_err = 0;
+
+    sim->regs[BME680_CHIP_ID_ADDR] = BME680_CHIP_ID;
+    bme_sim_set_calib(sim, &c);
+
+    return(sim);
+}
+
+/*********************************************************************
+ * @brief release a simulated BME680
+ *********************************************************************/
+void bme_sim_close(struct bmeSim *sim) {
+
+    if (sim == NULL) return;
+
+    if (sim->backend == BME680_BUS_REPLAY && --_replay.users == 0) {
+        free(_replay.sensors);
+        free(_replay.rec);
+        memset(&_replay, 0x0, sizeof(_replay));
+    }
+
+    free(sim);
+}
+
+/*********************************************************************
+ * @brief store calibration data in the registers
+ * @param sim : simulated BME680
+ * @param c : calibration
+ *
+ * The inverse of get_calib_data() in bme680.c
+ *********************************************************************/
+void bme_sim_set_calib(struct bmeSim *sim, const struct bme680_calib_data *c) {
+
+    uint8_t a[BME680_COEFF_SIZE];
+
+    memset(a, 0x0, sizeof(a));
+
+    a[BME680_T1_LSB_REG] = c->par_t1 & 0xff;    a[BME680_T1_MSB_REG] = c->par_t1 >> 8;
+    a[BME680_T2_LSB_REG] = c->par_t2 & 0xff;    a[BME680_T2_MSB_REG] = (uint16_t) c->par_t2 >> 8;
+    a[BME680_T3_REG] = (uint8_t) c->par_t3;
+
+    a[BME680_P1_LSB_REG] = c->par_p1 & 0xff;    a[BME680_P1_MSB_REG] = c->par_p1 >> 8;
+    a[BME680_P2_LSB_REG] = c->par_p2 & 0xff;    a[BME680_P2_MSB_REG] = (uint16_t) c->par_p2 >> 8;
+    a[BME680_P3_REG] = (uint8_t) c->par_p3;
+    a[BME680_P4_LSB_REG] = c->par_p4 & 0xff;    a[BME680_P4_MSB_REG] = (uint16_t) c->par_p4 >> 8;
+    a[BME680_P5_LSB_REG] = c->par_p5 & 0xff;    a[BME680_P5_MSB_REG] = (uint16_t) c->par_p5 >> 8;
+    a[BME680_P6_REG] = (uint8_t) c->par_p6;
+    a[BME680_P7_REG] = (uint8_t) c->par_p7;
+    a[BME680_P8_LSB_REG] = c->par_p8 & 0xff;    a[BME680_P8_MSB_REG] = (uint16_t) c->par_p8 >> 8;
+    a[BME680_P9_LSB_REG] = c->par_p9 & 0xff;    a[BME680_P9_MSB_REG] = (uint16_t) c->par_p9 >> 8;
+    a[BME680_P10_REG] = c->par_p10;
+
+    /* H1 and H2 share a register */
+    a[BME680_H1_MSB_REG] = c->par_h1 >> BME680_HUM_REG_SHIFT_VAL;
+    a[BME680_H2_MSB_REG] = c->par_h2 >> BME680_HUM_REG_SHIFT_VAL;
+    a[BME680_H1_LSB_REG] = (c->par_h1 & BME680_BIT_H1_DATA_MSK) |
+                           ((c->par_h2 << BME680_HUM_REG_SHIFT_VAL) & 0xf0);
+    a[BME680_H3_REG] = (uint8_t) c->par_h3;
+    a[BME680_H4_REG] = (uint8_t) c->par_h4;
+    a[BME680_H5_REG] = (uint8_t) c->par_h5;
+    a[BME680_H6_REG] = c->par_h6;
+    a[BME680_H7_REG] = (uint8_t) c->par_h7;
+
+    a[BME680_GH1_REG] = (uint8_t) c->par_gh1;
+    a[BME680_GH2_LSB_REG] = c->par_gh2 & 0xff;  a[BME680_GH2_MSB_REG] = (uint16_t) c->par_gh2 >> 8;
+    a[BME680_GH3_REG] = (uint8_t) c->par_gh3;
+
+    memcpy(&sim->regs[BME680_COEFF_ADDR1], a, BME680_COEFF_ADDR1_LEN);
+    memcpy(&sim->regs[BME680_COEFF_ADDR2], &a[BME680_COEFF_ADDR1_LEN], BME680_COEFF_ADDR2_LEN);
+
+    sim->regs[BME680_ADDR_RES_HEAT_VAL_ADDR] = (uint8_t) c->res_heat_val;
+    sim->regs[BME680_ADDR_RES_HEAT_RANGE_ADDR] = (c->res_heat_range * 16) & BME680_RHRANGE_MSK;
+    sim->regs[BME680_ADDR_RANGE_SW_ERR_ADDR] = (uint8_t) (c->range_sw_err * 16) & BME680_RSERROR_MSK;
+}
+
+/*********************************************************************
+ * @brief obtain the calibration back from the registers
+ *********************************************************************/
+static void get_calib(const struct bmeSim *sim, struct bme680_calib_data *c)
+{
+    const uint8_t *a = &sim->regs[BME680_COEFF_ADDR1];
+    const uint8_t *b = &sim->regs[BME680_COEFF_ADDR2 - BME680_COEFF_ADDR1_LEN];
+
+    memset(c, 0x0, sizeof(struct bme680_calib_data));
+
+    c->par_t1 = (uint16_t) (b[BME680_T1_MSB_REG] << 8 | b[BME680_T1_LSB_REG]);
+    c->par_t2 = (int16_t) (a[BME680_T2_MSB_REG] << 8 | a[BME680_T2_LSB_REG]);
+    c->par_t3 = (int8_t) a[BME680_T3_REG];
+    c->par_p1 = (uint16_t) (a[BME680_P1_MSB_REG] << 8 | a[BME680_P1_LSB_REG]);
+    c->par_p2 = (int16_t) (a[BME680_P2_MSB_REG] << 8 | a[BME680_P2_LSB_REG]);
+    c->par_p3 = (int8_t) a[BME680_P3_REG];
+    c->par_p4 = (int16_t) (a[BME680_P4_MSB_REG] << 8 | a[BME680_P4_LSB_REG]);
+    c->par_p5 = (int16_t) (a[BME680_P5_MSB_REG] << 8 | a[BME680_P5_LSB_REG]);
+    c->par_p6 = (int8_t) a[BME680_P6_REG];
+    c->par_p7 = (int8_t) a[BME680_P7_REG];
+    c->par_p8 = (int16_t) (a[BME680_P8_MSB_REG] << 8 | a[BME680_P8_LSB_REG]);
+    c->par_p9 = (int16_t) (a[BME680_P9_MSB_REG] << 8 | a[BME680_P9_LSB_REG]);
+    c->par_p10 = a[BME680_P10_REG];
+    c->par_h1 = (uint16_t) (b[BME680_H1_MSB_REG] << 4 | (b[BME680_H1_LSB_REG] & BME680_BIT_H1_DATA_MSK));
+    c->par_h2 = (uint16_t) (b[BME680_H2_MSB_REG] << 4 | b[BME680_H2_LSB_REG] >> 4);
+    c->par_h3 = (int8_t) b[BME680_H3_REG];
+    c->par_h4 = (int8_t) b[BME680_H4_REG];
+    c->par_h5 = (int8_t) b[BME680_H5_REG];
+    c->par_h6 = b[BME680_H6_REG];
+    c->par_h7 = (int8_t) b[BME680_H7_REG];
+}
+
+/*********************************************************************
+ * @brief ADC value that compensates to a value (binary search)
+ * @param target : wanted value (C, Pa or %)
+ * @param max : largest ADC value
+ * @param rising : true if the value rises with the ADC value
+ * @param value : calculate the value of an ADC value
+ *********************************************************************/
+static uint32_t find_adc(double target, uint32_t max, bool rising,
+    double (*value)(uint32_t adc, const struct bme680_calib_data *c, double t_fine),
+    const struct bme680_calib_data *c, double t_fine)
+{
+    uint32_t lo = 0, hi = max, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+
+        if ((value(mid, c, t_fine) < target) == rising) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return(lo);
+}
+
+static double temp_value(uint32_t adc, const struct bme680_calib_data *c, double t_fine)
+{
+    return(bmeRealKernel<double>::temperature(adc, c, &t_fine));
+}
+
+static double pres_value(uint32_t adc, const struct bme680_calib_data *c, double t_fine)
+{
+    return(bmeRealKernel<double>::pressure(adc, c, t_fine));
+}
+
+static double hum_value(uint32_t adc, const struct bme680_calib_data *c, double t_fine)
+{
+    return(bmeRealKernel<double>::humidity((uint16_t) adc, c, t_fine));
+}
+
+/*********************************************************************
+ * @brief next pseudo random value -1 .. 1
+ *********************************************************************/
+static double noise(struct bmeSim *sim)
+{
+    sim->seed = sim->seed * 1103515245 + 12345;
+
+    return((double) ((sim->seed >> 8) & 0xffff) / 32768.0 - 1.0);
+}
+
+/*********************************************************************
+ * @brief store the results of a finished conversion in the field registers
+ * @param sim : simulated BME680
+ *********************************************************************/
+static void set_field(struct bmeSim *sim)
+{
+    struct bme680_calib_data c;
+    struct bmeBinRecord rec;
+    uint8_t *f = &sim->regs[SIM_FIELD_ADDR];
+    uint8_t ctrl_gas = sim->regs[BME680_CONF_ODR_RUN_GAS_NBC_ADDR];
+    double t_fine, phase;
+    uint32_t i;
+
+    memset(&rec, 0x0, sizeof(rec));
+
+    if (sim->backend == BME680_BUS_REPLAY) {
+
+        /* next record of this sensor */
+        for (i = 0; i < _replay.count; i++, sim->pos++) {
+            if (sim->pos >= _replay.count) sim->pos = 0;
+            if (_replay.rec[sim->pos].sensor == sim->sensor) break;
+        }
+
+        if (i < _replay.count) rec = _replay.rec[sim->pos++];
+    }
+    else {
+        /* slow change with a different phase per instance, plus noise */
+        phase = sin(2 * M_PI * ((double) (sim_micros() / 1000000 % BME680_SIM_PERIOD) / BME680_SIM_PERIOD +
+            sim->id * 0.618));
+
+        get_calib(sim, &c);
+
+        rec.adc_temp = find_adc(22.0 + 2.0 * phase + 0.02 * noise(sim), 0xfffff, true, temp_value, &c, 0);
+        bmeRealKernel<double>::temperature(rec.adc_temp, &c, &t_fine);
+        rec.adc_pres = find_adc(101325.0 + 150.0 * phase + 2.0 * noise(sim), 0xfffff, false, pres_value, &c, t_fine);
+        rec.adc_hum = (uint16_t) find_adc(45.0 - 5.0 * phase + 0.1 * noise(sim), 0xffff, true, hum_value, &c, t_fine);
+        rec.adc_gas_res = (uint16_t) (512 + 100 * phase + 5 * noise(sim)) & 0x3ff;
+        rec.gas_range = 5;
+        rec.gas_index = ctrl_gas & BME680_NBCONV_MSK;
+
+        if (ctrl_gas & BME680_RUN_GAS_MSK) rec.status = BME680_GASM_VALID_MSK | BME680_HEAT_STAB_MSK;
+    }
+
+    f[0] = BME680_NEW_DATA_MSK | (rec.gas_index & BME680_GAS_INDEX_MSK);
+    f[1] = (uint8_t) sim->conversions;
+    f[2] = (uint8_t) (rec.adc_pres >> 12);
+    f[3] = (uint8_t) (rec.adc_pres >> 4);
+    f[4] = (uint8_t) (rec.adc_pres << 4);
+    f[5] = (uint8_t) (rec.adc_temp >> 12);
+    f[6] = (uint8_t) (rec.adc_temp >> 4);
+    f[7] = (uint8_t) (rec.adc_temp << 4);
+    f[8] = (uint8_t) (rec.adc_hum >> 8);
+    f[9] = (uint8_t) rec.adc_hum;
+    f[13] = (uint8_t) (rec.adc_gas_res >> 2);
+    f[14] = (uint8_t) (rec.adc_gas_res << 6) | (rec.status & (BME680_GASM_VALID_MSK | BME680_HEAT_STAB_MSK)) |
+            (rec.gas_range & BME680_GAS_RANGE_MSK);
+
+    /* forced mode ends in sleep */
+    sim->regs[BME680_CONF_T_P_MODE_ADDR] &= ~BME680_MODE_MSK;
+    sim->converting = false;
+    sim->conversions++;
+}
+
+/*********************************************************************
+ * @brief start a forced mode conversion
+ * @param sim : simulated BME680
+ *
+ * The conversion time is bme680_get_profile_dur() of the configuration
+ * in the registers. A replayed record is not ready before its capture
+ * time divided by the speed.
+ *********************************************************************/
+static void start_conversion(struct bmeSim *sim)
+{
+    struct bme680_dev dev;
+    uint8_t ctrl_gas = sim->regs[BME680_CONF_ODR_RUN_GAS_NBC_ADDR];
+    uint8_t meas = sim->regs[BME680_CONF_T_P_MODE_ADDR];
+    uint8_t wait = sim->regs[BME680_GAS_WAIT0_ADDR + (ctrl_gas & BME680_NBCONV_MSK)];
+    uint16_t dur;
+    uint64_t now = sim_micros(), t_rec;
+    uint32_t i, p;
+
+    memset(&dev, 0x0, sizeof(dev));
+    dev.tph_sett.os_temp = (meas >> BME680_OST_POS) & 0x07;
+    dev.tph_sett.os_pres = (meas >> BME680_OSP_POS) & 0x07;
+    dev.tph_sett.os_hum = sim->regs[BME680_CONF_OS_H_ADDR] & BME680_OSH_MSK;
+    dev.gas_sett.run_gas = (ctrl_gas & BME680_RUN_GAS_MSK) ? 1 : 0;
+
+    /* gas_wait : 6 bit value, 2 bit multiplier 1, 4, 16 or 64 */
+    dev.gas_sett.heatr_dur = (wait & 0x3f) << (2 * (wait >> 6));
+
+    /* os 16x and above are 16x */
+    if (dev.tph_sett.os_temp > BME680_OS_16X) dev.tph_sett.os_temp = BME680_OS_16X;
+    if (dev.tph_sett.os_pres > BME680_OS_16X) dev.tph_sett.os_pres = BME680_OS_16X;
+    if (dev.tph_sett.os_hum > BME680_OS_16X) dev.tph_sett.os_hum = BME680_OS_16X;
+
+    bme680_get_profile_dur(&dur, &dev);
+
+    sim->t_ready = now + (uint64_t) dur * 1000;
+    sim->converting = true;
+
+    sim->regs[SIM_FIELD_ADDR] = SIM_MEASURING | (dev.gas_sett.run_gas ? SIM_GAS_MEASURING : 0);
+
+    if (sim->backend != BME680_BUS_REPLAY || sim->speed <= 0) return;
+
+    /* capture time of the record set_field() will return */
+    for (i = 0, p = sim->pos; i < _replay.count; i++, p++) {
+        if (p >= _replay.count) p = 0;
+        if (_replay.rec[p].sensor == sim->sensor) break;
+    }
+
+    if (i == _replay.count) return;
+
+    t_rec = (uint64_t) (_replay.rec[p].time * 1000.0 / sim->speed);
+
+    /* first record or start of the file again : now is capture time */
+    if (sim->conversions == 0 || p < sim->pos) sim->t_start = now - t_rec;
+
+    if (sim->t_start + t_rec > sim->t_ready) sim->t_ready = sim->t_start + t_rec;
+}
+
+/*********************************************************************
+ * @brief read registers
+ * @param sim : simulated BME680
+ * @param reg : first register
+ * @param data : store the register values
+ * @param len : number of registers
+ *********************************************************************/
+void bme_sim_read(struct bmeSim *sim, uint8_t reg, uint8_t *data, uint16_t len) {
+
+    uint16_t i;
+
+    /* status or field registers : conversion done ? */
+    if (sim->converting && reg < SIM_FIELD_END && reg + len > SIM_FIELD_ADDR &&
+        sim_micros() >= sim->t_ready) set_field(sim);
+
+    for (i = 0; i < len; i++) data[i] = sim->regs[(uint8_t) (reg + i)];
+}
+
+/*********************************************************************
+ * @brief write registers
+ * @param sim : simulated BME680
+ * @param reg : first register
+ * @param data : data for reg, optional followed by register and data pairs
+ * @param len : bytes in data
+ *********************************************************************/
+void bme_sim_write(struct bmeSim *sim, uint8_t reg, const uint8_t *data, uint16_t len) {
+
+    uint16_t i = 0;
+    uint8_t val;
+
+    while (i < len) {
+
+        val = data[i++];
+
+        if (reg == BME680_SOFT_RESET_ADDR) {
+            if (val == BME680_SOFT_RESET_CMD) {
+                memset(&sim->regs[SIM_RESET_FIRST], 0x0, SIM_RESET_LAST - SIM_RESET_FIRST + 1);
+                sim->converting = false;
+            }
+        }
+        else if (reg == BME680_CONF_T_P_MODE_ADDR) {
+            sim->regs[reg] = val;
+
+            if ((val & BME680_MODE_MSK) == BME680_FORCED_MODE) start_conversion(sim);
+            else if ((val & BME680_MODE_MSK) == BME680_SLEEP_MODE) sim->converting = false;
+        }
+        /* status, field data and calibration are read-only */
+        else if (reg >= SIM_CONF_FIRST && reg <= SIM_RESET_LAST) {
+            sim->regs[reg] = val;
+        }
+
+        /* next register and value */
+        if (i >= len) break;
+        reg = data[i++];
+    }
+}
+
+/*********************************************************************
+ * @brief load a capture file for replay (once for all instances)
+ * @param file : capture file (bme680m -X)
+ *
+ * @return true if OK, false if error (reported)
+ *********************************************************************/
+static bool replay_load(const char *file) {
+
+    struct bmeBinRecord rec, *p;
+    uint32_t size = 0;
+    FILE *fp;
+    bool ok;
+
+    if (file == NULL) {
+        p_printf(RED,(char *) "no capture file to replay\n");
+        return(false);
+    }
+
+    if (_replay.users > 0) {
+        if (strcmp(_replay.file, file) != 0) {
+            p_printf(RED,(char *) "only one capture file can be replayed (%s)\n", _replay.file);
+            return(false);
+        }
+
+        _replay.users++;
+        return(true);
+    }
+
+    fp = fopen(file, "r");
+
+    if (fp == NULL) {
+        p_printf(RED,(char *) "can not open capture file %s\n", file);
+        return(false);
+    }
+
+    memset(&_replay, 0x0, sizeof(_replay));
+
+    ok = fread(&_replay.hdr, sizeof(_replay.hdr), 1, fp) == 1 &&
+        memcmp(_replay.hdr.magic, BME680_BIN_MAGIC, sizeof(_replay.hdr.magic)) == 0 &&
+        _replay.hdr.version == BME680_BIN_VERSION &&
+        _replay.hdr.calib_size == sizeof(struct bme680_calib_data) &&
+        _replay.hdr.rec_size == sizeof(struct bmeBinRecord) &&
+        _replay.hdr.sensors > 0;
+
+    if (ok) {
+        _replay.sensors = (struct bmeBinSensor *) malloc(_replay.hdr.sensors * sizeof(struct bmeBinSensor));
+        ok = _replay.sensors != NULL &&
+            fread(_replay.sensors, sizeof(struct bmeBinSensor), _replay.hdr.sensors, fp) == _replay.hdr.sensors;
+    }
+
+    while (ok && fread(&rec, sizeof(rec), 1, fp) == 1) {
+
+        if (_replay.count == size) {
+            size = size == 0 ? 1024 : size * 2;
+            p = (struct bmeBinRecord *) realloc(_replay.rec, size * sizeof(struct bmeBinRecord));
+
+            if (p == NULL) {
+                ok = false;
+                break;
+            }
+
+            _replay.rec = p;
+        }
+
+        _replay.rec[_replay.count++] = rec;
+    }
+
+    fclose(fp);
+
+    if (! ok || _replay.count == 0) {
+        p_printf(RED,(char *) "%s is not a capture file or has no readings\n", file);
+        free(_replay.sensors);
+        free(_replay.rec);
+        memset(&_replay, 0x0, sizeof(_replay));
+        return(false);
+    }
+
+    strncpy(_replay.file, file, sizeof(_replay.file) - 1);
+    _replay.users = 1;
+
+    return(true);
+}
+
+/*********************************************************************
+ * @brief monotonic time in micro seconds
+ *********************************************************************/
+static uint64_t sim_micros() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return((uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
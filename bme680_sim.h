@@ -0,0 +1,87 @@
+/***********************************************************************
+ *
+ * Simulated BME680 for running without hardware (setBackend())
+ *
+ * October 2026 / paulvha
+ *
+ * A register map that answers the reads and writes of the Bosch driver
+ * as a BME680 on I2C : chip id, calibration block, soft reset,
+ * configuration registers and forced mode. A conversion takes the time
+ * of bme680_get_profile_dur() for the configuration that was written,
+ * until then the status register shows measuring and no new data.
+ *
+ *  BME680_BUS_SIM    : synthetic ADC values, slowly changing around
+ *                      room conditions with some noise, a different
+ *                      phase per instance
+ *  BME680_BUS_REPLAY : calibration and ADC values of a binary capture
+ *                      file (bme680m -X). The records of a sensor are
+ *                      returned in order, not before their capture time
+ *                      divided by the speed (0 = as fast as possible).
+ *                      All instances share the file, instance # replays
+ *                      sensor # modulo the sensors in the file
+ *
+ * Timing is real (monotonic clock), so the scheduling, buffering and
+ * output of a program can be measured with many simulated sensors.
+ * begin() still waits the soft reset time of bme680_init() (10 ms).
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_SIM_H__
+#define __BME680_SIM_H__
+
+# include <stdint.h>
+# include "bme680_defs.h"
+# include "bme680_bin.h"
+
+/*! bus backends (setBackend()) */
+# define BME680_BUS_I2C     0       // BME680 on hard or soft I2C
+# define BME680_BUS_SIM     1       // simulated, synthetic values
+# define BME680_BUS_REPLAY  2       // simulated, values from a capture file
+# define BME680_BUS_SPI     3       // BME680 on SPI (setSPIsettings())
+
+/*! synthetic values : period of the slow change (s) */
+# define BME680_SIM_PERIOD  600
+
+struct bmeSim
+{
+    uint8_t     regs[256];          // register map (I2C addresses)
+    uint8_t     backend;            // BME680_BUS_SIM or BME680_BUS_REPLAY
+    uint16_t    id;                 // instance (phase, replayed sensor)
+    bool        converting;         // forced mode conversion in progress
+    uint64_t    t_ready;            // monotonic us the conversion is done
+    uint32_t    seed;               // noise
+    uint32_t    conversions;        // completed conversions
+
+    /* replay */
+    float       speed;              // capture time / speed (0 = no wait)
+    uint8_t     sensor;             // sensor in the capture file
+    uint32_t    pos;                // next record
+    uint64_t    t_start;            // monotonic us of capture time 0
+};
+
+/*! create a simulated BME680 (NULL = error, reported) */
+struct bmeSim *bme_sim_open(uint8_t backend, uint16_t id, const char *file, float speed);
+
+/*! release a simulated BME680 */
+void bme_sim_close(struct bmeSim *sim);
+
+/*! register read (auto-increment) and write (reg, data[, reg, data]..) */
+void bme_sim_read(struct bmeSim *sim, uint8_t reg, uint8_t *data, uint16_t len);
+void bme_sim_write(struct bmeSim *sim, uint8_t reg, const uint8_t *data, uint16_t len);
+
+/*! store calibration in the registers (as bme680_init() reads it) */
+void bme_sim_set_calib(struct bmeSim *sim, const struct bme680_calib_data *c);
+
+#endif /* __BME680_SIM_H__ */
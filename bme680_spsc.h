@@ -0,0 +1,184 @@
+/***********************************************************************
+ *
+ * Lock-free single producer / single consumer queue
+ *
+ * October 2026 / paulvha
+ *
+ * Used to hand samples from the sampling loop to an output thread
+ * (e.g. the UDP exporter), so a slow output never delays sampling.
+ * One thread may push, one other thread may pop. There are no locks or
+ * system calls : head and tail are free-running counters, read by the
+ * other side with acquire / release order. head is only written by the
+ * producer. tail is advanced with compare-and-swap : by the consumer and,
+ * with BME680_SPSC_DROP_OLDEST, by the producer when the queue is full.
+ * A consumer copy of an element that was dropped (and overwritten) at
+ * the same time fails the swap and is retried, so it is never returned.
+ *
+ * When the queue is full the push policy selects :
+ *  BME680_SPSC_DROP_NEWEST : the new element is dropped and counted
+ *  BME680_SPSC_DROP_OLDEST : the oldest element is dropped and counted
+ *  BME680_SPSC_BLOCK       : nothing is dropped, push returns false and
+ *                            the caller waits and tries again
+ *
+ * Usage :
+ *  struct bmeSpsc<struct bmeShmSample> q;
+ *  bme_spsc_init(&q, 1024);        // power of 2
+ *  bme_spsc_push(&q, &s);          // producer (drop newest)
+ *  bme_spsc_pop(&q, &s);           // consumer
+ *  bme_spsc_free(&q);
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_SPSC_H__
+#define __BME680_SPSC_H__
+
+# include <stdint.h>
+# include <stdlib.h>
+
+/*! head and tail on their own cache line */
+# define BME680_SPSC_LINE   64
+
+/*! push policy when the queue is full */
+# define BME680_SPSC_DROP_NEWEST    0
+# define BME680_SPSC_DROP_OLDEST    1
+# define BME680_SPSC_BLOCK          2
+
+template <typename T>
+struct bmeSpsc
+{
+    T           *buf;               // elements (NULL = not initialized)
+    uint32_t    mask;               // size - 1
+
+    /* producer side */
+    uint32_t    head __attribute__((aligned(BME680_SPSC_LINE))); // elements pushed
+    uint32_t    drops;              // elements dropped, queue full (newest or oldest)
+    uint32_t    max_depth;          // highest depth seen by the producer
+
+    /* consumer side */
+    uint32_t    tail __attribute__((aligned(BME680_SPSC_LINE))); // elements popped
+};
+
+/*********************************************************************
+ * @brief : allocate the queue
+ * @param q : queue
+ * @param size : number of elements, power of 2
+ *
+ * @return : true if OK, false if size is not a power of 2 or no memory
+ *********************************************************************/
+template <typename T>
+static inline bool bme_spsc_init(struct bmeSpsc<T> *q, uint32_t size)
+{
+    q->buf = NULL;
+    q->mask = 0;
+    q->head = q->tail = 0;
+    q->drops = q->max_depth = 0;
+
+    if (size < 2 || (size & (size - 1)) != 0) return(false);
+
+    q->buf = (T *) malloc(size * sizeof(T));
+
+    if (q->buf == NULL) return(false);
+
+    q->mask = size - 1;
+
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : release the queue (no other thread may use it)
+ *********************************************************************/
+template <typename T>
+static inline void bme_spsc_free(struct bmeSpsc<T> *q)
+{
+    if (q->buf != NULL) free(q->buf);
+    q->buf = NULL;
+}
+
+/*********************************************************************
+ * @brief : producer, add an element
+ * @param q : queue
+ * @param e : element to add
+ * @param policy : when full, BME680_SPSC_DROP_NEWEST, _DROP_OLDEST or _BLOCK
+ *
+ * @return : true if added, false if the queue is full (newest : dropped,
+ *           block : try again later)
+ *********************************************************************/
+template <typename T>
+static inline bool bme_spsc_push(struct bmeSpsc<T> *q, const T *e, int policy = BME680_SPSC_DROP_NEWEST)
+{
+    uint32_t head = q->head;
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    uint32_t depth = head - tail;
+
+    if (depth > q->mask) {
+
+        if (policy == BME680_SPSC_BLOCK) return(false);
+
+        if (policy == BME680_SPSC_DROP_NEWEST) {
+            __atomic_store_n(&q->drops, q->drops + 1, __ATOMIC_RELAXED);
+            return(false);
+        }
+
+        /* drop the oldest, unless the consumer took it meanwhile */
+        if (__atomic_compare_exchange_n(&q->tail, &tail, tail + 1, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            __atomic_store_n(&q->drops, q->drops + 1, __ATOMIC_RELAXED);
+
+        depth = q->mask;
+    }
+
+    q->buf[head & q->mask] = *e;
+
+    if (depth + 1 > q->max_depth) q->max_depth = depth + 1;
+
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : consumer, take the oldest element
+ * @param q : queue
+ * @param e : store the element
+ *
+ * @return : true if an element was taken, false if the queue is empty
+ *********************************************************************/
+template <typename T>
+static inline bool bme_spsc_pop(struct bmeSpsc<T> *q, T *e)
+{
+    uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    do {
+        if (tail == __atomic_load_n(&q->head, __ATOMIC_ACQUIRE)) return(false);
+
+        *e = q->buf[tail & q->mask];
+
+        /* fails (tail reloaded) if the producer dropped this element */
+    } while (! __atomic_compare_exchange_n(&q->tail, &tail, tail + 1, false,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : number of elements in the queue (either side)
+ *********************************************************************/
+template <typename T>
+static inline uint32_t bme_spsc_depth(const struct bmeSpsc<T> *q)
+{
+    return(__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE));
+}
+
+#endif /* __BME680_SPSC_H__ */
@@ -0,0 +1,54 @@
+/***********************************************************************
+ *
+ * UDP exporter datagram format for BME680 samples (bme680m -U)
+ *
+ * October 2026 / paulvha
+ *
+ * Line protocol (bme680m -E line, default) : a datagram holds one or
+ * more lines in InfluxDB line protocol, time in ns :
+ *
+ *  bme680,sensor=0 temperature=21.34,humidity=45.120,pressure=101325,
+ *  dewpoint=8.90,gas=123456i,gas_index=0i 1760000000000000000
+ *
+ * Binary (bme680m -E bin) : a bmeUdpHeader followed by count samples
+ * (struct bmeShmSample, bme680_shm.h) in the byte-order of the sender.
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+#ifndef __BME680_UDP_H__
+#define __BME680_UDP_H__
+
+# include <stdint.h>
+# include "bme680_shm.h"
+
+# define BME680_UDP_MAGIC       "BMEU"
+# define BME680_UDP_VERSION     1
+# define BME680_UDP_MAX         1400    // maximum datagram size (fits Ethernet MTU)
+
+/*! binary datagram header */
+struct bmeUdpHeader
+{
+    char        magic[4];           // BME680_UDP_MAGIC (no terminating 0)
+    uint8_t     version;            // BME680_UDP_VERSION
+    uint8_t     count;              // samples that follow
+    uint16_t    sample_size;        // sizeof(struct bmeShmSample)
+    uint32_t    seq;                // datagram sequence number (detect loss)
+    uint32_t    drops;              // samples dropped by the sender so far
+};
+
+/*! samples in a binary datagram */
+# define BME680_UDP_SAMPLES ((BME680_UDP_MAX - sizeof(struct bmeUdpHeader)) / sizeof(struct bmeShmSample))
+
+#endif /* __BME680_UDP_H__ */
@@ -0,0 +1,452 @@
+/***********************************************************************
+ *
+ * Benchmark of the BME680 compensation kernels (bme680_comp.h)
+ *
+ * October 2026 / paulvha
+ *
+ * Compensates a set of synthetic readings with the integer, float and
+ * double kernel and displays the time per reading and the largest
+ * difference compared to the double kernel. Each kernel is also timed
+ * with the batch (column) version. Run on the target CPU
+ * (e.g. Pi Zero / ARMv6) to select the kernel for large backfills.
+ *
+ * The altitude and dew point of the double results are then calculated
+ * with pow() / log() and with the tables of bme680_derive.h, one by one
+ * and in batch, with the largest difference of the tables.
+ *
+ * usage : bme680bench [readings]
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <math.h>
+# include <time.h>
+# include "bme680_comp.h"
+# include "bme680_derive.h"
+
+/* default number of readings */
+# define READINGS   100000
+
+/* number of runs, the fastest is reported */
+# define RUNS       5
+
+/* sea level pressure for the altitude (Pa) */
+# define SEALEVEL   101325.0f
+
+/* largest difference with the double kernel */
+struct bench_err
+{
+    double temperature, pressure, humidity, gas;
+};
+
+/*********************************************************************
+*  @brief get monotonic time
+*  @return time in seconds
+**********************************************************************/
+double mono_time()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return((double) ts.tv_sec + (double) ts.tv_nsec / 1e9);
+}
+
+/*********************************************************************
+ * @brief : typical calibration data
+ * @param c : store calibration
+ *********************************************************************/
+void set_calib(struct bme680_calib_data *c)
+{
+    memset(c, 0x0, sizeof(struct bme680_calib_data));
+
+    c->par_t1 = 26095;  c->par_t2 = 26422;  c->par_t3 = 3;
+    c->par_p1 = 36282;  c->par_p2 = -10398; c->par_p3 = 88;
+    c->par_p4 = 7183;   c->par_p5 = -126;   c->par_p6 = 30;
+    c->par_p7 = 57;     c->par_p8 = -2827;  c->par_p9 = -1575;
+    c->par_p10 = 30;
+    c->par_h1 = 754;    c->par_h2 = 1018;   c->par_h3 = 0;
+    c->par_h4 = 45;     c->par_h5 = 20;     c->par_h6 = 120;
+    c->par_h7 = -100;
+    c->range_sw_err = 0;
+}
+
+/*********************************************************************
+ * @brief : synthetic readings around room conditions
+ * @param raw : store readings
+ * @param cnt : number of readings
+ *********************************************************************/
+void set_readings(struct bme680_raw_data *raw, uint32_t cnt)
+{
+    uint32_t i, seed = 12345;
+
+    for (i = 0; i < cnt; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+
+        raw[i].status = BME680_NEW_DATA_MSK | BME680_GASM_VALID_MSK | BME680_HEAT_STAB_MSK;
+        raw[i].gas_index = 0;
+        raw[i].meas_index = 0;
+        raw[i].adc_temp = 480000 + (seed >> 16) % 40000;
+        raw[i].adc_pres = 360000 + (seed >> 8) % 20000;
+        raw[i].adc_hum = 18000 + (seed >> 12) % 8000;
+        raw[i].adc_gas_res = 300 + (seed >> 4) % 400;
+        raw[i].gas_range = 4 + (seed >> 20) % 6;
+    }
+}
+
+/*********************************************************************
+ * @brief : run a kernel over all readings
+ * @param raw : readings
+ * @param out : store results
+ * @param cnt : number of readings
+ * @param c : calibration
+ *
+ * @return : fastest run time per reading (ns)
+ *********************************************************************/
+template <typename K>
+double bench(const struct bme680_raw_data *raw, struct bmeComp<K> *out, uint32_t cnt,
+    const struct bme680_calib_data *c)
+{
+    double start, t, best = 0;
+    uint32_t i;
+    int r;
+
+    for (r = 0; r < RUNS; r++)
+    {
+        start = mono_time();
+
+        for (i = 0; i < cnt; i++)
+            bme_compensate<K>(&raw[i], c, &out[i]);
+
+        t = mono_time() - start;
+
+        if (r == 0 || t < best) best = t;
+    }
+
+    return(best * 1e9 / cnt);
+}
+
+/*********************************************************************
+ * @brief : run a kernel over all readings in columns
+ * @param in : ADC columns
+ * @param cnt : number of readings
+ * @param c : calibration
+ *
+ * @return : fastest run time per reading (ns)
+ *********************************************************************/
+template <typename K>
+double bench_batch(const struct bmeAdcColumns *in, uint32_t cnt, const struct bme680_calib_data *c)
+{
+    struct bmeCompColumns<K> out;
+    double start, t, best = 0;
+    int r;
+
+    out.temperature = (typename K::value_t *) malloc(cnt * sizeof(typename K::value_t));
+    out.pressure = (typename K::value_t *) malloc(cnt * sizeof(typename K::value_t));
+    out.humidity = (typename K::value_t *) malloc(cnt * sizeof(typename K::value_t));
+    out.gas_resistance = (typename K::value_t *) malloc(cnt * sizeof(typename K::value_t));
+    out.t_fine = (typename K::fine_t *) malloc(cnt * sizeof(typename K::fine_t));
+
+    if (out.temperature == NULL || out.pressure == NULL || out.humidity == NULL ||
+        out.gas_resistance == NULL || out.t_fine == NULL)
+    {
+        fprintf(stderr, "can not allocate memory for %u readings\n", cnt);
+        exit(EXIT_FAILURE);
+    }
+
+    for (r = 0; r < RUNS; r++)
+    {
+        start = mono_time();
+
+        bme_compensate_batch<K>(cnt, in, c, &out);
+
+        t = mono_time() - start;
+
+        if (r == 0 || t < best) best = t;
+    }
+
+    free(out.temperature);
+    free(out.pressure);
+    free(out.humidity);
+    free(out.gas_resistance);
+    free(out.t_fine);
+
+    return(best * 1e9 / cnt);
+}
+
+/*********************************************************************
+ * @brief : largest difference between two result sets
+ * @param out : results to check
+ * @param ref : reference (double) results
+ * @param cnt : number of readings
+ * @param scale : results of out / scale = C, Pa, %, Ohm
+ * @param err : store largest difference
+ *********************************************************************/
+template <typename K>
+void compare(const struct bmeComp<K> *out, const struct bmeComp<bmeRealKernel<double> > *ref,
+    uint32_t cnt, const double *scale, struct bench_err *err)
+{
+    uint32_t i;
+
+    memset(err, 0x0, sizeof(struct bench_err));
+
+    for (i = 0; i < cnt; i++)
+    {
+        err->temperature = fmax(err->temperature, fabs(out[i].temperature / scale[0] - ref[i].temperature));
+        err->pressure = fmax(err->pressure, fabs(out[i].pressure / scale[1] - ref[i].pressure));
+        err->humidity = fmax(err->humidity, fabs(out[i].humidity / scale[2] - ref[i].humidity));
+
+        /* relative for gas resistance */
+        err->gas = fmax(err->gas, fabs(out[i].gas_resistance / scale[3] - ref[i].gas_resistance) /
+            ref[i].gas_resistance * 100);
+    }
+}
+
+/*********************************************************************
+ * @brief : time the altitude and dew point of all readings
+ * @param pres : pressures (Pa)
+ * @param temp : temperatures (C)
+ * @param hum : humidities (%)
+ * @param alt : store altitudes
+ * @param dew : store dew points
+ * @param cnt : number of readings
+ * @param d : tables or NULL for pow() / log()
+ * @param batch : true = bme_*_batch(), false = one by one
+ *
+ * @return : fastest run time per reading (ns) for altitude + dew point
+ *********************************************************************/
+double bench_derive(const float *pres, const float *temp, const float *hum, float *alt, float *dew,
+    uint32_t cnt, const struct bmeDerive *d, bool batch)
+{
+    double start, t, best = 0;
+    uint32_t i;
+    int r;
+
+    for (r = 0; r < RUNS; r++)
+    {
+        start = mono_time();
+
+        if (batch)
+        {
+            bme_altitude_batch(cnt, pres, SEALEVEL, alt, d);
+            bme_dewpoint_batch(cnt, temp, hum, dew, d);
+        }
+        else if (d == NULL)
+        {
+            for (i = 0; i < cnt; i++)
+            {
+                alt[i] = bme_altitude(pres[i], SEALEVEL);
+                dew[i] = bme_dewpoint(temp[i], hum[i]);
+            }
+        }
+        else
+        {
+            for (i = 0; i < cnt; i++)
+            {
+                alt[i] = bme_altitude_fast(d, pres[i], SEALEVEL);
+                dew[i] = bme_dewpoint_fast(d, temp[i], hum[i]);
+            }
+        }
+
+        t = mono_time() - start;
+
+        if (r == 0 || t < best) best = t;
+    }
+
+    return(best * 1e9 / cnt);
+}
+
+/*********************************************************************
+ * @brief : compare altitude and dew point with the tables to pow() / log()
+ * @param cnt : number of readings
+ * @param o : double kernel results
+ *********************************************************************/
+void derive(uint32_t cnt, const struct bmeComp<bmeRealKernel<double> > *o)
+{
+    struct bmeDerive d;
+    float *pres, *temp, *hum, *alt, *dew, *alt_f, *dew_f;
+    double ns, ns_batch, ns_f, ns_f_batch, e_alt = 0, e_dew = 0;
+    uint32_t i;
+
+    pres = (float *) malloc(cnt * sizeof(float));
+    temp = (float *) malloc(cnt * sizeof(float));
+    hum = (float *) malloc(cnt * sizeof(float));
+    alt = (float *) malloc(cnt * sizeof(float));
+    dew = (float *) malloc(cnt * sizeof(float));
+    alt_f = (float *) malloc(cnt * sizeof(float));
+    dew_f = (float *) malloc(cnt * sizeof(float));
+
+    if (pres == NULL || temp == NULL || hum == NULL || alt == NULL || dew == NULL ||
+        alt_f == NULL || dew_f == NULL)
+    {
+        fprintf(stderr, "can not allocate memory for %u readings\n", cnt);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < cnt; i++)
+    {
+        pres[i] = (float) o[i].pressure;
+        temp[i] = (float) o[i].temperature;
+        hum[i] = (float) o[i].humidity;
+    }
+
+    bme_derive_init(&d);
+
+    ns = bench_derive(pres, temp, hum, alt, dew, cnt, NULL, false);
+    ns_batch = bench_derive(pres, temp, hum, alt, dew, cnt, NULL, true);
+    ns_f = bench_derive(pres, temp, hum, alt_f, dew_f, cnt, &d, false);
+    ns_f_batch = bench_derive(pres, temp, hum, alt_f, dew_f, cnt, &d, true);
+
+    for (i = 0; i < cnt; i++)
+    {
+        e_alt = fmax(e_alt, fabs(alt_f[i] - alt[i]));
+        e_dew = fmax(e_dew, fabs(dew_f[i] - dew[i]));
+    }
+
+    printf("\naltitude + dew point of %u readings (fastest of %d runs)\n\n", cnt, RUNS);
+    printf("pow/log  %8.1f ns/reading, batch %6.1f ns/reading\n", ns, ns_batch);
+    printf("table    %8.1f ns/reading, batch %6.1f ns/reading   "
+        "max diff: %.3f m, %.5f C (bound %.2f m, %.4f C)\n", ns_f, ns_f_batch, e_alt, e_dew,
+        BME680_ALT_ERROR, BME680_DEW_ERROR);
+
+    free(pres);
+    free(temp);
+    free(hum);
+    free(alt);
+    free(dew);
+    free(alt_f);
+    free(dew_f);
+}
+
+/*********************************************************************
+ * @brief : display the results of a kernel
+ *********************************************************************/
+void display(const char *name, double ns, double ns_batch, struct bench_err *err)
+{
+    printf("%-8s %8.1f ns/reading, batch %6.1f ns/reading (%5.1f M/s)   "
+        "max diff: %.3f C, %.2f Pa, %.3f %%, gas %.3f %%\n",
+        name, ns, ns_batch, 1e3 / ns_batch, err->temperature, err->pressure, err->humidity, err->gas);
+}
+
+/*********************************************************************
+ * @brief program starts here
+ * @param argc : count of command line options provided
+ * @param argv : command line options provided
+ *********************************************************************/
+int main(int argc, char *argv[])
+{
+    static const double int_scale[4] = { 100.0, 1.0, 1000.0, 1.0 };
+    static const double real_scale[4] = { 1.0, 1.0, 1.0, 1.0 };
+    struct bme680_calib_data calib;
+    struct bme680_raw_data *raw;
+    struct bmeComp<bmeIntKernel> *o_int;
+    struct bmeComp<bmeRealKernel<float> > *o_float;
+    struct bmeComp<bmeRealKernel<double> > *o_double;
+    struct bench_err err;
+    struct bmeAdcColumns in;
+    uint32_t *adc_temp, *adc_pres;
+    uint16_t *adc_hum, *adc_gas_res;
+    uint8_t *gas_range;
+    uint32_t i, cnt = READINGS;
+    double ns_int, ns_float, ns_double;
+    double nb_int, nb_float, nb_double;
+
+    if (argc > 1) cnt = (uint32_t) strtod(argv[1], NULL);
+
+    if (cnt == 0)
+    {
+        fprintf(stderr, "usage: %s [readings]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    raw = (struct bme680_raw_data *) malloc(cnt * sizeof(struct bme680_raw_data));
+    o_int = (struct bmeComp<bmeIntKernel> *) malloc(cnt * sizeof(*o_int));
+    o_float = (struct bmeComp<bmeRealKernel<float> > *) malloc(cnt * sizeof(*o_float));
+    o_double = (struct bmeComp<bmeRealKernel<double> > *) malloc(cnt * sizeof(*o_double));
+
+    if (raw == NULL || o_int == NULL || o_float == NULL || o_double == NULL)
+    {
+        fprintf(stderr, "can not allocate memory for %u readings\n", cnt);
+        exit(EXIT_FAILURE);
+    }
+
+    set_calib(&calib);
+    set_readings(raw, cnt);
+
+    /* same readings in columns */
+    adc_temp = (uint32_t *) malloc(cnt * sizeof(uint32_t));
+    adc_pres = (uint32_t *) malloc(cnt * sizeof(uint32_t));
+    adc_hum = (uint16_t *) malloc(cnt * sizeof(uint16_t));
+    adc_gas_res = (uint16_t *) malloc(cnt * sizeof(uint16_t));
+    gas_range = (uint8_t *) malloc(cnt * sizeof(uint8_t));
+
+    if (adc_temp == NULL || adc_pres == NULL || adc_hum == NULL || adc_gas_res == NULL || gas_range == NULL)
+    {
+        fprintf(stderr, "can not allocate memory for %u readings\n", cnt);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < cnt; i++)
+    {
+        adc_temp[i] = raw[i].adc_temp;
+        adc_pres[i] = raw[i].adc_pres;
+        adc_hum[i] = raw[i].adc_hum;
+        adc_gas_res[i] = raw[i].adc_gas_res;
+        gas_range[i] = raw[i].gas_range;
+    }
+
+    in.adc_temp = adc_temp;
+    in.adc_pres = adc_pres;
+    in.adc_hum = adc_hum;
+    in.adc_gas_res = adc_gas_res;
+    in.gas_range = gas_range;
+
+    printf("compensation of %u readings (fastest of %d runs)\n\n", cnt, RUNS);
+
+    ns_double = bench<bmeRealKernel<double> >(raw, o_double, cnt, &calib);
+    ns_float = bench<bmeRealKernel<float> >(raw, o_float, cnt, &calib);
+    ns_int = bench<bmeIntKernel>(raw, o_int, cnt, &calib);
+
+    nb_double = bench_batch<bmeRealKernel<double> >(&in, cnt, &calib);
+    nb_float = bench_batch<bmeRealKernel<float> >(&in, cnt, &calib);
+    nb_int = bench_batch<bmeIntKernel>(&in, cnt, &calib);
+
+    compare<bmeIntKernel>(o_int, o_double, cnt, int_scale, &err);
+    display("int", ns_int, nb_int, &err);
+
+    compare<bmeRealKernel<float> >(o_float, o_double, cnt, real_scale, &err);
+    display("float", ns_float, nb_float, &err);
+
+    compare<bmeRealKernel<double> >(o_double, o_double, cnt, real_scale, &err);
+    display("double", ns_double, nb_double, &err);
+
+    derive(cnt, o_double);
+
+    free(raw);
+    free(o_int);
+    free(o_float);
+    free(o_double);
+    free(adc_temp);
+    free(adc_pres);
+    free(adc_hum);
+    free(adc_gas_res);
+    free(gas_range);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,270 @@
+/***********************************************************************
+ *
+ * Decode a binary BME680 capture file (bme680m -X) to text
+ *
+ * October 2026 / paulvha
+ *
+ * The raw ADC values are compensated with the calibration data from
+ * the file header, using the Bosch driver code or a kernel from
+ * bme680_comp.h (-k int, -k float or -k double).
+ *
+ * Output is a line per record, separated by commas:
+ * time (epoch seconds), sensor, temperature (C), humidity (%),
+ * pressure (Pa), gas resistance (Ohm), gas index, status
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "bme680.h"
+# include "bme680_bin.h"
+# include "bme680_comp.h"
+
+/* maximum sensors in a file */
+# define MAXSENSORS 255
+
+/* records decoded in one batch */
+# define CHUNK      4096
+
+/*********************************************************************
+ * @brief : read and check the headers
+ * @param fp : capture file
+ * @param hdr : store file header
+ * @param dev : store calibration data for each sensor
+ *
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool read_headers(FILE *fp, struct bmeBinHeader *hdr, struct bme680_dev *dev)
+{
+    struct bmeBinSensor sens;
+    int i;
+
+    if (fread(hdr, sizeof(struct bmeBinHeader), 1, fp) != 1 ||
+        memcmp(hdr->magic, BME680_BIN_MAGIC, sizeof(hdr->magic)) != 0)
+    {
+        fprintf(stderr, "not a BME680 capture file\n");
+        return(false);
+    }
+
+    if (hdr->version != BME680_BIN_VERSION ||
+        hdr->calib_size != sizeof(struct bme680_calib_data) ||
+        hdr->rec_size != sizeof(struct bmeBinRecord))
+    {
+        fprintf(stderr, "unsupported capture file version %d\n", hdr->version);
+        return(false);
+    }
+
+    for (i = 0; i < hdr->sensors; i++)
+    {
+        if (fread(&sens, sizeof(struct bmeBinSensor), 1, fp) != 1)
+        {
+            fprintf(stderr, "can not read sensor %d header\n", i);
+            return(false);
+        }
+
+        memset(&dev[i], 0x0, sizeof(struct bme680_dev));
+        dev[i].chip_id = sens.chip_id;
+        dev[i].calib = sens.calib;
+    }
+
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : output the start of a line for a record
+ * @param hdr : file header
+ * @param rec : record
+ *********************************************************************/
+void output_start(const struct bmeBinHeader *hdr, const struct bmeBinRecord *rec)
+{
+    int64_t t = hdr->start + rec->time;
+
+    printf("%lld.%03d,%d,", (long long) (t / 1000), (int) (t % 1000), rec->sensor);
+}
+
+/*********************************************************************
+ * @brief : output the end of a line for a record
+ * @param rec : record
+ * @param gas : gas resistance (Ohm)
+ *********************************************************************/
+void output_end(const struct bmeBinRecord *rec, uint32_t gas)
+{
+    /* gas resistance only valid with stable heater */
+    if (! (rec->status & BME680_HEAT_STAB_MSK)) gas = 0;
+
+    printf("%u,%d,0x%02x\n", gas, rec->gas_index, rec->status);
+}
+
+/*********************************************************************
+ * @brief : decode records with the Bosch driver compensation
+ * @param hdr : file header
+ * @param dev : calibration data for each sensor
+ * @param rec : records
+ * @param n : number of records
+ *********************************************************************/
+void decode_driver(const struct bmeBinHeader *hdr, struct bme680_dev *dev,
+    const struct bmeBinRecord *rec, uint32_t n)
+{
+    struct bme680_raw_data raw;
+    struct bme680_field_data data;
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (rec[i].sensor >= hdr->sensors) continue;
+
+        raw.status = rec[i].status;
+        raw.gas_index = rec[i].gas_index;
+        raw.meas_index = 0;
+        raw.gas_range = rec[i].gas_range;
+        raw.adc_temp = rec[i].adc_temp;
+        raw.adc_pres = rec[i].adc_pres;
+        raw.adc_hum = rec[i].adc_hum;
+        raw.adc_gas_res = rec[i].adc_gas_res;
+
+        memset(&data, 0x0, sizeof(data));
+        bme680_compensate_adc(&raw, &data, &dev[rec[i].sensor]);
+
+        output_start(hdr, &rec[i]);
+#ifndef BME680_FLOAT_POINT_COMPENSATION
+        printf("%.2f,%.3f,%u,", data.temperature / 100.0, data.humidity / 1000.0, data.pressure);
+#else
+        printf("%.2f,%.3f,%.0f,", data.temperature, data.humidity, data.pressure);
+#endif
+        output_end(&rec[i], (uint32_t) data.gas_resistance);
+    }
+}
+
+/*********************************************************************
+ * @brief : decode records with kernel K, in columns per sensor
+ * @param hdr : file header
+ * @param dev : calibration data for each sensor
+ * @param rec : records
+ * @param n : number of records (max CHUNK)
+ * @param scale : results / scale = C, %, Pa
+ *********************************************************************/
+template <typename K>
+void decode_kernel(const struct bmeBinHeader *hdr, const struct bme680_dev *dev,
+    const struct bmeBinRecord *rec, uint32_t n, const double *scale)
+{
+    typedef typename K::value_t value_t;
+
+    static uint32_t adc_temp[CHUNK], adc_pres[CHUNK], idx[CHUNK];
+    static uint16_t adc_hum[CHUNK], adc_gas_res[CHUNK];
+    static uint8_t gas_range[CHUNK];
+    static value_t temp[CHUNK], pres[CHUNK], hum[CHUNK], gas[CHUNK];
+    static value_t t_temp[CHUNK], t_pres[CHUNK], t_hum[CHUNK], t_gas[CHUNK];
+    static typename K::fine_t t_fine[CHUNK];
+
+    struct bmeAdcColumns in = { adc_temp, adc_pres, adc_hum, adc_gas_res, gas_range };
+    struct bmeCompColumns<K> out = { t_temp, t_pres, t_hum, t_gas, t_fine };
+    uint32_t i, m;
+    int sensor;
+
+    for (sensor = 0; sensor < hdr->sensors; sensor++)
+    {
+        /* columns with the ADC values of this sensor */
+        for (i = 0, m = 0; i < n; i++)
+        {
+            if (rec[i].sensor != sensor) continue;
+
+            idx[m] = i;
+            adc_temp[m] = rec[i].adc_temp;
+            adc_pres[m] = rec[i].adc_pres;
+            adc_hum[m] = rec[i].adc_hum;
+            adc_gas_res[m] = rec[i].adc_gas_res;
+            gas_range[m++] = rec[i].gas_range;
+        }
+
+        if (m == 0) continue;
+
+        bme_compensate_batch<K>(m, &in, &dev[sensor].calib, &out);
+
+        /* back in record order */
+        for (i = 0; i < m; i++)
+        {
+            temp[idx[i]] = t_temp[i];
+            pres[idx[i]] = t_pres[i];
+            hum[idx[i]] = t_hum[i];
+            gas[idx[i]] = t_gas[i];
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (rec[i].sensor >= hdr->sensors) continue;
+
+        output_start(hdr, &rec[i]);
+        printf("%.2f,%.3f,%.0f,", temp[i] / scale[0], hum[i] / scale[1], (double) pres[i] / scale[2]);
+        output_end(&rec[i], (uint32_t) gas[i]);
+    }
+}
+
+/*********************************************************************
+ * @brief program starts here
+ * @param argc : count of command line options provided
+ * @param argv : command line options provided
+ *********************************************************************/
+int main(int argc, char *argv[])
+{
+    static struct bme680_dev dev[MAXSENSORS];
+    static struct bmeBinRecord rec[CHUNK];
+    static const double int_scale[3] = { 100.0, 1000.0, 1.0 };
+    static const double real_scale[3] = { 1.0, 1.0, 1.0 };
+    struct bmeBinHeader hdr;
+    const char *kernel = "";
+    FILE *fp;
+    size_t n;
+
+    if (argc == 4 && strcmp(argv[1], "-k") == 0) kernel = argv[2];
+
+    if ((argc != 2 && argc != 4) || (argc == 4 && strcmp(kernel, "int") != 0 &&
+        strcmp(kernel, "float") != 0 && strcmp(kernel, "double") != 0))
+    {
+        fprintf(stderr, "usage: %s [-k int | float | double] capture_file\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    fp = fopen(argv[argc - 1], "rb");
+
+    if (fp == NULL)
+    {
+        fprintf(stderr, "can not open %s\n", argv[argc - 1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (read_headers(fp, &hdr, dev) == false)
+    {
+        fclose(fp);
+        exit(EXIT_FAILURE);
+    }
+
+    while ((n = fread(rec, sizeof(struct bmeBinRecord), CHUNK, fp)) > 0)
+    {
+        if (strcmp(kernel, "int") == 0)
+            decode_kernel<bmeIntKernel>(&hdr, dev, rec, n, int_scale);
+        else if (strcmp(kernel, "float") == 0)
+            decode_kernel<bmeRealKernel<float> >(&hdr, dev, rec, n, real_scale);
+        else if (strcmp(kernel, "double") == 0)
+            decode_kernel<bmeRealKernel<double> >(&hdr, dev, rec, n, real_scale);
+        else
+            decode_driver(&hdr, dev, rec, n);
+    }
+
+    fclose(fp);
+    exit(EXIT_SUCCESS);
+}
@@ -4,6 +4,9 @@
  * 
  * version 2.0 September 2020 / paulvha
  * - fix compile issues on Pi-os (Buster)
+ *
+ * version 2.1 October 2026
+ * - single conversion per loop for all values
  * 
  * 
  * Hardware connections: (raspberry B/B+/3/4)
@@ -59,10 +62,37 @@
  **********************************************************************/ 
 
 #include "rasp_BME680.h"
-#define  VERSION "2.0 september 2020"
+#include "bme680_bin.h"
+#include "bme680_shm.h"
+#include "bme680_udp.h"
+#include "bme680_spsc.h"
+#include "bme680_derive.h"
+#include <errno.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#define  VERSION "2.1 October 2026"
 
 #define  MAXBUF     200
 #define  LOOPDELAY  5       // 5 seconds delay default
+#define  STREAMBATCH 32     // readings to format per batch in stream mode
+#define  LOGBUFSIZE 16      // save file buffer (kB) default
+#define  LOGROWS    100     // flush save file after rows default
+#define  LOGSECS    10      // flush save file after seconds default
+#define  BINBUFSIZE 64      // binary capture file buffer (kB)
+#define  OUTBUF     1024    // output line buffer
+#define  FMTOPS     64      // maximum fields and texts in the output format
+#define  FMTVALMAX  40      // maximum length of a formatted value
+#define  BENCHMAX   1000000 // maximum samples in benchmark mode
+#define  UDPQUEUE   1024    // samples in the UDP exporter queue (power of 2)
+#define  UDPBATCH   20      // samples per datagram default
+#define  UDPMS      1000    // maximum wait (ms) before a datagram is sent default
+#define  UDPIDLE    5       // exporter thread sleep (ms) when the queue is empty
+#define  WRITERQUEUE 256    // samples between sampler and writer thread (power of 2)
+#define  WRITERIDLE 1       // writer thread sleep (ms) when the queue is empty
+#define  IAQSAVE    600     // save the air quality baseline every # seconds
+#define  AGGWIN     4       // maximum aggregation windows
 
 typedef struct bmeval
 {
@@ -78,23 +108,222 @@ typedef struct bmeval
     float sealevel;         // hold current pressure at sealevel
     float height;           // hold calculated height based on pressure
     float dewpoint;         // hold calculated dewpoint
+    float iaq;              // air quality 0 - 500 (NAN = burn-in / none)
     uint32_t gas_resistance; // resistance of MOX sensor
+    uint8_t gas_index;      // heater set-point used for gas_resistance
+    uint16_t sensor;        // sensor the values are from
+    uint16_t sweepStart;    // heater sweep start temperature
+    uint16_t sweepEnd;      // heater sweep end temperature
+    uint8_t sweepSteps;     // heater sweep steps (0 = no sweep)
+    float gasPeriod;        // gas every # seconds (0 = every reading)
+    float noiseT;           // noise budget temperature (0 = -T)
+    float noiseP;           // noise budget pressure (0 = -P)
+    float noiseH;           // noise budget humidity (0 = -H)
+    uint16_t sweepTemp[BME680_HEATR_PROF_MAX]; // heater sweep temperatures
+    struct bme680_raw_data raw; // ADC values of the reading
+    unsigned long time;     // time of the reading (ms, library time)
 } bmeval;
 
 typedef struct measure
 {
     int       verbose;        // display debug information
     uint16_t  loop;           // # of measurement loops
-    uint16_t  loop_delay;     // loop delay (sec)
+    uint32_t  loop_delay;     // sample period (ms)
+    uint16_t  stream;         // stream buffer size (0 = no streaming)
+    uint32_t  bench;          // benchmark samples (0 = no benchmark)
+    bool      adaptive;       // adaptive conversion wait
+    bool      fast;           // fast altitude and dew point
+    uint8_t   backend;        // bus backend (BME680_BUS_xxx, -e)
+    char      replay[MAXBUF]; // capture file to replay
+    float     replay_speed;   // replay speed (0 = as fast as possible)
+    uint32_t  spi_speed;      // SPI clock (Hz)
     char      format[MAXBUF]; // output format
     char      v_save_file[MAXBUF];   // value savefile
+    uint32_t  log_buf;        // save file buffer (kB)
+    uint32_t  log_rows;       // flush save file after rows
+    uint32_t  log_secs;       // flush save file after seconds
+    uint32_t  log_rotate;     // rotate save file at size (kB), 0 = no
+    bool      log_daily;      // rotate save file at date change
+    char      bin_file[MAXBUF]; // binary capture file
+    char      calib_file[MAXBUF]; // calibration cache file
+    char      shm_name[MAXBUF]; // shared-memory name (daemon mode)
+    char      udp_dest[MAXBUF]; // UDP exporter destination host:port
+    uint16_t  udp_batch;      // samples per datagram
+    uint32_t  udp_ms;         // maximum wait (ms) before a datagram is sent
+    bool      udp_binary;     // binary frames instead of line protocol
+    int       writer;         // writer thread queue policy (-1 = no thread)
+    char      iaq_file[MAXBUF]; // air quality baseline file (enables IAQ)
     struct bmeval bme;       // BME680 info
+    struct bmeI2C_p i2c;     // I2C settings
+    int       sensors;        // number of sensors (1 + added with -N)
+    struct bmeI2C_p extra[BME680_MAX_DEVICES]; // I2C settings added sensors
 } measure;
 
+/* scheduler statistics */
+typedef struct sched
+{
+    uint32_t rounds;            // rounds completed
+    uint32_t samples[BME680_MAX_DEVICES]; // samples per sensor
+    double   first;             // start first round (seconds)
+    double   last;              // start previous round (seconds)
+    double   sum, sumsq;        // round interval (seconds)
+    double   min, max;          // round interval (seconds)
+    uint32_t missed;            // missed sample period deadlines
+} sched;
+
+/* save file */
+typedef struct logsink
+{
+    FILE     *fp;               // open save file (NULL = closed)
+    char     *buf;              // write buffer
+    uint32_t rows;              // rows since last flush
+    double   last_flush;        // time of last flush (seconds)
+    long     size;              // current file size
+    int      yday;              // day of the year file was opened
+} logsink;
+
+/* compiled output format : a list of texts and values */
+enum fmt_kind { F_TEXT, F_TEMP, F_HUM, F_PRES, F_HEIGHT, F_DEW, F_RES, F_RES_K,
+                F_SENSOR, F_GASIDX, F_GAS, F_SWEEP, F_LOCAL, F_EPOCH, F_IAQ };
+
+typedef struct fmt_op
+{
+    uint8_t  kind;              // F_xxx
+    uint8_t  len;               // F_TEXT : length
+    uint16_t text;              // F_TEXT : offset in outfmt.text
+} fmt_op;
+
+typedef struct outfmt
+{
+    fmt_op   op[FMTOPS];        // texts and values in order
+    int      ops;               // entries in op[]
+    char     text[OUTBUF];      // all texts
+    int      textlen;           // used in text[]
+    char     local[30];         // local time (\l) of local_sec
+    time_t   local_sec;
+    int64_t  epoch;             // epoch (ms) of library time 0
+} outfmt;
+
+/* binary capture file */
+typedef struct bincap
+{
+    FILE     *fp;               // open capture file (NULL = closed)
+    char     *buf;              // write buffer
+    int64_t  start;             // epoch (ms) of library time 0
+} bincap;
+
+/* shared-memory segment (daemon mode) */
+typedef struct shmpub
+{
+    struct bmeShmSegment *seg;  // mapped segment (NULL = not publishing)
+    char     name[MAXBUF];      // shared-memory name
+} shmpub;
+
+/* UDP exporter : samples are handed to a thread through a queue */
+typedef struct udpexp
+{
+    bool     running;           // thread started
+    int      stop;              // ask the thread to send the queue and stop
+    pthread_t thread;
+    int      sock;              // UDP socket
+    struct sockaddr_storage addr; // destination
+    socklen_t addrlen;
+    bool     binary;            // bmeUdpHeader + samples, else line protocol
+    int      batch;             // samples per datagram
+    uint32_t ms;                // maximum wait (ms) before a datagram is sent
+    struct bmeSpsc<struct bmeShmSample> q;
+    uint32_t datagrams;         // datagrams sent (thread)
+    uint32_t samples;           // samples sent (thread)
+    uint32_t errors;            // send errors (thread)
+} udpexp;
+
+/* writer thread : formatting and output, fed by the sampling loop */
+typedef struct writer
+{
+    bool     running;           // thread started
+    int      stop;              // ask the thread to output the queue and stop
+    int      error;             // an output failed (set by the thread)
+    pthread_t thread;
+    int      policy;            // BME680_SPSC_xxx when the queue is full
+    struct bmeSpsc<struct bmeval> q;
+    struct measure *mm;         // settings copy of the thread
+    uint32_t blocked;           // sampler waits, queue full (block policy)
+} writer;
+
+/* aggregation : running statistics per window and sensor */
+enum agg_value { A_TEMP, A_HUM, A_PRES, A_GAS, A_VALUES };
+
+typedef struct aggstat
+{
+    uint32_t n;                 // values
+    double   mean, m2;          // Welford : mean and sum of squared differences
+    double   min, max;
+} aggstat;
+
+typedef struct aggwin
+{
+    uint32_t secs;              // window length (s)
+    char     file[MAXBUF];      // sink (empty = display / save file)
+    FILE     *fp;
+    int64_t  start[BME680_MAX_DEVICES];     // window start (epoch ms)
+    uint32_t count[BME680_MAX_DEVICES];     // samples in the window
+    uint32_t unstable[BME680_MAX_DEVICES];  // heater unstable samples
+    struct aggstat st[BME680_MAX_DEVICES][A_VALUES];
+} aggwin;
+
+typedef struct aggregate
+{
+    int      windows;           // windows in win[] (0 = no aggregation)
+    struct aggwin win[AGGWIN];
+    struct measure *mm;         // for the output at closeout()
+} aggregate;
+
 char progname[20];
 
 /* global constructer */ 
-rasp_BME680 MyBme;
+rasp_BME680 MyBme[BME680_MAX_DEVICES];
+int NumSensors = 1;
+
+struct sched Sched;
+
+struct logsink Log;
+
+struct bincap Bin;
+
+struct shmpub Shm;
+
+struct udpexp Udp;
+
+struct writer Writer;
+
+struct aggregate Agg;
+
+struct outfmt Fmt;
+
+/* air quality baseline file (NULL = no air quality estimate) */
+const char *IaqFile = NULL;
+
+/* set by SIGUSR1 : display statistics */
+volatile sig_atomic_t DumpStats = 0;
+
+/* set by SIGINT / SIGTERM : the loops stop, main() performs closeout() */
+volatile sig_atomic_t StopReq = 0;
+
+void log_close();
+void bin_close();
+void shm_stop();
+void iaq_save();
+void agg_close();
+void udp_stop();
+void udp_report();
+
+bool do_output_values(struct measure *mm);
+bool output_values(struct measure *mm);
+bool write_output(struct measure *mm, char *buf, int len);
+bool thread_start(pthread_t *thread, void *(*func)(void *));
+bool writer_push(struct measure *mm);
+void writer_stop();
+void writer_report();
 
 /* used as part of p_printf() */
 bool NoColor= false;
@@ -124,40 +353,234 @@ void time_stamp(char *buf)
     1900 + tm->tm_year);
 }
 
+/*********************************************************************
+*  @brief get monotonic time
+*  @return time in seconds
+**********************************************************************/  
+double mono_time()
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return((double) ts.tv_sec + (double) ts.tv_nsec / 1e9);
+}
+
+/*********************************************************************
+*  @brief update scheduler statistics at start of a new round
+**********************************************************************/  
+void sched_round()
+{
+    double now = mono_time(), interval;
+    
+    if (Sched.rounds == 0) Sched.first = now;
+    else
+    {
+        interval = now - Sched.last;
+        Sched.sum += interval;
+        Sched.sumsq += interval * interval;
+        
+        if (Sched.rounds == 1 || interval < Sched.min) Sched.min = interval;
+        if (Sched.rounds == 1 || interval > Sched.max) Sched.max = interval;
+    }
+    
+    Sched.last = now;
+    Sched.rounds++;
+}
+
+/*********************************************************************
+*  @brief display samples/s per sensor and round jitter
+**********************************************************************/  
+void sched_report()
+{
+    double elapsed, mean, stdev;
+    uint32_t n;
+    int i;
+    
+    if (Sched.missed > 0) printf("\nmissed %u sample period deadlines\n", Sched.missed);
+    
+    if (Sched.rounds < 2) return;
+    
+    n = Sched.rounds - 1;           // intervals
+    elapsed = Sched.last - Sched.first;
+    mean = Sched.sum / n;
+    stdev = sqrt(fabs(Sched.sumsq / n - mean * mean));
+    
+    printf("\n%u rounds, round time %.1f ms (min %.1f, max %.1f, jitter (stdev) %.2f ms)\n",
+    Sched.rounds, mean * 1000, Sched.min * 1000, Sched.max * 1000, stdev * 1000);
+    
+    for (i = 0; i < NumSensors; i++)
+    {
+        uint32_t trans, bytes;
+        
+        printf("sensor %d : %u samples, %.2f samples/s", i, Sched.samples[i], 
+        (Sched.samples[i] > 1 ? (Sched.samples[i] - 1) / elapsed : 0));
+        
+        MyBme[i].getI2Ccount(&trans, &bytes);
+        
+        printf(", I2C %u transactions, %u bytes (incl. start)\n", trans, bytes);
+    }
+}
+
+/*********************************************************************
+*  @brief display readings lost in stream mode
+**********************************************************************/  
+void stream_report()
+{
+    int i;
+    
+    for (i = 0; i < NumSensors; i++)
+    {
+        if (MyBme[i].getStreamOverrun() > 0)
+            printf("sensor %d : %u readings lost (stream buffer full)\n", i, MyBme[i].getStreamOverrun());
+    }
+}
+
 /*********************************************************************
 *  @brief close hardware and program correctly
 *  @param val : exit value
 **********************************************************************/
 void closeout(int val)
 {
-    /* stop BME680 sensor */
-    MyBme.reset();
+    int i;
+    
+    /* output the samples still in the writer queue */
+    writer_stop();
     
-    /* close I2C channel */
-    MyBme.hw_close();
+    /* output incomplete aggregation windows */
+    agg_close();
+    
+    /* keep the air quality baseline for the next start */
+    iaq_save();
+    
+    /* write pending output to save file */
+    log_close();
+    bin_close();
+    shm_stop();
+    udp_stop();
+    
+    /* display scheduler results */
+    sched_report();
+    stream_report();
+    
+    for (i = 0; i < NumSensors; i++)
+    {
+        /* stop BME680 sensor */
+        MyBme[i].reset();
+    
+        /* close I2C channel */
+        MyBme[i].hw_close();
+    }
     
     exit(val);
 }
 
 /*********************************************************************
- * @brief : catch signals to close out correctly 
- * @param sig_num : signal raised to program
+ * @brief : display the statistics of all sensors on stderr
  *********************************************************************/
-void signal_handler(int sig_num)
+void stats_dump()
 {
-    switch(sig_num)
+    static const char *lat[BME680_LAT_BUCKETS] = { "<1", "1-2", "2-4", "4-8", "8-16",
+        "16-32", "32-64", "64-128", "128-256", ">=256" };
+    struct bmeStats st;
+    int i, n;
+    
+    for (n = 0; n < NumSensors; n++)
     {
-        case SIGINT:
-        case SIGKILL:
-        case SIGABRT:
-        case SIGTERM:
-        default:
-            printf("\nStopping BME680 monitor\n");
-            closeout(EXIT_SUCCESS);
-            break;
+        MyBme[n].getStats(&st);
+        
+        fprintf(stderr, "\nsensor %d statistics\n", n);
+        fprintf(stderr, "readings %u, status polls %u, no new data %u, heater unstable %u\n",
+            st.readings, st.polls, st.no_new_data, st.heater_unstable);
+        fprintf(stderr, "I2C %u transactions, %u bytes, %u errors, %u NACK, %u clock stretch\n",
+            st.transactions, st.bytes, st.errors, st.nacks, st.clock_stretch);
+        
+        if (MyBme[n].getI2Cclock() > 0)
+            fprintf(stderr, "I2C clock %u Khz, %u fall backs to %d Khz\n",
+                MyBme[n].getI2Cclock(), st.clock_fallbacks, BME680_SPEED);
+        fprintf(stderr, "I2C retries : NACK %u, clock stretch %u, data %u, other %u\n",
+            st.retries[BME680_ST_NACK], st.retries[BME680_ST_CLKSTR], 
+            st.retries[BME680_ST_DATA], st.retries[BME680_ST_OTHER]);
+        fprintf(stderr, "latency (ms) :");
+        
+        for (i = 0; i < BME680_LAT_BUCKETS; i++) fprintf(stderr, " %s: %u", lat[i], st.latency[i]);
+        
+        fprintf(stderr, "\n");
+#ifdef BME680_TRACE
+        MyBme[n].dumpTrace(stderr);
+#endif
+    }
+    
+    udp_report();
+    writer_report();
+}
+
+/*********************************************************************
+ * @brief : display statistics if requested with SIGUSR1
+ *********************************************************************/
+void stats_check()
+{
+    if (DumpStats)
+    {
+        DumpStats = 0;
+        stats_dump();
+    }
+}
+
+/*********************************************************************
+ * @brief : save the air quality baseline of all sensors
+ *********************************************************************/
+void iaq_save()
+{
+    int n;
+    
+    if (IaqFile == NULL) return;
+    
+    for (n = 0; n < NumSensors; n++) MyBme[n].saveAirQuality(IaqFile);
+}
+
+/*********************************************************************
+ * @brief : save the air quality baseline every IAQSAVE seconds
+ *********************************************************************/
+void iaq_check()
+{
+    static double last = 0;
+    double now;
+    
+    if (IaqFile == NULL) return;
+    
+    now = mono_time();
+    
+    if (last == 0) last = now;
+    else if (now - last >= IAQSAVE)
+    {
+        iaq_save();
+        last = now;
     }
 }
 
+/*********************************************************************
+ * @brief : SIGUSR1 : only set a flag, the main loops display the
+ *          statistics (stats_check())
+ * @param sig_num : signal raised to program
+ *********************************************************************/
+void stats_handler(int sig_num)
+{
+    DumpStats = 1;
+}
+
+/*********************************************************************
+ * @brief : SIGINT / SIGTERM : only set a flag, the main loops stop and
+ *          closeout() is performed from main(). closeout() joins the
+ *          output threads, writes files and frees memory, none of that
+ *          can be done in a signal handler
+ * @param sig_num : signal raised to program
+ *********************************************************************/
+void signal_handler(int sig_num)
+{
+    StopReq = 1;
+}
+
 /*********************************************************************
  * @brief : setup signals 
  *********************************************************************/
@@ -169,11 +592,14 @@ void set_signals()
     act.sa_handler = &signal_handler;
     sigemptyset(&act.sa_mask);
     
+    /* no SA_RESTART : a sleep returns EINTR and the loop stops */
     sigaction(SIGTERM,&act, NULL);
     sigaction(SIGINT,&act, NULL);
-    sigaction(SIGABRT,&act, NULL);
-    sigaction(SIGSEGV,&act, NULL);
-    sigaction(SIGKILL,&act, NULL);
+    
+    /* statistics on request */
+    act.sa_handler = &stats_handler;
+    act.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1,&act, NULL);
 }
 
 /**********************************************************
@@ -236,19 +662,56 @@ void usage(struct measure *mm)
     "-T #       temperature oversampling (default %d)\n"
     "-C #       heater temperature       (default %d C)\n"
     "-K #       heater warm-up time      (default %d Ms)\n"
+    "-G #,#,#   heater sweep: start C, end C, steps (max %d)\n"
+    "-g #       gas every # seconds, other readings without heater and\n"
+    "           the last gas value (default 0 : every reading)\n"
+    "-n #,#,#   noise budget temperature C, pressure Pa, humidity %%:\n"
+    "           lowest oversampling within it (0 = -T / -P / -H)\n"
 
     "\nprogram settings: \n\n"
+    "-a         adaptive wait : learn the conversion time of each sensor\n"
     "-B         no colored output\n"
+    "-b #       benchmark : # samples back-to-back, time per stage on stderr\n"
+    "-c file    calibration cache file : faster start, no reset of the BME680\n"
+    "-e spi[,#[,#]] BME680's on SPI (# sensors on CS0 / CS1, default 1,\n"
+    "           # = clock in MHz max 10, default 10), requires root\n"
+    "-e sim[,#] simulated BME680's (# sensors, default 1), no hardware needed\n"
+    "-e replay,file[,#] simulated BME680's with the readings of capture file\n"
+    "           (-X), a sensor per sensor in the file, # = speed (default 1,\n"
+    "           0 = as fast as possible)\n"
+    "-f         fast altitude and dew point : tables instead of pow() / log()\n"
+    "           (max difference %.2f m, %.4f C)\n"
     "-L #       loop count               (default 0: endless)\n"
-    "-D #       delay between loops      (default %d seconds)\n"
-    "-O string  output format string\n"
+    "-D #       sample period in seconds (e.g. 0.25) or ms (e.g. 250ms)\n"
+    "           (default %d seconds)\n"
+    "-O string  output format string or preset csv, tsv, json\n"
+    "-S #       stream : sample continuously, buffer # readings (-L = samples)\n"
     "-V #       verbose level (1 = user program, 2 + driver messages.\n"
     "-W file    save formatted output to file\n"
+    "-w #,#,#   save file buffer kB, flush after rows, seconds (default %d,%d,%d)\n"
+    "-R #       rotate save file at # kB or 'day' at date change\n"
+    "-X file    capture raw values to binary file (decode with bme680dec)\n"
+    "-U dest    export samples with UDP to dest host:port (separate thread)\n"
+    "-u #,#     UDP batch : samples per datagram, max wait ms (default %d,%d)\n"
+    "-E format  UDP format : line (InfluxDB line protocol, default) or bin\n"
+    "-Z #[:file],.. aggregate : min/mean/max/stddev per window of # seconds\n"
+    "           (max %d windows, e.g. 1,10,60:min.csv), a line per window to\n"
+    "           file or display / -W instead of a line per sample\n"
+    "-q file    air quality estimate (IAQ 0 - 500, format Q), baseline\n"
+    "           saved in file, a restart skips the burn-in\n"
+    "-Q policy  output from a writer thread, sampling never waits for slow\n"
+    "           output. Queue full : block, oldest or newest (is dropped)\n"
+    "-Y name    daemon : publish samples in shared memory (e.g. /bme680), no\n"
+    "           display. Read with bme680rd or bme680_shm.h\n"
+    "\n           kill -USR1 <pid> : display statistics of all sensors on stderr\n"
+    "           (and the last I2C transfers if build with make TRACE=1)\n"
     
     "\nI2C settings: \n\n"
     "-A #       i2C address              (default 0x%02x)\n"
+    "-N #[,#,#] add sensor: i2C address [,SDA GPIO, SCL GPIO (SOFT I2C)]\n"
     "-i         interface with HARD_I2C  (default software I2C)\n"
-    "-I #       I2C speed 1 - 400        (default %d Khz)\n"
+    "-I #       hard I2C speed 1 - 400   (default %d Khz)\n"
+    "           fast = 400 Khz, back to 100 Khz after errors\n"
     "-s #       SOFT I2C GPIO # for SDA  (default GPIO %d)\n"
     "-d #       SOFT I2C GPIO # for SCL  (default GPIO %d)\n"
 
@@ -256,75 +719,176 @@ void usage(struct measure *mm)
 
     ,progname, mm->bme.filter, mm->bme.overSampleH,
     mm->bme.overSampleP, mm->bme.overSampleT ,mm->bme.heaterT, 
-    mm->bme.heaterM, LOOPDELAY,I2Csettings.I2C_Address, 
-    I2Csettings.baudrate, DEF_SDA, DEF_SCL, VERSION);
+    mm->bme.heaterM, BME680_HEATR_PROF_MAX, BME680_ALT_ERROR, BME680_DEW_ERROR, LOOPDELAY,
+    LOGBUFSIZE, LOGROWS, LOGSECS, UDPBATCH, UDPMS, AGGWIN, mm->i2c.I2C_Address, 
+    mm->i2c.baudrate, DEF_SDA, DEF_SCL, VERSION);
 }
 
 /*********************************************************************
- *  @brief : perform init (take in account commandline option) 
+ *  @brief : perform init of a sensor (take in account commandline option) 
  *  @param mm ; measurement variables
+ *  @param n ; sensor to initialize
+ *  @param i2c ; I2C settings for the sensor
  * 
  *  speed of i2C, i2C addresses etc. &  set oversampling /filter.
  *********************************************************************/
-void init_hardware(struct measure *mm)
+void init_sensor(struct measure *mm, int n, struct bmeI2C_p *i2c)
 {
-    /* hard_I2C requires  root permission */    
-    if (I2Csettings.I2C_interface == hard_I2C)
+    /* hard_I2C and SPI require root permission */    
+    if ((mm->backend == BME680_BUS_I2C && i2c->I2C_interface == hard_I2C) ||
+        mm->backend == BME680_BUS_SPI)
     {
         if (geteuid() != 0)
         {
             p_printf(RED,(char *)"You must be super user\n");
-            exit(EXIT_FAILURE);
+            closeout(EXIT_FAILURE);
         }
     }
 
     /* set hardware and I2C measurement settings */
     if (mm->verbose) 
     {
-        printf((char *)"initialize BCM2835 / BME680\n");
-        printf((char *)"set slaveaddres 0x%x\n",I2Csettings.I2C_Address);
-        printf((char *)"set baudrate %dKhz\n",I2Csettings.baudrate);
+        printf((char *)"initialize BCM2835 / BME680 sensor %d\n", n);
+        printf((char *)"set slaveaddres 0x%x\n",i2c->I2C_Address);
+        printf((char *)"set baudrate %dKhz\n",i2c->baudrate);
         
         // potentially enable debug messages
-        if (mm->verbose == 2) MyBme.setDebug(1);
+        if (mm->verbose == 2) MyBme[n].setDebug(1);
     }
     
-    if (MyBme.begin() != true)
+    MyBme[n].setI2Csettings(i2c);
+    MyBme[n].setBackend(mm->backend, mm->replay, mm->replay_speed);
+
+    /* sensor 0 on chip select 0, sensor 1 on chip select 1 */
+    if (mm->backend == BME680_BUS_SPI)
+        MyBme[n].setSPIsettings(n == 0 ? BCM2835_SPI_CS0 : BCM2835_SPI_CS1, mm->spi_speed);
+
+    if (strlen(mm->calib_file) > 0) MyBme[n].setCalibFile(mm->calib_file);
+
+    MyBme[n].setAdaptiveWait(mm->adaptive);
+    MyBme[n].setFastDerived(mm->fast);
+    
+    /* air quality estimate, restore the baseline */
+    if (strlen(mm->iaq_file) > 0)
     {
-        p_printf(RED,(char *)"error during starting BME680\n");
-        exit(EXIT_FAILURE);
+        MyBme[n].setAirQuality(true);
+        IaqFile = mm->iaq_file;
+        
+        if (MyBme[n].loadAirQuality(mm->iaq_file))
+        {
+            if (mm->verbose) printf("sensor %d : air quality baseline restored\n", n);
+        }
+        else if (mm->verbose) printf("sensor %d : air quality burn-in (%d minutes)\n", n, BME680_IAQ_BURNIN / 60);
     }
+    
+    if (MyBme[n].begin() != true)
+    {
+        p_printf(RED,(char *)"error during starting BME680 sensor %d\n", n);
+        closeout(EXIT_FAILURE);
+    }
+    
+    if (mm->verbose && MyBme[n].getI2Cclock() > 0)
+        printf((char *)"sensor %d : I2C clock %d Khz\n", n, MyBme[n].getI2Cclock());
  
     /* set BME680 measurement settings */
-    if (MyBme.setHumidityOversampling(getOversample(mm->bme.overSampleH)) == false)
+    if (MyBme[n].setHumidityOversampling(getOversample(mm->bme.overSampleH)) == false)
     {
         p_printf(RED,(char *) "incorrect BME680 humidity oversampling: %d\n",mm->bme.overSampleH);
         closeout(EXIT_FAILURE);
     }  
  
-    if (MyBme.setTemperatureOversampling(getOversample(mm->bme.overSampleT)) == false)
+    if (MyBme[n].setTemperatureOversampling(getOversample(mm->bme.overSampleT)) == false)
     {
         p_printf(RED,(char *) "incorrect BME680 temperature oversampling: %d\n",mm->bme.overSampleT);
         closeout(EXIT_FAILURE);
     }   
  
-    if (MyBme.setPressureOversampling(getOversample(mm->bme.overSampleP)) == false)
+    if (MyBme[n].setPressureOversampling(getOversample(mm->bme.overSampleP)) == false)
     {
         p_printf(RED,(char *) "incorrect BME680 pressure oversampling: %d\n",mm->bme.overSampleP);
         closeout(EXIT_FAILURE);
     } 
+    
+    /* lowest oversampling within the noise budget instead */
+    if ((mm->bme.noiseT > 0 || mm->bme.noiseP > 0 || mm->bme.noiseH > 0) &&
+        MyBme[n].setNoiseBudget(mm->bme.noiseT, mm->bme.noiseP, mm->bme.noiseH) == false)
+    {
+        p_printf(RED,(char *) "BME680 noise budget %.4f C, %.2f Pa, %.3f %% below the noise at 16x\n",
+            mm->bme.noiseT, mm->bme.noiseP, mm->bme.noiseH);
+        closeout(EXIT_FAILURE);
+    }
   
-    if (MyBme.setIIRFilterSize(getfilter(mm->bme.filter)) == false)
+    if (MyBme[n].setIIRFilterSize(getfilter(mm->bme.filter)) == false)
     {
         p_printf(RED,(char *) "incorrect BME680 filter size: %d\n",mm->bme.filter);
         closeout(EXIT_FAILURE);
     } 
  
-    if (MyBme.setGasHeater(mm->bme.heaterT, mm->bme.heaterM) == false)
+    if (MyBme[n].setGasHeater(mm->bme.heaterT, mm->bme.heaterM) == false)
     {
         p_printf(RED,(char *) "incorrect BME680 gas setting: temp %d, time %d\n",mm->bme.heaterT,mm->bme.heaterM);
         closeout(EXIT_FAILURE);
     }     
+    
+    MyBme[n].setDutyCycle((uint32_t) (mm->bme.gasPeriod * 1000));
+    
+    /* set heater profile for sweep */
+    if (mm->bme.sweepSteps > 0)
+    {
+        uint16_t dur[BME680_HEATR_PROF_MAX];
+        int i;
+        
+        for (i = 0; i < mm->bme.sweepSteps; i++)
+        {
+            if (mm->bme.sweepSteps == 1) mm->bme.sweepTemp[i] = mm->bme.sweepStart;
+            else mm->bme.sweepTemp[i] = mm->bme.sweepStart + 
+                ((mm->bme.sweepEnd - mm->bme.sweepStart) * i) / (mm->bme.sweepSteps - 1);
+            
+            dur[i] = mm->bme.heaterM;
+        }
+        
+        if (MyBme[n].setHeaterProfile(mm->bme.sweepTemp, dur, mm->bme.sweepSteps) == false)
+        {
+            p_printf(RED,(char *) "incorrect BME680 heater sweep: %d - %d C, %d steps, time %d\n",
+            mm->bme.sweepStart, mm->bme.sweepEnd, mm->bme.sweepSteps, mm->bme.heaterM);
+            closeout(EXIT_FAILURE);
+        }
+    }
+}
+
+/*********************************************************************
+ *  @brief : perform init of all sensors 
+ *  @param mm ; measurement variables
+ *********************************************************************/
+void init_hardware(struct measure *mm)
+{
+    struct bmeI2C_p i2c;
+    int n;
+    
+    for (n = 0; n < mm->sensors; n++)
+    {
+        /* first sensor is set with -A -i -s -d -I (simulated : all) */
+        if (n == 0 || mm->backend != BME680_BUS_I2C) i2c = mm->i2c;
+        else
+        {
+            i2c = mm->extra[n - 1];
+            
+            /* same channel as first sensor */
+            if (i2c.sda == 0)
+            {
+                i2c.I2C_interface = mm->i2c.I2C_interface;
+                i2c.sda = mm->i2c.sda;
+                i2c.scl = mm->i2c.scl;
+            }
+            
+            i2c.baudrate = mm->i2c.baudrate;
+        }
+
+        /* allow closeout() to include this sensor */
+        NumSensors = n + 1;
+        
+        init_sensor(mm, n, &i2c);
+    }
 }
 
 /*********************************************************************
@@ -334,11 +898,13 @@ void init_hardware(struct measure *mm)
 void init_variables(struct measure *mm)
 {
     /* set I2C */
-    I2Csettings.I2C_interface = soft_I2C;// I2c communication
-    I2Csettings.I2C_Address = BME680_DEFAULT_ADDRESS;
-    I2Csettings.sda = DEF_SDA;           // default SDA line for soft_I2C
-    I2Csettings.scl = DEF_SCL;           // SCL GPIO for soft_I2C
-    I2Csettings.baudrate = BME680_SPEED; // set default baudrate   
+    mm->i2c.hw_initialized = false;
+    mm->i2c.I2C_interface = soft_I2C;// I2c communication
+    mm->i2c.I2C_Address = BME680_DEFAULT_ADDRESS;
+    mm->i2c.sda = DEF_SDA;           // default SDA line for soft_I2C
+    mm->i2c.scl = DEF_SCL;           // SCL GPIO for soft_I2C
+    mm->i2c.baudrate = BME680_SPEED; // set default baudrate   
+    mm->sensors = 1;
     
     /* BME680 measurement settings */
     mm->bme.overSampleT = 16;           // oversampling
@@ -347,13 +913,38 @@ void init_variables(struct measure *mm)
     mm->bme.filter = 7;                 // filter
     mm->bme.heaterT = 300;              // heater temperature
     mm->bme.heaterM = 150;              // heater time
+    mm->bme.gasPeriod = 0;              // gas every reading
+    mm->bme.noiseT = mm->bme.noiseP = mm->bme.noiseH = 0;
+    mm->bme.sweepSteps = 0;             // no heater sweep
     
     /* set program instructions */
     mm->verbose = 0;
     mm->loop = 0;
-    mm->loop_delay = LOOPDELAY;
+    mm->loop_delay = LOOPDELAY * 1000;
+    mm->stream = 0;
+    mm->bench = 0;
+    mm->adaptive = false;
+    mm->fast = false;
+    mm->backend = BME680_BUS_I2C;
+    mm->replay[0] = 0x0;
+    mm->replay_speed = 1.0;
+    mm->spi_speed = BME680_SPI_SPEED;
     mm->format[0] = 0x0;
     mm->v_save_file[0] = 0x0;
+    mm->log_buf = LOGBUFSIZE;
+    mm->log_rows = LOGROWS;
+    mm->log_secs = LOGSECS;
+    mm->log_rotate = 0;
+    mm->log_daily = false;
+    mm->bin_file[0] = 0x0;
+    mm->calib_file[0] = 0x0;
+    mm->shm_name[0] = 0x0;
+    mm->udp_dest[0] = 0x0;
+    mm->udp_batch = UDPBATCH;
+    mm->udp_ms = UDPMS;
+    mm->udp_binary = false;
+    mm->writer = -1;
+    mm->iaq_file[0] = 0x0;
     
     /* reset results */
     mm->bme.sealevel = 0;
@@ -362,241 +953,1909 @@ void init_variables(struct measure *mm)
     mm->bme.pressure =0;
     mm->bme.humid=0;
     mm->bme.dewpoint=0;
+    mm->bme.iaq = NAN;
+    mm->bme.gas_resistance = 0;
+    mm->bme.gas_index = 0;
 }
 
 /*********************************************************************
- * @brief : Read BME680 for temperature, humidity, pressure 
- *           and calculation height and dew_point
+ * @brief : store and check measurement results
  * @param mm ; measurement variables
+ * @param s ; results of a reading
  * 
  * @return : TRUE if OK, false if error
  *********************************************************************/
-bool read_BME680(struct measure *mm)
+bool store_sample(struct measure *mm, struct bmeSample *s)
 {
-    if (mm->verbose) printf("Try reading BME680 values\n"); 
-    
     /* get temperature */
-    mm->bme.tempC = MyBme.readTemperature();
+    mm->bme.tempC = s->temperature;
     
-    if (mm->bme.tempC == NAN)
+    if (isnan(mm->bme.tempC))
     {
         p_printf(RED,(char *)"can not read temperature\n");
         return(false);
     }       
 
     /* get humidity */
-    mm->bme.humid = MyBme.readHumidity();
+    mm->bme.humid = s->humidity;
     
-    if (mm->bme.humid == NAN)
+    if (isnan(mm->bme.humid))
     {
         p_printf(RED,(char *)"can not read humidity\n");
         return(false);
     }  
 
     /* get pressure */
-    mm->bme.pressure = MyBme.readPressure();
+    mm->bme.pressure = s->pressure;
     
-    if (mm->bme.pressure == NAN)
+    if (isnan(mm->bme.pressure))
     {
         p_printf(RED,(char *)"can not read pressure\n");
         return(false);
     } 
     
     /* get gas */
-    mm->bme.gas_resistance = MyBme.readGas();
-    if (mm->bme.gas_resistance == 0)
-    {
-        p_printf(RED,(char *)"can not gas resistance\n");
-        return(false);
-    } 
+    mm->bme.gas_resistance = s->gas_resistance;
+    mm->bme.gas_index = s->gas_index;
+    mm->bme.raw = s->raw;
+    mm->bme.time = s->time;
 
-    // Calculate hight in meters
-    mm->bme.height = MyBme.readAltitude(mm->bme.sealevel);
+    // hight in meters
+    mm->bme.height = s->altitude;
 
-    // calculate dew_point
-    mm->bme.dewpoint = MyBme.calc_dewpoint(mm->bme.tempC, mm->bme.humid);
+    // dew_point
+    mm->bme.dewpoint = s->dewpoint;
+    
+    // air quality
+    mm->bme.iaq = s->iaq;
 
     return(true);
 }
 
-/***************************************************************
- * @brief add to output buffer before checking on length
- * @param buf : end result buffer
- * @param buf1 : data to add to buf
- ***************************************************************/
-void add_to_buf(char * buf, char * buf1 )
-{
-    if (strlen(buf) + strlen(buf1) > MAXBUF)    return;
-    
-    strcat(buf, buf1);
-}
-
-/*****************************************************************
- * @brief : format output buffer
+/*********************************************************************
+ * @brief : Read all BME680 sensors for temperature, humidity, pressure 
+ *           and calculation height and dew_point and output the results
  * @param mm ; measurement variables
- * @param buf ; formatted data to output
- *  
- * output format can be defined
  * 
- * BME results :
- *  T = temperature from BME
- *  H = Humidity from BME
- *  P = Pressure from BME
- *  M = height compared to sealevel
- *  R = Resistance from BME
- *  D = dewpoint
+ * The conversions on all sensors are started back-to-back. After that
+ * the results are collected in order of the expected end of the 
+ * conversion. The round takes about one measurement period, 
+ * independent of the number of sensors.
  * 
- * Markup: 
- *  \l = local time
- *  \t = tab
- *  \s = space
- *  \, = comma
- *  \; = semicolon
- *  \\x = character x is included (x can be any)
- *  \n = new line
- *****************************************************************/
-void format_output(struct measure *mm, char *buf)
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool read_BME680(struct measure *mm)
 {
-    char    *p,tm[30];
-  
-    /* use default output if no specific format was requested */
-    if (strlen(mm->format) == 0 )
-    {
-        sprintf(buf, "Temp: %2.2f\tHumidity: %2.2f\tpressure: %2.2f\t gas resistance %u Kohm\n",mm->bme.tempC, mm->bme.humid, mm->bme.pressure/100, mm->bme.gas_resistance/1000);
-        return;
-    }
-    else
-    {
-        /* reset output buffer */
-        buf[0] = 0x0;   
-    }
+    struct bmeSample s;
+    unsigned long meas_end[BME680_MAX_DEVICES], now;
+    int order[BME680_MAX_DEVICES];
+    int i, j, n, tries;
+    int8_t rslt;
+
+    if (mm->verbose) printf("Try reading BME680 values\n"); 
     
-    p = mm->format;
+    sched_round();
     
-    while (*p != 0x0)
+    /* start conversion on all sensors */
+    for (n = 0; n < NumSensors; n++)
     {
-        // BME results
-        if (*p == 'T')       sprintf(tm, " Temp: %2.2f",mm->bme.tempC);
-        else if (*p == 'H') sprintf(tm, " Humidity: %2.2f",mm->bme.humid);
-        else if (*p == 'P') sprintf(tm, " Pressure: %2.2f",mm->bme.pressure/100);
-        else if (*p == 'M') sprintf(tm, " Height: %2.2f",mm->bme.height);
-        else if (*p == 'R') sprintf(tm, " Resistance: %d",mm->bme.gas_resistance/1000);
-        else if (*p == 'D') sprintf(tm, " Dewpoint: %2.2f",mm->bme.dewpoint);
+        meas_end[n] = MyBme[n].beginReading();
         
-        // markup
-        else if (*p == '\\')
+        if (meas_end[n] == 0)
         {
-            p++;
-
-            if (*p == 't') sprintf(tm, "\t");
-            else if (*p == 's') sprintf(tm, " ");
-            else if (*p == 'n') sprintf(tm, "\n");
-            else if (*p == ',') sprintf(tm, ",");
-            else if (*p == ';') sprintf(tm, ";");
-            else if (*p == 'l')
-            {
-                // get timestamp
-                time_stamp(tm);
-            }
-            else if (*p == '\\')
-            {
-                p++; 
-                sprintf(tm, "%c",*p);
-            }
+            p_printf(RED,(char *)"can not start reading BME680 sensor %d\n", n);
+            return(false);
         }
         
-        // trouble ...
-        else
-        {
-            printf("Illegal character %c in output format string: %s\n", *p, mm->format);
-
-            sprintf(buf, "Temp: %2.2f\tHumidity: %2.2f\tpressure: %2.2f\t gas resistance %u Kohm\n",mm->bme.tempC, mm->bme.humid, mm->bme.pressure/100, mm->bme.gas_resistance/1000);
-
-            return;
-        }
-   
-        add_to_buf(buf,tm);
+        /* insert in order of expected end */
+        for (i = n; i > 0 && (long) (meas_end[order[i - 1]] - meas_end[n]) > 0; i--)
+            order[i] = order[i - 1];
         
-        p++;    
- 
+        order[i] = n;
     }
     
-    add_to_buf(buf, (char *) "\n");
-}
-
-/**********************************************************
- *  @brief output values to screen and file (if requested) 
- *  @return true if OK, false if error
- **********************************************************/
-bool do_output_values(struct measure *mm)
-{
-    FILE    *fp = NULL ;
-    char    buf[MAXBUF];
-
-    if (mm->verbose) printf("output BME680 values\n");  
-    
-    /* create output string */
-    format_output(mm, buf);
-        
-    /* display output */
-    p_printf(YELLOW,(char *) "%s",buf);
-     
-    /* append output to a save_file (if requested) */
-    if (strlen (mm->v_save_file) > 0)
+    /* collect results in order of expected end */
+    for (j = 0; j < NumSensors; j++)
     {
-        if(mm->verbose >1 ) printf("Appending data to file %s\n",mm->v_save_file);
+        n = order[j];
+        tries = 10;
         
-        // save baseline to file
-        fp = fopen (mm->v_save_file, "a");
-           
-        // Checks if file is open
-        if (fp == NULL )
-        { 
-            p_printf(RED,(char *) "Issue with opening output file: %s\n", mm->v_save_file);                      
-            return(false);
+        while ((rslt = MyBme[n].tryCollect(s, mm->bme.sealevel)) == BME680_W_NO_NEW_DATA)
+        {
+            now = MyBme[n].getMillis();
+            
+            /* sleep till expected end */
+            if ((long) (meas_end[n] - now) > 0)
+                usleep((meas_end[n] - now) * 1000);
+            
+            /* poll status */
+            else if (tries-- > 0)
+                usleep(BME680_POLL_PERIOD_MS * 1000);
+            
+            else
+                break;
         }
         
-        // write ouput
-        if (fwrite(buf, sizeof(char), strlen(buf),fp) != strlen(buf))
-        { 
-            p_printf(RED,(char *) "Issue during writing output file: %s\n", mm->v_save_file);                      
-            fclose(fp);
+        if (rslt != BME680_OK)
+        {
+            p_printf(RED,(char *)"can not read BME680 sensor %d\n", n);
             return(false);
         }
-        
-        fclose(fp);
-    }
     
-    return(true);
+        mm->bme.sensor = n;
+        
+        if (mm->verbose) printf("sensor %d : %d I2C transactions, %d bytes\n", 
+            n, s.i2c_transactions, s.i2c_bytes);
+        
+        if (mm->verbose && mm->adaptive) printf("sensor %d : learned conversion time %u us\n",
+            n, MyBme[n].getConvTime());
+        
+        if (store_sample(mm, &s) == false) return(false);
+    
+        if (mm->bme.gas_resistance == 0)
+        {
+            p_printf(RED,(char *)"can not gas resistance\n");
+            return(false);
+        } 
+        
+        Sched.samples[n]++;
+        
+        /* do output */
+        if (do_output_values(mm) == false) return(false);
+    }
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : Run a heater sweep and output a line for each step
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool sweep_BME680(struct measure *mm)
+{
+    struct bmeSample s[BME680_HEATR_PROF_MAX];
+    uint8_t cnt, i;
+    int n;
+    
+    if (mm->verbose) printf("Try heater sweep BME680\n"); 
+    
+    sched_round();
+    
+    for (n = 0; n < NumSensors; n++)
+    {
+        cnt = MyBme[n].sampleHeaterProfile(s, mm->bme.sealevel);
+
+        if (cnt != mm->bme.sweepSteps)
+        {
+            p_printf(RED,(char *)"can not read BME680 sensor %d heater sweep (step %d)\n", n, cnt);
+            return(false);
+        }
+    
+        mm->bme.sensor = n;
+        
+        for (i = 0; i < cnt; i++)
+        {
+            if (store_sample(mm, &s[i]) == false) return(false);
+        
+            Sched.samples[n]++;
+            
+            if (do_output_values(mm) == false)  return(false);
+        }
+    }
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : format and output the readings in the stream buffer of a sensor
+ * @param mm ; measurement variables
+ * @param n ; sensor
+ * @param todo ; number of samples still to output (0 = endless)
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool stream_drain(struct measure *mm, int n, uint32_t todo)
+{
+    struct bmeSample s[STREAMBATCH];
+    uint16_t cnt, i;
+    
+    mm->bme.sensor = n;
+    
+    while ((cnt = MyBme[n].streamRead(s, STREAMBATCH, mm->bme.sealevel)) > 0)
+    {
+        for (i = 0; i < cnt; i++)
+        {
+            if (mm->loop > 0 && Sched.samples[n] >= todo) return(true);
+            
+            if (store_sample(mm, &s[i]) == false) return(false);
+            
+            Sched.samples[n]++;
+            
+            if (do_output_values(mm) == false) return(false);
+        }
+    }
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : stream mode : sample all sensors as fast as possible
+ * @param mm ; measurement variables
+ * 
+ * Each sensor starts the next conversion as soon as a reading is 
+ * collected. The readings are buffered in the library and formatted 
+ * in batches, while the sensors convert the next readings.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool stream_BME680(struct measure *mm)
+{
+    unsigned long next, now, meas_end;
+    bool done;
+    int n;
+    int8_t rslt;
+    
+    printf((char *)"starting stream\n");
+    
+    sched_round();
+    
+    for (n = 0; n < NumSensors; n++)
+    {
+        if (MyBme[n].startStream(mm->stream) == false)
+        {
+            p_printf(RED,(char *)"can not start stream BME680 sensor %d\n", n);
+            return(false);
+        }
+    }
+    
+    while (1)
+    {
+        done = true;
+        now = MyBme[0].getMillis();
+        next = now + BME680_POLL_PERIOD_MS;
+        
+        for (n = 0; n < NumSensors; n++)
+        {
+            rslt = MyBme[n].streamService();
+            
+            if (rslt < BME680_OK)
+            {
+                p_printf(RED,(char *)"can not read BME680 sensor %d\n", n);
+                return(false);
+            }
+            
+            /* output in batches */
+            if (MyBme[n].streamAvailable() >= STREAMBATCH || 
+                MyBme[n].streamAvailable() >= (mm->stream + 1) / 2 ||
+                (mm->loop > 0 && Sched.samples[n] + MyBme[n].streamAvailable() >= mm->loop))
+            {
+                if (stream_drain(mm, n, mm->loop) == false) return(false);
+            }
+            
+            if (mm->loop == 0 || Sched.samples[n] < mm->loop) done = false;
+            
+            /* earliest expected end of conversion */
+            meas_end = MyBme[n].getMeasEnd();
+            
+            if (rslt == BME680_W_NO_NEW_DATA && (long) (meas_end - now) > 0 &&
+                (long) (meas_end - next) < 0)
+                next = meas_end;
+        }
+        
+        if (done || StopReq) break;
+        
+        stats_check();
+        iaq_check();
+        
+        /* sleep till first expected end */
+        now = MyBme[0].getMillis();
+        
+        if ((long) (next - now) > 0) usleep((next - now) * 1000);
+    }
+    
+    /* stopped : output the readings still in the stream buffers */
+    if (StopReq)
+    {
+        for (n = 0; n < NumSensors; n++)
+        {
+            if (stream_drain(mm, n, mm->loop) == false) return(false);
+        }
+    }
+    
+    for (n = 0; n < NumSensors; n++) MyBme[n].stopStream();
+    
+    return(true);
+}
+
+/*****************************************************************
+ * @brief : add literal text to the compiled format
+ * @param t : text
+ * @param len : length of text
+ * 
+ * @return : TRUE if OK, false if too long
+ *****************************************************************/
+bool fmt_text(const char *t, int len)
+{
+    fmt_op *op = NULL;
+    
+    if (Fmt.textlen + len > OUTBUF) return(false);
+    
+    /* extend previous text if possible */
+    if (Fmt.ops > 0) op = &Fmt.op[Fmt.ops - 1];
+    
+    if (op == NULL || op->kind != F_TEXT || op->len + len > 255)
+    {
+        if (Fmt.ops == FMTOPS) return(false);
+        
+        op = &Fmt.op[Fmt.ops++];
+        op->kind = F_TEXT;
+        op->text = Fmt.textlen;
+        op->len = 0;
+    }
+    
+    memcpy(Fmt.text + Fmt.textlen, t, len);
+    Fmt.textlen += len;
+    op->len += len;
+    
+    return(true);
+}
+
+/*****************************************************************
+ * @brief : add a value to the compiled format
+ * @param kind : F_xxx
+ * @param label : text before the value (or NULL)
+ * 
+ * @return : TRUE if OK, false if too long
+ *****************************************************************/
+bool fmt_value(uint8_t kind, const char *label)
+{
+    if (label != NULL && fmt_text(label, strlen(label)) == false) return(false);
+    
+    if (Fmt.ops == FMTOPS) return(false);
+    
+    Fmt.op[Fmt.ops++].kind = kind;
+    
+    return(true);
+}
+
+/*****************************************************************
+ * @brief : compile a preset (csv, tsv or json)
+ * @param sep : separator for csv / tsv, 0x0 for json lines
+ * 
+ * time (epoch seconds), sensor, temperature (C), humidity (%),
+ * pressure (hPa), gas resistance (Ohm), gas index
+ *****************************************************************/
+void fmt_preset(char sep)
+{
+    static const uint8_t kind[] = { F_EPOCH, F_SENSOR, F_TEMP, F_HUM, F_PRES, F_RES, F_GASIDX };
+    static const char *name[] = { "time", "sensor", "temperature", "humidity", "pressure", 
+                                  "gas_resistance", "gas_index" };
+    char label[30];
+    unsigned int i;
+    
+    for (i = 0; i < sizeof(kind); i++)
+    {
+        if (sep == 0x0)
+            sprintf(label, "%s\"%s\":", i == 0 ? "{" : ",", name[i]);
+        else
+            sprintf(label, "%c", sep);
+        
+        fmt_value(kind[i], (sep != 0x0 && i == 0) ? NULL : label);
+    }
+    
+    if (sep == 0x0) fmt_text("}", 1);
+}
+
+/*****************************************************************
+ * @brief : compile the output format string (once, at start)
+ * @param mm ; measurement variables
+ * 
+ * output format can be defined
+ * 
+ * BME results :
+ *  T = temperature from BME
+ *  H = Humidity from BME
+ *  P = Pressure from BME
+ *  M = height compared to sealevel
+ *  R = Resistance from BME
+ *  D = dewpoint
+ *  G = heater set-point (gas index) and temperature
+ *  N = sensor number
+ *  Q = air quality (IAQ 0 - 500, -q) or burn-in
+ * 
+ * Markup: 
+ *  \l = local time
+ *  \e = epoch time in seconds (ms resolution)
+ *  \t = tab
+ *  \s = space
+ *  \, = comma
+ *  \; = semicolon
+ *  \\x = character x is included (x can be any)
+ *  \n = new line
+ * 
+ * Presets : csv, tsv or json (json lines) with time (epoch), sensor,
+ * temperature, humidity, pressure, gas resistance (Ohm), gas index
+ *****************************************************************/
+void format_compile(struct measure *mm)
+{
+    struct timespec ts;
+    char    *p;
+    bool    ok = true;
+    int     i, maxlen;
+    
+    memset(&Fmt, 0x0, sizeof(Fmt));
+    
+    /* epoch (ms) of library time 0 */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    Fmt.epoch = (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - MyBme[0].getMillis();
+    
+    /* use default output if no specific format was requested */
+    if (strlen(mm->format) == 0 )
+    {
+        if (NumSensors > 1)
+        {
+            fmt_value(F_SENSOR, "Sensor ");
+            fmt_text(": ", 2);
+        }
+        
+        fmt_value(F_TEMP, "Temp: ");
+        fmt_value(F_HUM, "\tHumidity: ");
+        fmt_value(F_PRES, "\tpressure: ");
+        fmt_value(F_RES_K, "\t gas resistance ");
+        fmt_text(" Kohm", 5);
+        fmt_value(F_SWEEP, NULL);
+        
+        if (strlen(mm->iaq_file) > 0) fmt_value(F_IAQ, "\tIAQ ");
+    }
+    else if (strcmp(mm->format, "csv") == 0) fmt_preset(',');
+    else if (strcmp(mm->format, "tsv") == 0) fmt_preset('\t');
+    else if (strcmp(mm->format, "json") == 0) fmt_preset(0x0);
+    else
+    {
+        for (p = mm->format; *p != 0x0 && ok; p++)
+        {
+            // BME results
+            if (*p == 'T')      ok = fmt_value(F_TEMP, " Temp: ");
+            else if (*p == 'H') ok = fmt_value(F_HUM, " Humidity: ");
+            else if (*p == 'P') ok = fmt_value(F_PRES, " Pressure: ");
+            else if (*p == 'M') ok = fmt_value(F_HEIGHT, " Height: ");
+            else if (*p == 'R') ok = fmt_value(F_RES_K, " Resistance: ");
+            else if (*p == 'D') ok = fmt_value(F_DEW, " Dewpoint: ");
+            else if (*p == 'N') ok = fmt_value(F_SENSOR, " Sensor: ");
+            else if (*p == 'G') ok = fmt_value(F_GAS, " Gas_index: ");
+            else if (*p == 'Q') ok = fmt_value(F_IAQ, " IAQ: ");
+            
+            // markup
+            else if (*p == '\\')
+            {
+                p++;
+                
+                if (*p == 't') ok = fmt_text("\t", 1);
+                else if (*p == 's') ok = fmt_text(" ", 1);
+                else if (*p == 'n') ok = fmt_text("\n", 1);
+                else if (*p == ',') ok = fmt_text(",", 1);
+                else if (*p == ';') ok = fmt_text(";", 1);
+                else if (*p == 'l') ok = fmt_value(F_LOCAL, NULL);
+                else if (*p == 'e') ok = fmt_value(F_EPOCH, NULL);
+                else if (*p == '\\' && *(p + 1) != 0x0)
+                {
+                    p++;
+                    ok = fmt_text(p, 1);
+                }
+                else if (*p == 0x0) break;
+            }
+            
+            // trouble ...
+            else
+            {
+                p_printf(RED, (char *) "Illegal character %c in output format string: %s\n", *p, mm->format);
+                closeout(EXIT_FAILURE);
+            }
+        }
+    }
+    
+    /* worst case line length */
+    for (i = 0, maxlen = Fmt.textlen + 2; i < Fmt.ops; i++)
+    {
+        if (Fmt.op[i].kind != F_TEXT) maxlen += FMTVALMAX;
+    }
+    
+    if (! ok || ! fmt_text("\n", 1) || maxlen > OUTBUF)
+    {
+        p_printf(RED, (char *) "Output format string too long: %s\n", mm->format);
+        closeout(EXIT_FAILURE);
+    }
+}
+
+/*****************************************************************
+ * @brief : write unsigned value
+ * @param p : write position
+ * @param v : value
+ * 
+ * @return : new write position
+ *****************************************************************/
+static inline char *put_uint(char *p, uint64_t v)
+{
+    char    tmp[20];
+    int     i = 0;
+    
+    do
+    {
+        tmp[i++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    
+    while (i > 0) *p++ = tmp[--i];
+    
+    return(p);
+}
+
+/*****************************************************************
+ * @brief : write signed value
+ * @param p : write position
+ * @param v : value
+ * 
+ * @return : new write position
+ *****************************************************************/
+static inline char *put_int(char *p, int64_t v)
+{
+    if (v < 0)
+    {
+        *p++ = '-';
+        return(put_uint(p, (uint64_t) -v));
+    }
+    
+    return(put_uint(p, (uint64_t) v));
+}
+
+/*****************************************************************
+ * @brief : write value with fixed decimals (rounded)
+ * @param p : write position
+ * @param v : value
+ * @param dec : number of decimals (0 - 3)
+ * 
+ * @return : new write position
+ *****************************************************************/
+static inline char *put_fixed(char *p, double v, int dec)
+{
+    static const uint32_t scale[4] = { 1, 10, 100, 1000 };
+    uint64_t n;
+    uint32_t frac;
+    double  x;
+    int     i;
+    
+    if (isnan(v))
+    {
+        memcpy(p, "nan", 3);
+        return(p + 3);
+    }
+    
+    /* out of range for the fast path (incl. inf) */
+    if (! (fabs(v) < 1e12)) return(p + sprintf(p, "%.*f", dec, v));
+    
+    x = fabs(v) * scale[dec];
+    n = (uint64_t) x;
+    x -= n;
+    
+    /* near a tie the scaled value is not exact : let printf() decide */
+    if (fabs(x - 0.5) < 1e-6) return(p + sprintf(p, "%.*f", dec, v));
+    
+    if (x > 0.5) n++;
+    
+    /* printf() keeps the sign of a value rounded to 0 (-0.00) */
+    if (signbit(v)) *p++ = '-';
+    
+    p = put_uint(p, n / scale[dec]);
+    
+    if (dec > 0)
+    {
+        *p++ = '.';
+        frac = n % scale[dec];
+        
+        for (i = dec; i > 0; i--)
+        {
+            p[i - 1] = '0' + frac % 10;
+            frac /= 10;
+        }
+        
+        p += dec;
+    }
+    
+    return(p);
+}
+
+/*****************************************************************
+ * @brief : format output buffer with the compiled format
+ * @param mm ; measurement variables
+ * @param buf ; formatted data to output (OUTBUF)
+ * 
+ * @return : length of the output
+ *****************************************************************/
+int format_output(struct measure *mm, char *buf)
+{
+    struct bmeval *b = &mm->bme;
+    char    *p = buf;
+    time_t  ltime;
+    int64_t t;
+    int     i;
+    
+    for (i = 0; i < Fmt.ops; i++)
+    {
+        switch(Fmt.op[i].kind)
+        {
+            case F_TEXT:
+                memcpy(p, Fmt.text + Fmt.op[i].text, Fmt.op[i].len);
+                p += Fmt.op[i].len;
+                break;
+            
+            case F_TEMP:    p = put_fixed(p, b->tempC, 2); break;
+            case F_HUM:     p = put_fixed(p, b->humid, 2); break;
+            case F_PRES:    p = put_fixed(p, b->pressure / 100, 2); break;
+            case F_HEIGHT:  p = put_fixed(p, b->height, 2); break;
+            case F_DEW:     p = put_fixed(p, b->dewpoint, 2); break;
+            case F_RES:     p = put_uint(p, b->gas_resistance); break;
+            case F_RES_K:   p = put_uint(p, b->gas_resistance / 1000); break;
+            case F_SENSOR:  p = put_uint(p, b->sensor); break;
+            case F_GASIDX:  p = put_uint(p, b->gas_index); break;
+            
+            case F_IAQ:
+                if (isnan(b->iaq)) p = stpcpy(p, "burn-in");
+                else p = put_uint(p, (uint32_t) lround(b->iaq));
+                break;
+            
+            case F_SWEEP:   // only with heater sweep
+                if (b->sweepSteps == 0 || b->gas_index >= b->sweepSteps) break;
+                memcpy(p, "\t gas index ", 12);
+                p += 12;
+                // fall through
+            
+            case F_GAS:
+                p = put_uint(p, b->gas_index);
+                *p++ = ' ';
+                *p++ = '(';
+                
+                if (b->sweepSteps > 0 && b->gas_index < b->sweepSteps)
+                    p = put_uint(p, b->sweepTemp[b->gas_index]);
+                else
+                    p = put_uint(p, b->heaterT);
+                
+                memcpy(p, " C)", 3);
+                p += 3;
+                break;
+            
+            case F_LOCAL:   // formatted once per second
+                ltime = time(NULL);
+                
+                if (ltime != Fmt.local_sec)
+                {
+                    time_stamp(Fmt.local);
+                    Fmt.local_sec = ltime;
+                }
+                
+                p = stpcpy(p, Fmt.local);
+                break;
+            
+            case F_EPOCH:
+                t = Fmt.epoch + (int64_t) b->time;
+                p = put_int(p, t / 1000);
+                *p++ = '.';
+                *p++ = '0' + (t % 1000) / 100;
+                *p++ = '0' + (t % 100) / 10;
+                *p++ = '0' + t % 10;
+                break;
+        }
+    }
+    
+    *p = 0x0;
+    
+    return(p - buf);
+}
+
+/*********************************************************************
+ * @brief : open the save file
+ * @param mm ; measurement variables
+ * 
+ * The file is kept open and written through a buffer of mm->log_buf kB
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool log_open(struct measure *mm)
+{
+    time_t ltime = time(NULL);
+    
+    Log.fp = fopen(mm->v_save_file, "a");
+    
+    if (Log.fp == NULL)
+    { 
+        p_printf(RED,(char *) "Issue with opening output file: %s\n", mm->v_save_file);
+        return(false);
+    }
+    
+    if (Log.buf == NULL) Log.buf = (char *) malloc(mm->log_buf * 1024);
+    
+    if (Log.buf != NULL) setvbuf(Log.fp, Log.buf, _IOFBF, mm->log_buf * 1024);
+    
+    /* append to existing file */
+    fseek(Log.fp, 0, SEEK_END);
+    Log.size = ftell(Log.fp);
+    Log.yday = localtime(&ltime)->tm_yday;
+    Log.rows = 0;
+    Log.last_flush = mono_time();
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : close the current save file and continue in a new file
+ * @param mm ; measurement variables
+ * 
+ * The current file is renamed to <file>.<date>-<time>
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool log_rotate(struct measure *mm)
+{
+    char name[MAXBUF + 20];
+    time_t ltime = time(NULL);
+    
+    if (mm->verbose) printf("Rotate output file %s\n", mm->v_save_file);
+    
+    if (fclose(Log.fp) != 0)
+        p_printf(RED,(char *) "Issue during writing output file: %s\n", mm->v_save_file);
+    
+    Log.fp = NULL;
+    
+    snprintf(name, sizeof(name), "%s.", mm->v_save_file);
+    strftime(name + strlen(name), 20, "%Y%m%d-%H%M%S", localtime(&ltime));
+    
+    if (rename(mm->v_save_file, name) != 0)
+        p_printf(RED,(char *) "Issue with renaming output file to: %s\n", name);
+    
+    return(log_open(mm));
+}
+
+/*********************************************************************
+ * @brief : write buffered output to the save file
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool log_flush(struct measure *mm)
+{
+    if (Log.fp == NULL) return(true); 
+    
+    if(mm->verbose > 1) printf("Flush %d rows to file %s\n", Log.rows, mm->v_save_file);
+    
+    Log.rows = 0;
+    Log.last_flush = mono_time();
+    
+    if (fflush(Log.fp) != 0)
+    {
+        p_printf(RED,(char *) "Issue during writing output file: %s\n", mm->v_save_file);
+        return(false);
+    }
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : write pending output and close the save file
+ *********************************************************************/
+void log_close()
+{
+    if (Log.fp != NULL)
+    {
+        if (fclose(Log.fp) != 0)
+            p_printf(RED,(char *) "Issue during writing output file\n");
+        
+        Log.fp = NULL;
+    }
+    
+    if (Log.buf != NULL)
+    {
+        free(Log.buf);
+        Log.buf = NULL;
+    }
+}
+
+/*********************************************************************
+ * @brief : add output to the save file
+ * @param mm ; measurement variables
+ * @param buf ; formatted data
+ * 
+ * The row is buffered. The buffer is written after mm->log_rows rows,
+ * mm->log_secs seconds or when the buffer is full.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool log_write(struct measure *mm, char *buf, size_t len)
+{
+    time_t ltime;
+    
+    if (Log.fp == NULL)
+    {
+        if (log_open(mm) == false) return(false);
+    }
+    
+    /* rotate on size or date */
+    else if (mm->log_rotate > 0 && Log.size + (long) len > (long) mm->log_rotate * 1024)
+    {
+        if (log_rotate(mm) == false) return(false);
+    }
+    else if (mm->log_daily)
+    {
+        ltime = time(NULL);
+        
+        if (localtime(&ltime)->tm_yday != Log.yday)
+        {
+            if (log_rotate(mm) == false) return(false);
+        }
+    }
+    
+    // write ouput
+    if (fwrite(buf, sizeof(char), len, Log.fp) != len)
+    { 
+        p_printf(RED,(char *) "Issue during writing output file: %s\n", mm->v_save_file);
+        return(false);
+    }
+    
+    Log.size += len;
+    Log.rows++;
+    
+    if (Log.rows >= mm->log_rows || mono_time() - Log.last_flush >= mm->log_secs)
+        return(log_flush(mm));
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : open the binary capture file and write the headers
+ * @param mm ; measurement variables
+ * 
+ * The headers hold the calibration and settings of each sensor, so the
+ * raw values can be compensated later with bme680dec.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool bin_open(struct measure *mm)
+{
+    struct bmeBinHeader hdr;
+    struct bmeBinSensor sens;
+    struct timespec ts;
+    bool ok;
+    int n;
+    
+    if (NumSensors > UINT8_MAX)
+    {
+        p_printf(RED,(char *) "Capture file holds max %d sensors\n", UINT8_MAX);
+        return(false);
+    }
+    
+    Bin.fp = fopen(mm->bin_file, "wb");
+    
+    if (Bin.fp == NULL)
+    { 
+        p_printf(RED,(char *) "Issue with opening capture file: %s\n", mm->bin_file);
+        return(false);
+    }
+    
+    Bin.buf = (char *) malloc(BINBUFSIZE * 1024);
+    
+    if (Bin.buf != NULL) setvbuf(Bin.fp, Bin.buf, _IOFBF, BINBUFSIZE * 1024);
+    
+    /* epoch of library time 0 */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    Bin.start = (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - MyBme[0].getMillis();
+    
+    memset(&hdr, 0x0, sizeof(hdr));
+    memcpy(hdr.magic, BME680_BIN_MAGIC, sizeof(hdr.magic));
+    hdr.version = BME680_BIN_VERSION;
+    hdr.calib_size = sizeof(struct bme680_calib_data);
+    hdr.rec_size = sizeof(struct bmeBinRecord);
+    hdr.sensors = NumSensors;
+    hdr.start = Bin.start;
+    
+    ok = fwrite(&hdr, sizeof(hdr), 1, Bin.fp) == 1;
+    
+    for (n = 0; n < NumSensors && ok; n++)
+    {
+        memset(&sens, 0x0, sizeof(sens));
+        MyBme[n].getCalibration(&sens.chip_id, &sens.calib);
+        sens.i2c_address = n == 0 ? mm->i2c.I2C_Address : mm->extra[n - 1].I2C_Address;
+        sens.os_temp = getOversample(mm->bme.overSampleT);
+        sens.os_pres = getOversample(mm->bme.overSampleP);
+        sens.os_hum = getOversample(mm->bme.overSampleH);
+        sens.filter = getfilter(mm->bme.filter);
+        sens.heatr_temp = mm->bme.heaterM > 0 ? mm->bme.heaterT : 0;
+        sens.heatr_dur = mm->bme.heaterM;
+        
+        ok = fwrite(&sens, sizeof(sens), 1, Bin.fp) == 1;
+    }
+    
+    if (! ok) p_printf(RED,(char *) "Issue during writing capture file: %s\n", mm->bin_file);
+    
+    return(ok);
+}
+
+/*********************************************************************
+ * @brief : write a record with the raw values to the capture file
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool bin_write(struct measure *mm)
+{
+    struct bmeBinRecord rec;
+    
+    rec.time = (uint32_t) mm->bme.time;
+    rec.adc_temp = mm->bme.raw.adc_temp;
+    rec.adc_pres = mm->bme.raw.adc_pres;
+    rec.adc_hum = mm->bme.raw.adc_hum;
+    rec.adc_gas_res = mm->bme.raw.adc_gas_res;
+    rec.gas_range = mm->bme.raw.gas_range;
+    rec.status = mm->bme.raw.status;
+    rec.gas_index = mm->bme.raw.gas_index;
+    rec.sensor = mm->bme.sensor;
+    
+    if (fwrite(&rec, sizeof(rec), 1, Bin.fp) != 1)
+    {
+        p_printf(RED,(char *) "Issue during writing capture file: %s\n", mm->bin_file);
+        return(false);
+    }
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : write pending records and close the capture file
+ *********************************************************************/
+void bin_close()
+{
+    if (Bin.fp != NULL)
+    {
+        if (fclose(Bin.fp) != 0)
+            p_printf(RED,(char *) "Issue during writing capture file\n");
+        
+        Bin.fp = NULL;
+    }
+    
+    if (Bin.buf != NULL)
+    {
+        free(Bin.buf);
+        Bin.buf = NULL;
+    }
+}
+
+/*********************************************************************
+ * @brief : get the writer of an existing shared-memory segment
+ * @param name ; name of the segment
+ * 
+ * @return : pid of the writer if it is still running, else 0
+ *********************************************************************/
+pid_t shm_owner(const char *name)
+{
+    struct bmeShmSegment *seg;
+    struct stat st;
+    pid_t pid = 0;
+    int fd;
+    
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) return(0);
+    
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(struct bmeShmSegment))
+    {
+        close(fd);
+        return(0);
+    }
+    
+    seg = (struct bmeShmSegment *) mmap(NULL, sizeof(struct bmeShmSegment), 
+        PROT_READ, MAP_SHARED, fd, 0);
+    
+    close(fd);
+    
+    if (seg == MAP_FAILED) return(0);
+    
+    // EPERM : running under another user
+    if (memcmp(seg->magic, BME680_SHM_MAGIC, sizeof(seg->magic)) == 0 && seg->pid > 0 &&
+        (kill(seg->pid, 0) == 0 || errno == EPERM))
+        pid = seg->pid;
+    
+    munmap(seg, sizeof(struct bmeShmSegment));
+    
+    return(pid);
+}
+
+/*********************************************************************
+ * @brief : create the shared-memory segment for the samples
+ * @param mm ; measurement variables
+ * 
+ * The segment is created with mode 0644, any local user can read the
+ * samples with bme_shm_open() (bme680_shm.h) or bme680rd.
+ * 
+ * A segment left by a stopped monitor is replaced, a segment of a
+ * running monitor is never touched.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool shm_start(struct measure *mm)
+{
+    struct bmeShmSegment *seg;
+    pid_t pid;
+    int fd;
+    
+    if (NumSensors > BME680_SHM_SENSORS)
+    {
+        p_printf(RED,(char *) "Shared memory holds max %d sensors\n", BME680_SHM_SENSORS);
+        return(false);
+    }
+    
+    fd = shm_open(mm->shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    
+    if (fd < 0 && errno == EEXIST)
+    {
+        pid = shm_owner(mm->shm_name);
+        
+        if (pid != 0)
+        {
+            p_printf(RED,(char *) "Shared memory %s is in use by process %d\n", mm->shm_name, (int) pid);
+            return(false);
+        }
+        
+        // stale segment
+        shm_unlink(mm->shm_name);
+        fd = shm_open(mm->shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+    
+    if (fd < 0)
+    { 
+        p_printf(RED,(char *) "Issue with creating shared memory %s : %s\n", mm->shm_name, strerror(errno));
+        return(false);
+    }
+    
+    if (ftruncate(fd, sizeof(struct bmeShmSegment)) != 0)
+    {
+        p_printf(RED,(char *) "Issue with sizing shared memory %s\n", mm->shm_name);
+        close(fd);
+        shm_unlink(mm->shm_name);
+        return(false);
+    }
+    
+    seg = (struct bmeShmSegment *) mmap(NULL, sizeof(struct bmeShmSegment), 
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    
+    close(fd);
+    
+    if (seg == MAP_FAILED)
+    {
+        p_printf(RED,(char *) "Issue with mapping shared memory %s\n", mm->shm_name);
+        shm_unlink(mm->shm_name);
+        return(false);
+    }
+    
+    /* readers check the magic : set it last */
+    memset(seg, 0x0, sizeof(struct bmeShmSegment));
+    seg->version = BME680_SHM_VERSION;
+    seg->sample_size = sizeof(struct bmeShmSample);
+    seg->history = BME680_SHM_HISTORY;
+    seg->sensors = NumSensors;
+    seg->pid = getpid();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(seg->magic, BME680_SHM_MAGIC, sizeof(seg->magic));
+    
+    Shm.seg = seg;
+    strncpy(Shm.name, mm->shm_name, MAXBUF);
+    
+    if (mm->verbose) printf("publish samples in shared memory %s\n", mm->shm_name);
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : the measured values as a sample for shared memory or export
+ * @param mm ; measurement variables
+ * @param s ; store sample
+ *********************************************************************/
+void sample_fill(struct measure *mm, struct bmeShmSample *s)
+{
+    s->time = Fmt.epoch + (int64_t) mm->bme.time;
+    s->temperature = mm->bme.tempC;
+    s->humidity = mm->bme.humid;
+    s->pressure = mm->bme.pressure;
+    s->altitude = mm->bme.height;
+    s->dewpoint = mm->bme.dewpoint;
+    s->gas_resistance = mm->bme.gas_resistance;
+    s->sensor = mm->bme.sensor;
+    s->gas_index = mm->bme.gas_index;
+    s->status = mm->bme.raw.status;
+    s->reserved = 0;
+}
+
+/*********************************************************************
+ * @brief : publish the measured values in the shared-memory segment
+ * @param mm ; measurement variables
+ *********************************************************************/
+void shm_write(struct measure *mm)
+{
+    struct bmeShmSample s;
+    
+    sample_fill(mm, &s);
+    bme_shm_publish(Shm.seg, &s);
+}
+
+/*********************************************************************
+ * @brief : remove the shared-memory segment
+ *********************************************************************/
+void shm_stop()
+{
+    if (Shm.seg == NULL) return;
+    
+    munmap(Shm.seg, sizeof(struct bmeShmSegment));
+    shm_unlink(Shm.name);
+    Shm.seg = NULL;
+}
+
+/*********************************************************************
+ * @brief : encode a sample in InfluxDB line protocol
+ * @param buf ; store the line
+ * @param size ; space in buf
+ * @param s ; sample
+ * 
+ * @return : length of the line, 0 if it does not fit
+ *********************************************************************/
+int udp_line(char *buf, int size, const struct bmeShmSample *s)
+{
+    int len;
+    
+    len = snprintf(buf, size, "bme680,sensor=%d temperature=%.2f,humidity=%.3f,pressure=%.0f,"
+        "dewpoint=%.2f,gas=%ui,gas_index=%ui %lld\n", s->sensor, s->temperature, s->humidity,
+        s->pressure, s->dewpoint, s->gas_resistance, s->gas_index, (long long) s->time * 1000000);
+    
+    if (len < 0 || len >= size) return(0);
+    
+    return(len);
+}
+
+/*********************************************************************
+ * @brief : send the pending datagram of the exporter thread
+ * @param buf ; datagram
+ * @param len ; length of the datagram
+ * @param cnt ; samples in the datagram
+ *********************************************************************/
+void udp_send(char *buf, int len, int cnt)
+{
+    struct bmeUdpHeader *hdr = (struct bmeUdpHeader *) buf;
+    
+    if (Udp.binary)
+    {
+        hdr->count = (uint8_t) cnt;
+        hdr->seq = Udp.datagrams;
+        hdr->drops = __atomic_load_n(&Udp.q.drops, __ATOMIC_RELAXED);
+    }
+    
+    if (sendto(Udp.sock, buf, len, 0, (struct sockaddr *) &Udp.addr, Udp.addrlen) == len)
+    {
+        __atomic_store_n(&Udp.samples, Udp.samples + cnt, __ATOMIC_RELAXED);
+        __atomic_store_n(&Udp.datagrams, Udp.datagrams + 1, __ATOMIC_RELAXED);
+    }
+    else
+        __atomic_store_n(&Udp.errors, Udp.errors + 1, __ATOMIC_RELAXED);
+}
+
+/*********************************************************************
+ * @brief : exporter thread : take samples from the queue, batch them
+ * in datagrams and send
+ * 
+ * A datagram is sent when it holds the batch samples, is full, or the
+ * oldest sample in it waited the batch time. A blocked send only
+ * delays this thread, the sampling loop drops samples if the queue 
+ * is full.
+ *********************************************************************/
+void *udp_thread(void *arg)
+{
+    char buf[BME680_UDP_MAX];
+    struct bmeUdpHeader *hdr = (struct bmeUdpHeader *) buf;
+    struct bmeShmSample s;
+    double first = 0;
+    int len = 0, cnt = 0, l;
+    bool got, stop;
+    
+    while (1)
+    {
+        stop = __atomic_load_n(&Udp.stop, __ATOMIC_ACQUIRE);
+        got = bme_spsc_pop(&Udp.q, &s);
+        
+        if (got)
+        {
+            /* start a new datagram */
+            if (cnt == 0)
+            {
+                first = mono_time();
+                len = 0;
+                
+                if (Udp.binary)
+                {
+                    memcpy(hdr->magic, BME680_UDP_MAGIC, sizeof(hdr->magic));
+                    hdr->version = BME680_UDP_VERSION;
+                    hdr->sample_size = sizeof(struct bmeShmSample);
+                    len = sizeof(struct bmeUdpHeader);
+                }
+            }
+            
+            if (Udp.binary)
+            {
+                memcpy(buf + len, &s, sizeof(s));
+                len += sizeof(s);
+                cnt++;
+                
+                if (cnt == (int) BME680_UDP_SAMPLES) 
+                {
+                    udp_send(buf, len, cnt);
+                    cnt = 0;
+                }
+            }
+            else
+            {
+                /* line does not fit : send and start with this line */
+                if ((l = udp_line(buf + len, sizeof(buf) - len, &s)) == 0)
+                {
+                    udp_send(buf, len, cnt);
+                    first = mono_time();
+                    len = cnt = 0;
+                    l = udp_line(buf, sizeof(buf), &s);
+                }
+                
+                len += l;
+                cnt++;
+            }
+        }
+        
+        if (cnt > 0 && (cnt >= Udp.batch || mono_time() - first >= Udp.ms / 1000.0 || (stop && ! got)))
+        {
+            udp_send(buf, len, cnt);
+            cnt = 0;
+        }
+        
+        if (! got)
+        {
+            if (stop) break;
+            usleep(UDPIDLE * 1000);
+        }
+    }
+    
+    return(NULL);
+}
+
+/*********************************************************************
+ * @brief : start the UDP exporter
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool udp_start(struct measure *mm)
+{
+    struct addrinfo hints, *res;
+    char host[MAXBUF], *port;
+    int ret;
+    
+    /* sensor is 8 bits in a sample */
+    if (NumSensors > UINT8_MAX + 1)
+    {
+        p_printf(RED,(char *) "UDP exporter holds max %d sensors\n", UINT8_MAX + 1);
+        return(false);
+    }
+    
+    /* host:port, IPv6 address as [addr]:port */
+    strncpy(host, mm->udp_dest, MAXBUF - 1);
+    host[MAXBUF - 1] = 0x0;
+    port = strrchr(host, ':');
+    
+    if (port == NULL)
+    {
+        p_printf(RED,(char *) "Invalid UDP destination %s (host:port)\n", mm->udp_dest);
+        return(false);
+    }
+    
+    *port++ = 0x0;
+    
+    if (host[0] == '[' && host[strlen(host) - 1] == ']')
+    {
+        host[strlen(host) - 1] = 0x0;
+        memmove(host, host + 1, strlen(host));
+    }
+    
+    memset(&hints, 0x0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    
+    if ((ret = getaddrinfo(host, port, &hints, &res)) != 0)
+    {
+        p_printf(RED,(char *) "Can not resolve UDP destination %s : %s\n", mm->udp_dest, gai_strerror(ret));
+        return(false);
+    }
+    
+    Udp.sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    memcpy(&Udp.addr, res->ai_addr, res->ai_addrlen);
+    Udp.addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+    
+    if (Udp.sock < 0)
+    {
+        p_printf(RED,(char *) "Can not create UDP socket : %s\n", strerror(errno));
+        return(false);
+    }
+    
+    if (bme_spsc_init(&Udp.q, UDPQUEUE) == false)
+    {
+        p_printf(RED,(char *) "Can not allocate exporter queue\n");
+        close(Udp.sock);
+        return(false);
+    }
+    
+    Udp.binary = mm->udp_binary;
+    Udp.batch = mm->udp_batch;
+    Udp.ms = mm->udp_ms;
+    Udp.stop = 0;
+    
+    if (thread_start(&Udp.thread, udp_thread) == false)
+    {
+        p_printf(RED,(char *) "Can not start exporter thread\n");
+        bme_spsc_free(&Udp.q);
+        close(Udp.sock);
+        return(false);
+    }
+    
+    Udp.running = true;
+    
+    if (mm->verbose) printf("export samples to UDP %s (%s, batch %d samples / %u ms)\n", 
+        mm->udp_dest, Udp.binary ? "binary" : "line protocol", Udp.batch, Udp.ms);
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : hand the measured values to the exporter thread
+ * @param mm ; measurement variables
+ *********************************************************************/
+void udp_write(struct measure *mm)
+{
+    struct bmeShmSample s;
+    
+    sample_fill(mm, &s);
+    
+    /* full : dropped and counted, never wait */
+    bme_spsc_push(&Udp.q, &s);
+}
+
+/*********************************************************************
+ * @brief : display the exporter counters on stderr
+ *********************************************************************/
+void udp_report()
+{
+    if (! Udp.running) return;
+    
+    fprintf(stderr, "exporter : queue depth %u (max %u of %d), dropped %u, %u datagrams, "
+        "%u samples, %u send errors\n", bme_spsc_depth(&Udp.q), Udp.q.max_depth, UDPQUEUE,
+        Udp.q.drops, __atomic_load_n(&Udp.datagrams, __ATOMIC_RELAXED), 
+        __atomic_load_n(&Udp.samples, __ATOMIC_RELAXED), __atomic_load_n(&Udp.errors, __ATOMIC_RELAXED));
+}
+
+/*********************************************************************
+ * @brief : send the queued samples and stop the exporter
+ *********************************************************************/
+void udp_stop()
+{
+    if (! Udp.running) return;
+    
+    __atomic_store_n(&Udp.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(Udp.thread, NULL);
+    
+    udp_report();
+    
+    Udp.running = false;
+    bme_spsc_free(&Udp.q);
+    close(Udp.sock);
+}
+
+/*********************************************************************
+ * @brief : add a value to running statistics (Welford)
+ * @param a ; statistics
+ * @param x ; value
+ *********************************************************************/
+void agg_value(struct aggstat *a, double x)
+{
+    double d = x - a->mean;
+    
+    if (a->n == 0 || x < a->min) a->min = x;
+    if (a->n == 0 || x > a->max) a->max = x;
+    
+    a->n++;
+    a->mean += d / a->n;
+    a->m2 += d * (x - a->mean);
+}
+
+/*********************************************************************
+ * @brief : format running statistics : min,mean,max,stddev
+ * @param p ; store text
+ * @param size ; space in p
+ * @param a ; statistics
+ * @param fmt ; printf format of a value, e.g. "%.2f"
+ * 
+ * @return : length of the text
+ *********************************************************************/
+int agg_text(char *p, int size, const struct aggstat *a, const char *fmt)
+{
+    char    f[50];
+    double  sd = a->n > 1 ? sqrt(a->m2 / (a->n - 1)) : 0;
+    
+    if (a->n == 0) return(snprintf(p, size, ",,,,"));
+    
+    snprintf(f, sizeof(f), ",%s,%s,%s,%s", fmt, fmt, fmt, fmt);
+    
+    return(snprintf(p, size, f, a->min, a->mean, a->max, sd));
+}
+
+/*********************************************************************
+ * @brief : output the statistics of a window of a sensor and reset
+ * @param mm ; measurement variables
+ * @param w ; window
+ * @param n ; sensor
+ * 
+ * line : window start (epoch seconds), window (s), sensor, samples,
+ * min,mean,max,stddev of temperature (C), humidity (%), pressure (Pa)
+ * and gas resistance (Ohm), heater unstable samples
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool agg_emit(struct measure *mm, struct aggwin *w, int n)
+{
+    char    buf[OUTBUF];
+    int     len;
+    bool    ok = true;
+    
+    len = snprintf(buf, sizeof(buf), "%lld.%03d,%u,%d,%u", (long long) (w->start[n] / 1000),
+        (int) (w->start[n] % 1000), w->secs, n, w->count[n]);
+    len += agg_text(buf + len, sizeof(buf) - len, &w->st[n][A_TEMP], "%.2f");
+    len += agg_text(buf + len, sizeof(buf) - len, &w->st[n][A_HUM], "%.3f");
+    len += agg_text(buf + len, sizeof(buf) - len, &w->st[n][A_PRES], "%.0f");
+    len += agg_text(buf + len, sizeof(buf) - len, &w->st[n][A_GAS], "%.0f");
+    len += snprintf(buf + len, sizeof(buf) - len, ",%u\n", w->unstable[n]);
+    
+    if (w->fp != NULL)
+    {
+        if (fputs(buf, w->fp) < 0 || fflush(w->fp) != 0)
+        {
+            p_printf(RED,(char *) "Issue during writing aggregation file %s\n", w->file);
+            ok = false;
+        }
+    }
+    else
+        ok = write_output(mm, buf, len);
+    
+    memset(w->st[n], 0x0, sizeof(w->st[n]));
+    w->count[n] = w->unstable[n] = 0;
+    w->start[n] = 0;
+    
+    return(ok);
+}
+
+/*********************************************************************
+ * @brief : add the measured values to each aggregation window
+ * @param mm ; measurement variables
+ * 
+ * Windows are aligned to the epoch (e.g. a 60 s window starts on the
+ * minute). A window is output with the first sample of the next one. 
+ * No samples are kept, only running statistics.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool agg_add(struct measure *mm)
+{
+    struct aggwin *w;
+    int64_t t = Fmt.epoch + (int64_t) mm->bme.time, start;
+    int     i, n = mm->bme.sensor;
+    bool    ok = true;
+    
+    for (i = 0; i < Agg.windows; i++)
+    {
+        w = &Agg.win[i];
+        start = t - t % ((int64_t) w->secs * 1000);
+        
+        if (w->count[n] > 0 && start != w->start[n]) ok = agg_emit(mm, w, n) && ok;
+        
+        w->start[n] = start;
+        w->count[n]++;
+        
+        agg_value(&w->st[n][A_TEMP], mm->bme.tempC);
+        agg_value(&w->st[n][A_HUM], mm->bme.humid);
+        agg_value(&w->st[n][A_PRES], mm->bme.pressure);
+        
+        if (mm->bme.heaterM == 0) continue;
+        
+        if (mm->bme.raw.status & BME680_HEAT_STAB_MSK) 
+            agg_value(&w->st[n][A_GAS], mm->bme.gas_resistance);
+        else
+            w->unstable[n]++;
+    }
+    
+    return(ok);
+}
+
+/*********************************************************************
+ * @brief : open the aggregation window sinks
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool agg_start(struct measure *mm)
+{
+    int i;
+    
+    for (i = 0; i < Agg.windows; i++)
+    {
+        if (Agg.win[i].file[0] == 0x0) continue;
+        
+        Agg.win[i].fp = fopen(Agg.win[i].file, "a");
+        
+        if (Agg.win[i].fp == NULL)
+        {
+            p_printf(RED,(char *) "Issue with opening aggregation file: %s\n", Agg.win[i].file);
+            return(false);
+        }
+    }
+    
+    Agg.mm = mm;
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : output the incomplete windows and close the sinks
+ *********************************************************************/
+void agg_close()
+{
+    int i, n;
+    
+    for (i = 0; i < Agg.windows; i++)
+    {
+        for (n = 0; n < NumSensors && Agg.mm != NULL; n++)
+        {
+            if (Agg.win[i].count[n] > 0) agg_emit(Agg.mm, &Agg.win[i], n);
+        }
+        
+        if (Agg.win[i].fp != NULL) fclose(Agg.win[i].fp);
+        Agg.win[i].fp = NULL;
+    }
+    
+    Agg.windows = 0;
+}
+
+/*********************************************************************
+ * @brief : output the measured values, or hand them to the writer thread
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool do_output_values(struct measure *mm)
+{
+    if (Writer.running) return(writer_push(mm));
+    
+    return(output_values(mm));
+}
+
+/*********************************************************************
+ * @brief : output the measured values to all sinks
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool output_values(struct measure *mm)
+{
+    char    buf[OUTBUF];
+    
+    /* daemon mode : latest samples in shared memory */
+    if (Shm.seg != NULL) shm_write(mm);
+    
+    /* UDP exporter */
+    if (Udp.running) udp_write(mm);
+
+    /* raw capture : no text output */
+    if (Bin.fp != NULL) return(bin_write(mm));
+    
+    /* aggregation : a line per window instead of per sample */
+    if (Agg.windows > 0) return(agg_add(mm));
+    
+    if (mm->verbose) printf("output BME680 values\n");  
+    
+    /* create output string and output */
+    return(write_output(mm, buf, format_output(mm, buf)));
+}
+
+/*********************************************************************
+ * @brief : output a formatted line
+ * @param mm ; measurement variables
+ * @param buf ; formatted line
+ * @param len ; length of the line
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool write_output(struct measure *mm, char *buf, int len)
+{
+    /* display output (not in daemon mode) */
+    if (Shm.seg == NULL) p_printf(YELLOW,(char *) "%s",buf);
+     
+    /* append output to a save_file (if requested) */
+    if (mm->v_save_file[0] != 0x0) return(log_write(mm, buf, len));
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : start a thread that does not handle signals
+ * @param thread ; store thread
+ * @param func ; thread function
+ * 
+ * Signals (SIGINT, SIGTERM, SIGUSR1) are handled on the main (sampling)
+ * thread, that also performs closeout().
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool thread_start(pthread_t *thread, void *(*func)(void *))
+{
+    sigset_t all, old;
+    int ret;
+    
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    ret = pthread_create(thread, NULL, func, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    
+    return(ret == 0);
+}
+
+/*********************************************************************
+ * @brief : writer thread : format and output the values from the queue
+ * 
+ * After an output error no more output is done, the sampling loop
+ * stops at the next sample.
+ *********************************************************************/
+void *writer_thread(void *arg)
+{
+    struct measure *wm = Writer.mm;
+    struct bmeval v;
+    bool got, stop;
+    
+    while (1)
+    {
+        stop = __atomic_load_n(&Writer.stop, __ATOMIC_ACQUIRE);
+        got = bme_spsc_pop(&Writer.q, &v);
+        
+        if (got)
+        {
+            wm->bme = v;
+            
+            if (! __atomic_load_n(&Writer.error, __ATOMIC_ACQUIRE) && output_values(wm) == false)
+                __atomic_store_n(&Writer.error, 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            /* queue drained */
+            if (stop) break;
+            usleep(WRITERIDLE * 1000);
+        }
+    }
+    
+    return(NULL);
+}
+
+/*********************************************************************
+ * @brief : start the writer thread
+ * @param mm ; measurement variables
+ * 
+ * The writer thread uses a copy of the settings, only the values
+ * (mm->bme) are passed for each sample.
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool writer_start(struct measure *mm)
+{
+    Writer.mm = (struct measure *) malloc(sizeof(struct measure));
+    
+    if (Writer.mm == NULL || bme_spsc_init(&Writer.q, WRITERQUEUE) == false)
+    {
+        p_printf(RED,(char *) "Can not allocate writer queue\n");
+        return(false);
+    }
+    
+    *Writer.mm = *mm;
+    Writer.policy = mm->writer;
+    Writer.stop = Writer.error = 0;
+    Writer.blocked = 0;
+    
+    if (thread_start(&Writer.thread, writer_thread) == false)
+    {
+        p_printf(RED,(char *) "Can not start writer thread\n");
+        bme_spsc_free(&Writer.q);
+        return(false);
+    }
+    
+    Writer.running = true;
+    
+    if (mm->verbose) printf("output from writer thread (queue %d samples)\n", WRITERQUEUE);
+    
+    return(true);
+}
+
+/*********************************************************************
+ * @brief : hand the values to the writer thread
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if an output error happened
+ *********************************************************************/
+bool writer_push(struct measure *mm)
+{
+    while (bme_spsc_push(&Writer.q, &mm->bme, Writer.policy) == false)
+    {
+        /* drop policy : dropped and counted */
+        if (Writer.policy != BME680_SPSC_BLOCK) break;
+        
+        if (__atomic_load_n(&Writer.error, __ATOMIC_ACQUIRE) || StopReq) break;
+        
+        Writer.blocked++;
+        usleep(WRITERIDLE * 1000);
+    }
+    
+    return(__atomic_load_n(&Writer.error, __ATOMIC_ACQUIRE) == 0);
+}
+
+/*********************************************************************
+ * @brief : display the writer queue counters on stderr
+ *********************************************************************/
+void writer_report()
+{
+    if (! Writer.running) return;
+    
+    fprintf(stderr, "writer : queue depth %u (max %u of %d), dropped %u, sampler waited %u times\n",
+        bme_spsc_depth(&Writer.q), Writer.q.max_depth, WRITERQUEUE, 
+        __atomic_load_n(&Writer.q.drops, __ATOMIC_RELAXED), Writer.blocked);
+}
+
+/*********************************************************************
+ * @brief : output the queued values and stop the writer thread
+ *********************************************************************/
+void writer_stop()
+{
+    if (! Writer.running) return;
+    
+    __atomic_store_n(&Writer.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(Writer.thread, NULL);
+    
+    if (Writer.q.drops > 0 || Writer.blocked > 0) writer_report();
+    
+    Writer.running = false;
+    
+    bme_spsc_free(&Writer.q);
+    free(Writer.mm);
+    Writer.mm = NULL;
+}
+
+/*******************************************************************
+ * @brief : add milli-seconds to time
+ * @param ts ; time to update
+ * @param ms ; milli-seconds to add
+ *******************************************************************/
+void ts_add_ms(struct timespec *ts, uint64_t ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long) (ms % 1000) * 1000000;
+    
+    if (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+/*******************************************************************
+ * @brief : get first sample time, aligned on a wall-clock multiple
+ *          of the sample period
+ * @param mm ; measurement variables
+ * @param next ; store the first sample time (CLOCK_MONOTONIC)
+ *******************************************************************/
+void first_deadline(struct measure *mm, struct timespec *next)
+{
+    struct timespec wall;
+    uint64_t now_ms;
+    
+    clock_gettime(CLOCK_REALTIME, &wall);
+    clock_gettime(CLOCK_MONOTONIC, next);
+
+    now_ms = (uint64_t) wall.tv_sec * 1000 + wall.tv_nsec / 1000000;
+    
+    /* time till next multiple of the sample period */
+    ts_add_ms(next, mm->loop_delay - (now_ms % mm->loop_delay));
 }
+
 /*******************************************************************
  * @brief : main loop for measurement
  * @param mm ; measurement variables
+ * 
+ * The samples are taken at a fixed rate (no drift by the time to 
+ * measure and output). A deadline that has passed before the 
+ * previous sample was completed is skipped and counted.
  *******************************************************************/
 void main_loop(struct measure *mm)
 {
     uint16_t lloop;
+    struct timespec next, now;
+    int64_t late_ns;
         
     /* setup loop count */
     if (mm->loop > 0)   lloop = mm->loop;
     else lloop=1;
     
+    if (mm->loop_delay > 0) first_deadline(mm, &next);
+    
     printf((char *)"starting mainloop\n");
     
-    while (lloop > 0)
+    while (lloop > 0 && ! StopReq)
     {
-        /* read values */
-        if (read_BME680(mm) == false) closeout(EXIT_FAILURE);
+        /* wait for next sample time */
+        if (mm->loop_delay > 0)
+        {
+            if(mm->verbose) printf("wait for next sample (period %u ms)\n",mm->loop_delay);
+            
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            {
+                stats_check();
+                if (StopReq) break;
+            }
+        }
         
-        /* do output */
-        if (do_output_values(mm) == false)  closeout(EXIT_FAILURE);
-
-        /* delay */
-        if(mm->verbose) printf("wait %d seconds\n",mm->loop_delay);
-        sleep(mm->loop_delay);
+        if (StopReq) break;
+        
+        if (mm->bme.sweepSteps > 0)
+        {
+            /* read and output each heater sweep step */
+            if (sweep_BME680(mm) == false) closeout(EXIT_FAILURE);
+        }
+        else
+        {
+            /* read values and output */
+            if (read_BME680(mm) == false) closeout(EXIT_FAILURE);
+        }
+        
+        stats_check();
+        iaq_check();
         
         /* loop count */
         if(mm->loop > 0)    lloop--;
+
+        if (mm->loop_delay == 0) continue;
+        
+        /* last sample taken : later deadlines were never due */
+        if (mm->loop > 0 && lloop == 0) break;
+        
+        /* set next sample time */
+        ts_add_ms(&next, mm->loop_delay);
+        
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        
+        /* in ns : a ms difference truncates toward 0, a deadline that
+         * is still ahead by less than 1 ms would be skipped */
+        late_ns = (int64_t) (now.tv_sec - next.tv_sec) * 1000000000 + (now.tv_nsec - next.tv_nsec);
+        
+        /* skip the sample times that have passed already */
+        if (late_ns > 0)
+        {
+            uint32_t missed = late_ns / ((int64_t) mm->loop_delay * 1000000) + 1;
+            
+            if(mm->verbose) printf("missed %u sample time(s)\n", missed);
+            
+            Sched.missed += missed;
+            ts_add_ms(&next, (uint64_t) missed * mm->loop_delay);
+        }
     }
 }
 
@@ -614,15 +2873,49 @@ void parse_cmdline(int opt, char *option, struct measure *mm)
     switch (opt) {
              
     case 'A':   // BME680 i2C address
-        I2Csettings.I2C_Address = (int)strtod(option, NULL);
+        mm->i2c.I2C_Address = (int)strtod(option, NULL);
       
-        if (I2Csettings.I2C_Address != 0x77 && I2Csettings.I2C_Address != 0x76)
+        if (mm->i2c.I2C_Address != 0x77 && mm->i2c.I2C_Address != 0x76)
         {
-            p_printf(RED,(char *) "incorrect BME680 i2C address 0x%x\n",I2Csettings.I2C_Address);
+            p_printf(RED,(char *) "incorrect BME680 i2C address 0x%x\n",mm->i2c.I2C_Address);
             exit(EXIT_FAILURE);
         }   
         break;
     
+    case 'N':   // add BME680 sensor
+        {
+            int addr, sda = 0, scl = 0;
+            int cnt = sscanf(option, "%i,%d,%d", &addr, &sda, &scl);
+            struct bmeI2C_p *i2c = &mm->extra[mm->sensors - 1];
+            
+            if (mm->sensors >= BME680_MAX_DEVICES)
+            {
+                p_printf(RED,(char *) "Too many sensors (max %d)\n", BME680_MAX_DEVICES);
+                exit(EXIT_FAILURE);
+            }
+            
+            if ((cnt != 1 && cnt != 3) || (addr != 0x77 && addr != 0x76))
+            {
+                p_printf(RED,(char *) "incorrect BME680 sensor %s. (i2C address [,SDA,SCL])\n", option);
+                exit(EXIT_FAILURE);
+            }
+            
+            if (cnt == 3 && (sda < 2 || sda == 4 || sda > 27 ||
+                scl < 2 || scl == 4 || scl > 27 || sda == scl))
+            {
+                p_printf(RED,(char *) "invalid GPIO for SDA / SCL :  %d / %d\n", sda, scl);
+                exit(EXIT_FAILURE);
+            }
+            
+            i2c->hw_initialized = false;
+            i2c->I2C_interface = soft_I2C;  // GPIO's given : soft_I2C
+            i2c->I2C_Address = addr;
+            i2c->sda = sda;                 // 0 = same channel as first sensor
+            i2c->scl = scl;
+            mm->sensors++;
+        }
+        break;
+        
     case 'B':   // set NO color output
         NoColor = true;
         break;
@@ -661,12 +2954,51 @@ void parse_cmdline(int opt, char *option, struct measure *mm)
         }
         break;
            
+    case 'g':   // gas duty cycle
+        mm->bme.gasPeriod = strtod(option, NULL);
+        
+        if (mm->bme.gasPeriod < 0 || mm->bme.gasPeriod > 86400)
+        {
+            p_printf(RED,(char *) "Invalid gas period %s. (0 - 86400 seconds)\n", option);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'n':   // noise budget
+        if (sscanf(option, "%f,%f,%f", &mm->bme.noiseT, &mm->bme.noiseP, &mm->bme.noiseH) != 3 ||
+            mm->bme.noiseT < 0 || mm->bme.noiseP < 0 || mm->bme.noiseH < 0)
+        {
+            p_printf(RED,(char *) "Invalid noise budget %s. (temperature,pressure,humidity)\n", option);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'G':   // BME680 heater sweep
+        {
+            unsigned int st, en, steps;
+            
+            if (sscanf(option, "%u,%u,%u", &st, &en, &steps) != 3 ||
+            st == 0 || st > 400 || en == 0 || en > 400 || 
+            steps < 1 || steps > BME680_HEATR_PROF_MAX)
+            {
+                p_printf(RED,(char *) "Invalid heater sweep %s. (start,end,steps) max 400C, %d steps\n",
+                option, BME680_HEATR_PROF_MAX);
+                exit(EXIT_FAILURE);
+            }
+            
+            mm->bme.sweepStart = st;
+            mm->bme.sweepEnd = en;
+            mm->bme.sweepSteps = steps;
+        }
+        break;
+        
     case 'I':   // I2C Speed
-        I2Csettings.baudrate = (uint32_t) strtod(option, NULL);
+        if (strcmp(option, "fast") == 0) mm->i2c.baudrate = BME680_SPEED_FAST;
+        else mm->i2c.baudrate = (uint32_t) strtod(option, NULL);
      
-        if (I2Csettings.baudrate < 1 || I2Csettings.baudrate > 400)
+        if (mm->i2c.baudrate < 1 || mm->i2c.baudrate > BME680_SPEED_FAST)
         {
-          p_printf(RED,(char *) "Invalid i2C speed option %d\n",I2Csettings.baudrate);
+          p_printf(RED,(char *) "Invalid i2C speed option %d\n",mm->i2c.baudrate);
           exit(EXIT_FAILURE);
         }
         break;
@@ -689,10 +3021,44 @@ void parse_cmdline(int opt, char *option, struct measure *mm)
         strncpy(mm->format,option,MAXBUF);
         break;
   
-    case 'D':   // loop delay
-        mm->loop_delay = (int) strtod(option, NULL);
+    case 'D':   // sample period
+        {
+            char *end;
+            double period = strtod(option, &end);
+            
+            // milli-seconds or seconds
+            if (strcmp(end, "ms") == 0) mm->loop_delay = (uint32_t) lround(period);
+            else if (*end == 0x0) mm->loop_delay = (uint32_t) lround(period * 1000);
+            else period = -1;
+            
+            if (period < 0)
+            {
+                p_printf(RED,(char *) "Invalid sample period %s\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
         break;
       
+    case 'b':   // benchmark
+        mm->bench = (uint32_t) strtod(option, NULL);
+        
+        if (mm->bench < 1 || mm->bench > BENCHMAX)
+        {
+            p_printf(RED,(char *) "Invalid benchmark samples %s (1 - %d)\n", option, BENCHMAX);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'S':   // stream mode
+        mm->stream = (uint16_t) strtod(option, NULL);
+        
+        if (mm->stream < 1 || mm->stream > 10000)
+        {
+          p_printf(RED,(char *) "Invalid stream buffer size %s. 1 - 10000\n", option);
+          exit(EXIT_FAILURE);
+        }
+        break;
+        
     case 'V':   // verbose /debug message
         mm->verbose = (int) strtod(option, NULL);;
         if (mm->verbose > 2)
@@ -706,28 +3072,231 @@ void parse_cmdline(int opt, char *option, struct measure *mm)
         strncpy(mm->v_save_file, option, MAXBUF);
         break;
     
+    case 'w':   // save file buffer and flush
+        {
+            unsigned int size, rows, secs;
+            
+            if (sscanf(option, "%u,%u,%u", &size, &rows, &secs) != 3 || 
+                size < 1 || size > 4096 || rows < 1)
+            {
+                p_printf(RED,(char *) "Invalid save file setting %s. (buffer kB, rows, seconds)\n", option);
+                exit(EXIT_FAILURE);
+            }
+            
+            mm->log_buf = size;
+            mm->log_rows = rows;
+            mm->log_secs = secs;
+        }
+        break;
+        
+    case 'R':   // rotate save file
+        if (strcmp(option, "day") == 0) mm->log_daily = true;
+        else
+        {
+            mm->log_rotate = (uint32_t) strtod(option, NULL);
+            
+            if (mm->log_rotate < 1)
+            {
+                p_printf(RED,(char *) "Invalid rotate size %s\n", option);
+                exit(EXIT_FAILURE);
+            }
+        }
+        break;
+        
+    case 'a':   // adaptive conversion wait
+        mm->adaptive = true;
+        break;
+        
+    case 'e':   // bus backend
+        {
+            char list[MAXBUF], *p;
+            
+            strncpy(list, option, MAXBUF - 1);
+            list[MAXBUF - 1] = 0x0;
+            
+            p = strtok(list, ",");
+            
+            if (p != NULL && strcmp(p, "sim") == 0)
+            {
+                mm->backend = BME680_BUS_SIM;
+                
+                if ((p = strtok(NULL, ",")) != NULL) mm->sensors = (int) strtod(p, NULL);
+                else mm->sensors = 1;
+            }
+            else if (p != NULL && strcmp(p, "spi") == 0)
+            {
+                mm->backend = BME680_BUS_SPI;
+                
+                if ((p = strtok(NULL, ",")) != NULL) mm->sensors = (int) strtod(p, NULL);
+                else mm->sensors = 1;
+                
+                if ((p = strtok(NULL, ",")) != NULL) mm->spi_speed = (uint32_t) (strtod(p, NULL) * 1000000);
+                
+                if (mm->sensors < 1 || mm->sensors > 2 || mm->spi_speed == 0 || mm->spi_speed > BME680_SPI_SPEED)
+                {
+                    p_printf(RED,(char *) "Invalid backend %s (spi[,1 or 2[,MHz max 10]])\n", option);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if (p != NULL && strcmp(p, "replay") == 0 && (p = strtok(NULL, ",")) != NULL)
+            {
+                struct bmeBinHeader hdr;
+                FILE *fp = fopen(p, "rb");
+                
+                mm->backend = BME680_BUS_REPLAY;
+                strncpy(mm->replay, p, MAXBUF - 1);
+                
+                if ((p = strtok(NULL, ",")) != NULL) mm->replay_speed = strtod(p, NULL);
+                
+                /* a sensor per sensor in the file */
+                if (fp == NULL || fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+                    memcmp(hdr.magic, BME680_BIN_MAGIC, sizeof(hdr.magic)) != 0)
+                {
+                    p_printf(RED,(char *) "Can not read capture file %s\n", mm->replay);
+                    exit(EXIT_FAILURE);
+                }
+                
+                fclose(fp);
+                mm->sensors = hdr.sensors;
+            }
+            else
+            {
+                p_printf(RED,(char *) "Invalid backend %s (spi[,#[,#]], sim[,#] or replay,file[,#])\n", option);
+                exit(EXIT_FAILURE);
+            }
+            
+            if (mm->sensors < 1 || mm->sensors > BME680_MAX_DEVICES || mm->replay_speed < 0)
+            {
+                p_printf(RED,(char *) "Invalid backend %s (max %d sensors)\n", option, BME680_MAX_DEVICES);
+                exit(EXIT_FAILURE);
+            }
+        }
+        break;
+        
+    case 'f':   // fast altitude and dew point
+        mm->fast = true;
+        break;
+        
+    case 'c':   // calibration cache file
+        strncpy(mm->calib_file, option, MAXBUF);
+        break;
+
+    case 'U':   // UDP exporter destination
+        strncpy(mm->udp_dest, option, MAXBUF);
+        break;
+        
+    case 'u':   // UDP batch
+        {
+            unsigned int batch, ms;
+            
+            if (sscanf(option, "%u,%u", &batch, &ms) != 2 || batch < 1 || batch > 1000)
+            {
+                p_printf(RED,(char *) "Invalid UDP batch %s. (samples 1 - 1000, ms)\n", option);
+                exit(EXIT_FAILURE);
+            }
+            
+            mm->udp_batch = batch;
+            mm->udp_ms = ms;
+        }
+        break;
+        
+    case 'E':   // UDP format
+        if (strcmp(option, "bin") == 0) mm->udp_binary = true;
+        else if (strcmp(option, "line") == 0) mm->udp_binary = false;
+        else
+        {
+            p_printf(RED,(char *) "Invalid UDP format %s (line or bin)\n", option);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'Z':   // aggregation windows
+        {
+            char list[MAXBUF], *w, *f;
+            
+            strncpy(list, option, MAXBUF - 1);
+            list[MAXBUF - 1] = 0x0;
+            
+            for (w = strtok(list, ","); w != NULL; w = strtok(NULL, ","))
+            {
+                struct aggwin *a = &Agg.win[Agg.windows];
+                
+                if (Agg.windows >= AGGWIN)
+                {
+                    p_printf(RED,(char *) "Too many aggregation windows (max %d)\n", AGGWIN);
+                    exit(EXIT_FAILURE);
+                }
+                
+                if ((f = strchr(w, ':')) != NULL) 
+                {
+                    *f++ = 0x0;
+                    strncpy(a->file, f, MAXBUF - 1);
+                }
+                
+                a->secs = (uint32_t) strtod(w, NULL);
+                
+                if (a->secs < 1)
+                {
+                    p_printf(RED,(char *) "Invalid aggregation window %s\n", w);
+                    exit(EXIT_FAILURE);
+                }
+                
+                Agg.windows++;
+            }
+        }
+        break;
+        
+    case 'q':   // air quality baseline file
+        strncpy(mm->iaq_file, option, MAXBUF);
+        break;
+        
+    case 'Q':   // writer thread
+        if (strcmp(option, "block") == 0) mm->writer = BME680_SPSC_BLOCK;
+        else if (strcmp(option, "oldest") == 0) mm->writer = BME680_SPSC_DROP_OLDEST;
+        else if (strcmp(option, "newest") == 0) mm->writer = BME680_SPSC_DROP_NEWEST;
+        else
+        {
+            p_printf(RED,(char *) "Invalid writer queue policy %s (block, oldest or newest)\n", option);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'Y':   // shared-memory name
+        strncpy(mm->shm_name, option, MAXBUF);
+        
+        if (mm->shm_name[0] != '/')
+        {
+            p_printf(RED,(char *) "Shared memory name must start with / : %s\n", option);
+            exit(EXIT_FAILURE);
+        }
+        break;
+        
+    case 'X':   // binary capture file
+        strncpy(mm->bin_file, option, MAXBUF);
+        break;
+        
     case 'i':   // use hardware I2C
-        I2Csettings.I2C_interface = hard_I2C;
+        mm->i2c.I2C_interface = hard_I2C;
         break;
       
     case 'd':   // change default SCL line for soft_I2C
-        I2Csettings.scl = (int)strtod(option, NULL);
+        mm->i2c.scl = (int)strtod(option, NULL);
       
-        if (I2Csettings.scl < 2 || I2Csettings.scl == 4 || 
-        I2Csettings.scl > 27 || I2Csettings.sda == I2Csettings.scl)
+        if (mm->i2c.scl < 2 || mm->i2c.scl == 4 || 
+        mm->i2c.scl > 27 || mm->i2c.sda == mm->i2c.scl)
         {
-          p_printf(RED,(char *) "invalid GPIO for SCL :  %d\n",I2Csettings.scl);
+          p_printf(RED,(char *) "invalid GPIO for SCL :  %d\n",mm->i2c.scl);
           exit(EXIT_FAILURE);
         }   
         break; 
 
     case 's':   // change default SDA line for soft_I2C
-        I2Csettings.sda = (int)strtod(option, NULL);
+        mm->i2c.sda = (int)strtod(option, NULL);
       
-        if (I2Csettings.sda < 2 || I2Csettings.sda == 4 || 
-        I2Csettings.sda > 27 || I2Csettings.sda == I2Csettings.scl)
+        if (mm->i2c.sda < 2 || mm->i2c.sda == 4 || 
+        mm->i2c.sda > 27 || mm->i2c.sda == mm->i2c.scl)
         {
-          p_printf(RED,(char *) "invalid GPIO for SDA :  %d\n",I2Csettings.sda);
+          p_printf(RED,(char *) "invalid GPIO for SDA :  %d\n",mm->i2c.sda);
           exit(EXIT_FAILURE);
         }   
         break;
@@ -738,6 +3307,177 @@ void parse_cmdline(int opt, char *option, struct measure *mm)
     }
 }
 
+/*********************************************************************
+ * @brief : compare for qsort()
+ *********************************************************************/
+int cmp_uint32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    
+    return((x > y) - (x < y));
+}
+
+/*********************************************************************
+ * @brief : get monotonic time
+ * @return : micro-seconds
+ *********************************************************************/
+uint32_t mono_us()
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    
+    return((uint32_t) ((uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000));
+}
+
+/*********************************************************************
+ * @brief : benchmark : take mm->bench samples back-to-back (sensors in 
+ *          turn) and report the time per stage on stderr
+ * @param mm ; measurement variables
+ * 
+ * @return : TRUE if OK, false if error
+ *********************************************************************/
+bool bench_BME680(struct measure *mm)
+{
+    enum { B_MODE, B_CONFIG, B_WAIT, B_READ, B_COMP, B_FORMAT, B_OUTPUT, B_TOTAL, B_POLLS, B_STAGES };
+    static const char *name[B_STAGES] = { "mode set", "config write", "conversion wait", 
+        "field read", "compensation", "formatting", "output", "total", "status polls" };
+    uint32_t trans[2] = { 0 }, bytes[2] = { 0 }, retries[2] = { 0 }, t, b;
+    uint32_t i, k, cnt = mm->bench, *st, *v;
+    unsigned long meas_end, now;
+    struct bmeSample s;
+    struct bmeTiming tm;
+    uint32_t t0, t1, t2, t3;
+    char    buf[OUTBUF];
+    int     n, len, tries;
+    int8_t  rslt;
+    bool    ok = true;
+    
+    st = (uint32_t *) malloc(cnt * B_STAGES * sizeof(uint32_t));
+    
+    if (st == NULL)
+    {
+        p_printf(RED,(char *) "can not allocate memory for %u samples\n", cnt);
+        return(false);
+    }
+    
+    for (n = 0; n < NumSensors; n++)
+    {
+        MyBme[n].getI2Ccount(&t, &b);
+        trans[0] += t;
+        bytes[0] += b;
+        retries[0] += MyBme[n].getI2Cretries();
+    }
+    
+    for (i = 0; i < cnt && ok && ! StopReq; i++)
+    {
+        n = i % NumSensors;
+        tries = 10;
+        
+        t0 = mono_us();
+        
+        if (MyBme[n].beginReading() == 0)
+        {
+            p_printf(RED,(char *)"can not start reading BME680 sensor %d\n", n);
+            ok = false;
+            break;
+        }
+        
+        while ((rslt = MyBme[n].tryCollect(s, mm->bme.sealevel)) == BME680_W_NO_NEW_DATA)
+        {
+            now = MyBme[n].getMillis();
+            meas_end = MyBme[n].getMeasEnd();
+            
+            /* sleep till expected end */
+            if ((long) (meas_end - now) > 0)
+                usleep((meas_end - now) * 1000);
+            
+            /* poll status */
+            else if (tries-- > 0)
+                usleep(BME680_POLL_PERIOD_MS * 1000);
+            
+            else
+                break;
+        }
+        
+        if (rslt != BME680_OK)
+        {
+            p_printf(RED,(char *)"can not read BME680 sensor %d\n", n);
+            ok = false;
+            break;
+        }
+        
+        MyBme[n].getTiming(&tm);
+        mm->bme.sensor = n;
+        store_sample(mm, &s);
+        
+        /* format and output */
+        t1 = mono_us();
+        
+        if (Bin.fp == NULL) 
+        {
+            len = format_output(mm, buf);
+            t2 = mono_us();
+            ok = write_output(mm, buf, len);
+        }
+        else
+        {
+            t2 = t1;
+            ok = bin_write(mm);
+        }
+        
+        t3 = mono_us();
+        
+        st[B_MODE * cnt + i] = tm.mode_us;
+        st[B_CONFIG * cnt + i] = tm.config_us;
+        st[B_WAIT * cnt + i] = tm.wait_us;
+        st[B_READ * cnt + i] = tm.read_us;
+        st[B_COMP * cnt + i] = tm.comp_us;
+        st[B_FORMAT * cnt + i] = t2 - t1;
+        st[B_OUTPUT * cnt + i] = t3 - t2;
+        st[B_TOTAL * cnt + i] = t3 - t0;
+        st[B_POLLS * cnt + i] = tm.polls;
+        
+        stats_check();
+    }
+    
+    /* samples completed */
+    cnt = i;
+    
+    if (cnt > 0)
+    {
+        for (n = 0; n < NumSensors; n++)
+        {
+            MyBme[n].getI2Ccount(&t, &b);
+            trans[1] += t;
+            bytes[1] += b;
+            retries[1] += MyBme[n].getI2Cretries();
+        }
+        
+        fprintf(stderr, "\nbenchmark : %u samples, %d sensor(s)\n\n", cnt, NumSensors);
+        fprintf(stderr, "%-16s %9s %9s %9s %9s (us)\n", "stage", "min", "median", "p99", "max");
+        
+        for (k = 0; k < B_STAGES; k++)
+        {
+            v = &st[k * mm->bench];
+            qsort(v, cnt, sizeof(uint32_t), cmp_uint32);
+            
+            if (k == B_POLLS) fprintf(stderr, "\n");
+            
+            fprintf(stderr, "%-16s %9u %9u %9u %9u\n", name[k], v[0], v[(cnt - 1) / 2], 
+                v[(uint32_t) ceil(cnt * 0.99) - 1], v[cnt - 1]);
+        }
+        
+        fprintf(stderr, "\nI2C per sample  : %.1f transactions, %.1f bytes\n", 
+            (double) (trans[1] - trans[0]) / cnt, (double) (bytes[1] - bytes[0]) / cnt);
+        fprintf(stderr, "I2C retries     : %u\n", retries[1] - retries[0]);
+    }
+    
+    free(st);
+    
+    return(ok);
+}
+
 /*********************************************************************
  * 
  * @brief program starts here
@@ -760,7 +3500,7 @@ int main(int argc, char *argv[])
     strncpy(progname,argv[0],20);
     
     /* parse commandline */
-    while ((opt = getopt(argc, argv, "A:C:F:H:K:M:P:T:I:L:O:D:s:d:BiV:")) != -1)
+    while ((opt = getopt(argc, argv, "A:C:D:E:F:G:H:I:K:L:M:N:O:P:Q:R:S:T:U:V:W:X:Y:Z:b:c:e:g:n:q:u:w:s:d:Bafi")) != -1)
     {
         parse_cmdline(opt, optarg, &mm);
     }
@@ -768,8 +3508,52 @@ int main(int argc, char *argv[])
     /* initialize the hardware */
     init_hardware(&mm);
     
+    /* compile the output format */
+    format_compile(&mm);
+    
+    /* open binary capture file */
+    if (strlen(mm.bin_file) > 0)
+    {
+        if (bin_open(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    
+    /* daemon mode : create shared memory */
+    if (strlen(mm.shm_name) > 0)
+    {
+        if (shm_start(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    
+    /* start UDP exporter */
+    if (strlen(mm.udp_dest) > 0)
+    {
+        if (udp_start(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    
+    /* open aggregation sinks */
+    if (Agg.windows > 0)
+    {
+        if (agg_start(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    
+    /* start writer thread (not with benchmark, it times the output) */
+    if (mm.writer >= 0 && mm.bench == 0)
+    {
+        if (writer_start(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    
     /* main loop (include command line options)  */
-    main_loop(&mm);
+    if (mm.bench > 0)
+    {
+        if (bench_BME680(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    else if (mm.stream > 0)
+    {
+        if (stream_BME680(&mm) == false) closeout(EXIT_FAILURE);
+    }
+    else
+        main_loop(&mm);
+    
+    if (StopReq) printf("\nStopping BME680 monitor\n");
     
     closeout(EXIT_SUCCESS);
     
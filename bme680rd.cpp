@@ -0,0 +1,90 @@
+/***********************************************************************
+ *
+ * Read the latest BME680 samples from shared memory (bme680m -Y)
+ *
+ * October 2026 / paulvha
+ *
+ * Displays the latest sample of each sensor, or the last # samples of
+ * all sensors, without access to the BME680.
+ *
+ * Output is a line per sample, separated by commas:
+ * time (epoch seconds), sensor, temperature (C), humidity (%),
+ * pressure (Pa), gas resistance (Ohm), gas index, status
+ *
+ * usage : bme680rd name [samples]
+ *
+ * *****************************************************************
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ **********************************************************************/
+
+# include <stdio.h>
+# include <stdlib.h>
+# include "bme680_shm.h"
+
+/*********************************************************************
+ * @brief : output a sample
+ * @param s : sample
+ *********************************************************************/
+void output(const struct bmeShmSample *s)
+{
+    printf("%lld.%03d,%d,%.2f,%.3f,%.0f,%u,%d,0x%02x\n", (long long) (s->time / 1000),
+        (int) (s->time % 1000), s->sensor, s->temperature, s->humidity, s->pressure,
+        s->gas_resistance, s->gas_index, s->status);
+}
+
+/*********************************************************************
+ * @brief program starts here
+ * @param argc : count of command line options provided
+ * @param argv : command line options provided
+ *********************************************************************/
+int main(int argc, char *argv[])
+{
+    static struct bmeShmSample hist[BME680_SHM_HISTORY];
+    struct bmeShmSegment *seg;
+    struct bmeShmSample s;
+    int i, n = 0;
+
+    if (argc == 3) n = (int) strtod(argv[2], NULL);
+
+    if ((argc != 2 && argc != 3) || n < 0)
+    {
+        fprintf(stderr, "usage: %s name [samples]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    seg = bme_shm_open(argv[1]);
+
+    if (seg == NULL)
+    {
+        fprintf(stderr, "can not open BME680 shared memory %s\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (n > 0)
+    {
+        n = bme_shm_history(seg, hist, (uint16_t) (n > BME680_SHM_HISTORY ? BME680_SHM_HISTORY : n));
+
+        for (i = 0; i < n; i++) output(&hist[i]);
+    }
+    else
+    {
+        for (i = 0; i < seg->sensors && i < BME680_SHM_SENSORS; i++)
+        {
+            if (bme_shm_latest(seg, (uint8_t) i, &s)) output(&s);
+        }
+    }
+
+    bme_shm_close(seg);
+    exit(EXIT_SUCCESS);
+}
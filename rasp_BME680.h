@@ -71,6 +71,7 @@
 # include <math.h>
 # include <sys/time.h>
 # include "bme680.h"
+# include "bme680_sim.h"
 
 
 /*=======================================================================
@@ -81,10 +82,34 @@
 /* default speed 100 Khz*/
 # define BME680_SPEED 100
 
+/* hard_I2C Fast mode (Khz), back to BME680_SPEED after this many NACK or
+ * clock stretch errors in a row */
+# define BME680_SPEED_FAST      400
+# define BME680_SPEED_FALLBACK  3
+
+/* returned by tryCollect() if no measurement was started */
+# define BME680_E_NOT_TRIGGERED   INT8_C(-10)
+
+/* RMS noise at 1x oversampling (typical, IIR filter off). setNoiseBudget()
+ * assumes it drops with the square root of the oversampling */
+# define BME680_NOISE_T     0.005f  // degrees Celsius
+# define BME680_NOISE_P     1.3f    // Pascal
+# define BME680_NOISE_H     0.02f   // relative humidity %
+
 /* default GPIO for SOFT_I2C */
 # define DEF_SDA 2
 # define DEF_SCL 3
 
+/* maximum BME680 instances and I2C channels in one program
+ * (instances above the I2C addresses are simulated, setBackend()) */
+# define BME680_MAX_DEVICES 1024
+# define BME680_MAX_BUSES   8
+
+/* SPI : default chip select and clock (BME680 maximum 10 MHz) */
+# define BME680_SPI_CS      BCM2835_SPI_CS0
+# define BME680_SPI_SPEED   10000000
+# define BME680_SPI_BUFFER  128     // largest register read in one frame
+
 /*! driver information */
 struct bmeI2C_p
 {
@@ -92,12 +117,175 @@ struct bmeI2C_p
     bool         hw_initialized;     // initialized or not
     bool         I2C_interface;      // hard_I2C or soft_I2C
     uint8_t     I2C_Address;        // slave address
-    uint16_t    baudrate;           // speed
+    uint16_t    baudrate;           // speed (Khz, hard_I2C 1 - BME680_SPEED_FAST)
     uint8_t     sda;                // SDA GPIO (soft_I2C only)
     uint8_t     scl;                // SCL GPIO (soft_I2C only)
 };
 
-extern struct bmeI2C_p I2Csettings;
+/*! results of a single measurement
+ * all values are obtained from the same forced-mode conversion */
+struct bmeSample
+{
+    float       temperature;        // degrees Celsius
+    float       pressure;           // Pascal
+    float       humidity;           // relative humidity %
+    uint32_t    gas_resistance;     // Ohm (0 = heater unstable / disabled)
+    uint8_t     status;             // new_data, gasm_valid & heat_stab bits
+    uint8_t     gas_index;          // heater set-point used
+    uint32_t    gas_age;            // ms since gas_resistance was read (0 = this conversion)
+    float       altitude;           // meter compared to sealevel pressure
+    float       dewpoint;           // degrees Celsius
+    float       iaq;                // air quality 0 - 500 (0 = good, NAN = no estimate)
+    unsigned long time;             // getMillis() when the results were read
+    struct bme680_raw_data raw;     // ADC values of this reading
+    uint16_t    i2c_transactions;   // I2C transactions used for this reading
+    uint16_t    i2c_bytes;          // I2C bytes (address and data) for this reading
+};
+
+/*! results of a single measurement in integer units
+ * (compensated with integer math only, see bme680_comp.h) */
+struct bmeSampleInt
+{
+    int32_t     temperature;        // 0.01 degrees Celsius
+    int32_t     pressure;           // Pascal
+    int32_t     humidity;           // 0.001 relative humidity %
+    int32_t     gas_resistance;     // Ohm (0 = heater unstable / disabled)
+    uint8_t     status;             // new_data, gasm_valid & heat_stab bits
+    uint8_t     gas_index;          // heater set-point used
+};
+
+/*! time spent in each stage of a reading (CLOCK_MONOTONIC, micro-seconds) */
+struct bmeTiming
+{
+    uint32_t    mode_us;            // set sleep mode (only if state unknown)
+    uint32_t    config_us;          // write changed configuration + forced mode
+    uint32_t    wait_us;            // end of config till new data (incl. polls)
+    uint32_t    read_us;            // status and field data read
+    uint32_t    comp_us;            // compensation
+    uint16_t    polls;              // status reads without new data
+};
+
+/*! adaptive conversion wait (setAdaptiveWait()) */
+# define BME680_CONV_LEARN      4       // readings before the learned time is used
+# define BME680_CONV_PROBE      16      // every # reading probes below the learned time
+# define BME680_CONV_MARGIN_US  1000    // margin around the learned time
+# define BME680_CONV_POLL_MS    1       // status poll period of performReading()
+
+/*! air quality estimate from the gas resistance (setAirQuality()) */
+# define BME680_IAQ_BURNIN      1200    // burn-in (s of heater stable readings)
+# define BME680_IAQ_TAU_BURNIN  60      // baseline time constant during burn-in (s)
+# define BME680_IAQ_TAU_UP      3600    // baseline follows cleaner air (s)
+# define BME680_IAQ_TAU_DOWN    86400   // baseline follows worse air (s)
+# define BME680_IAQ_HUM_REF     40.0    // % humidity with the best score
+# define BME680_IAQ_HUM_WEIGHT  25.0    // % of the score from humidity
+# define BME680_IAQ_HUM_COEF    0.03    // ln(gas resistance) change per % humidity
+# define BME680_IAQ_MAXAGE      (7 * 86400) // saved baseline used if younger (s)
+
+# define BME680_IAQ_OFF         0       // not enabled or no gas readings yet
+# define BME680_IAQ_BURN        1       // burn-in, no estimate yet
+# define BME680_IAQ_READY       2       // estimate available
+
+struct bmeIaq
+{
+    uint8_t     state;              // BME680_IAQ_xxx
+    float       baseline;           // gas resistance of clean air (Ohm, humidity compensated)
+    float       gas_comp;           // gas resistance of the last reading (Ohm, humidity compensated)
+    float       score;              // 0 - 100 (100 = good)
+    float       iaq;                // 0 - 500 (0 = good)
+    uint32_t    burnin;             // burn-in done (ms)
+    unsigned long last;             // getMillis() of the last update (0 = none)
+};
+
+/*! interface in the key of a file record for a backend other than I2C */
+# define BME680_KEY_BUS         0x10
+
+/*! key at the start of a record in the calibration cache and air quality
+ * files : a file holds a fixed-size record per sensor */
+struct bmeRecKey
+{
+    char        magic[8];           // BME680_CALIB_MAGIC or BME680_IAQ_MAGIC
+    uint8_t     version;            // BME680_CALIB_VERSION or BME680_IAQ_VERSION
+    uint8_t     interface;          // hard_I2C, soft_I2C or BME680_KEY_BUS + backend
+    uint8_t     address;            // I2C address (SPI : chip select, simulated : instance)
+    uint8_t     sda;                // SDA GPIO (soft_I2C only, simulated : instance >> 8, else 0)
+    uint8_t     scl;                // SCL GPIO (soft_I2C only, else 0)
+};
+
+/*! air quality state file : a record per sensor (saveAirQuality()) */
+# define BME680_IAQ_MAGIC       "BME680Q"
+# define BME680_IAQ_VERSION     1
+
+struct bmeIaqRec
+{
+    struct bmeRecKey key;           // BME680_IAQ_MAGIC / _VERSION
+    uint8_t     state;              // BME680_IAQ_xxx
+    uint8_t     reserved[2];
+    int64_t     saved;              // epoch (s) the record was saved
+    float       baseline;
+    uint32_t    burnin;
+};
+
+/*! counters of an instance (getStats()), always on */
+# define BME680_ST_NACK     0       // index in bmeStats.retries : Wstatus I2C_SDA_NACK
+# define BME680_ST_CLKSTR   1       // I2C_SCL_CLKSTR
+# define BME680_ST_DATA     2       // I2C_SDA_DATA
+# define BME680_ST_OTHER    3       // any other
+# define BME680_ST_CODES    4
+# define BME680_LAT_BUCKETS 10      // latency : < 1, 1-2, 2-4 .. 128-256, >= 256 ms
+
+struct bmeStats
+{
+    uint32_t    transactions;       // I2C transactions
+    uint32_t    bytes;              // I2C bytes (register address and data)
+    uint32_t    retries[BME680_ST_CODES]; // I2C retries per result code
+    uint32_t    errors;             // I2C transfers failed after all retries
+    uint32_t    nacks;              // I2C NACK results (incl. retried)
+    uint32_t    clock_stretch;      // I2C clock stretch errors (incl. retried)
+    uint32_t    clock_fallbacks;    // I2C clock lowered to BME680_SPEED after errors
+    uint32_t    readings;           // readings collected
+    uint32_t    polls;              // status reads without new data
+    uint32_t    no_new_data;        // sample() without new data after all polls
+    uint32_t    heater_unstable;    // gas results dropped, heater not stable
+    uint32_t    latency[BME680_LAT_BUCKETS]; // beginReading() till the results are read
+};
+
+#ifdef BME680_TRACE
+/*! I2C trace : the last transfers of an instance (make TRACE=1) */
+# define BME680_TRACE_SIZE  256     // transfers kept
+
+struct bmeTrace
+{
+    uint32_t    time_us;            // CLOCK_MONOTONIC micro-seconds
+    uint8_t     reg;                // first register
+    uint8_t     write;              // 1 = write, 0 = read
+    uint16_t    len;                // data bytes
+    uint8_t     result;             // Wstatus
+    uint8_t     retry;              // 0 = first attempt, 1.. = retry
+};
+#endif
+
+/*! raw results of one reading in the stream buffer */
+struct bmeRaw
+{
+    unsigned long time;             // getMillis() when the results were read
+    uint8_t     field[BME680_FIELD_LENGTH]; // field registers (0x1D - 0x2B)
+};
+
+/*! calibration cache file : a record per sensor (setCalibFile()) */
+# define BME680_CALIB_MAGIC     "BME680C"
+# define BME680_CALIB_VERSION   1
+
+struct bmeCalibRec
+{
+    struct bmeRecKey key;           // BME680_CALIB_MAGIC / _VERSION
+    uint8_t     chip_id;
+    uint8_t     reserved[2];
+    uint8_t     check[BME680_COEFF_ADDR2_LEN]; // coefficient block 2 to detect a swap
+    struct bme680_calib_data calib;
+};
+
+/*! I2C channel (defined in bme680_lib.cpp) */
+struct bmeBus;
 
 /*=======================================================================
    rasp_BME680 Class I2C usage.
@@ -111,9 +299,39 @@ class rasp_BME680
     /*! constructor */
     rasp_BME680();
     
+    /*! destructor */
+    ~rasp_BME680();
+    
+    /*! set / get I2C channel, address and speed (set before begin()) */
+    void setI2Csettings(struct bmeI2C_p *settings);
+    void getI2Csettings(struct bmeI2C_p *settings);
+    
     /*! enable or disable debug messages from the driver */
     void setDebug( int level ) ;
+
+    /*! calibration cache file (set before begin(), NULL = none). The file
+     *  name must remain valid as long as the instance is used */
+    void setCalibFile(const char *file);
     
+    /*! adaptive conversion wait : learn the real conversion time of
+     *  this sensor and wait that (+ margin) instead of the estimate
+     *  from the Bosch driver. Falls back to status polling */
+    void setAdaptiveWait(bool enable);
+
+    /*! fast altitude and dew point (bme680_derive.h) instead of
+     *  pow() / log(), see BME680_ALT_ERROR and BME680_DEW_ERROR */
+    void setFastDerived(bool enable);
+
+    /*! bus backend (set before begin()) : BME680_BUS_I2C (default),
+     *  BME680_BUS_SIM or BME680_BUS_REPLAY with a capture file and
+     *  speed (bme680_sim.h). The file name must remain valid as long
+     *  as the instance is used */
+    void setBackend(uint8_t backend, const char *file = NULL, float speed = 1.0);
+
+    /*! SPI chip select (BCM2835_SPI_CS0 or _CS1) and clock in Hz for
+     *  the BME680_BUS_SPI backend (set before begin()) */
+    void setSPIsettings(uint8_t cs, uint32_t speed_hz = BME680_SPI_SPEED);
+
     /*! reset BCM2835 and release memory - if applicable */
     void hw_close(void);
     
@@ -123,11 +341,21 @@ class rasp_BME680
     /*! set hardware and sensor */
     bool  begin(void);
     
+    /*! perform one reading and obtain all results */
+    bool sample(struct bmeSample &s, float seaLevel = 0);
+
+    /*! perform one reading, results in integer units */
+    bool sampleInt(struct bmeSampleInt &s);
+    
+    /*! compensate ADC values (e.g. bmeSample.raw) in integer units */
+    void compensateInt(const struct bme680_raw_data *raw, struct bmeSampleInt &s);
+
     /*! obtain  / calculate results */
     float readTemperature(void);
     float readPressure(void);
     float readHumidity(void);
     float calc_dewpoint(float temp, float hum);
+    float calc_altitude(float pressure, float seaLevel);
     uint32_t readGas(void);
     float readAltitude(float seaLevel);
 
@@ -138,16 +366,179 @@ class rasp_BME680
     bool setIIRFilterSize(uint8_t fs);
     bool setGasHeater(uint16_t heaterTemp, uint16_t heaterTime);
 
-private:
-    /*! Perform a reading */
-    bool performReading(void);
+    /*! set heater profile with up to 10 set-points */
+    bool setHeaterProfile(const uint16_t *heaterTemp, const uint16_t *heaterTime, uint8_t len);
+
+    /*! @brief duty cycle : run the gas heater only every gasPeriod ms,
+     *  other conversions are temperature, pressure and humidity only and
+     *  return the last gas reading with its age (bmeSample.gas_age)
+     *  @param gasPeriod : ms between gas conversions, 0 = every conversion
+     */
+    void setDutyCycle(uint32_t gasPeriod);
+
+    /*! @brief select the lowest oversampling with an RMS noise within
+     *  the budget (BME680_NOISE_x model), 0 = keep the oversampling
+     *  @return false if a budget is below the noise at 16x (nothing set)
+     */
+    bool setNoiseBudget(float temp, float pres, float hum);
+
+    /*! @brief perform a reading for each set-point in the heater profile
+     *  @param s : array to store results (at least profile length)
+     *  @return number of results stored in s
+     */
+    uint8_t sampleHeaterProfile(struct bmeSample *s, float seaLevel = 0);
 
-    /*! @brief Begin a reading.
+    /*! @brief Begin a reading (non-blocking)
      *  
-     *  @return When the reading would be ready as absolute time in millis().
+     *  @return When the reading would be ready as absolute time in 
+     *  getMillis() or 0 in case of error.
      */
     unsigned long beginReading(void);
 
+    /*! @brief check measurement has completed, without waiting
+     *  @return true if new data is available
+     */
+    bool poll(void);
+
+    /*! @brief Collect the results of the reading started with beginReading()
+     *  does not wait, no I2C access before the deadline has passed.
+     * 
+     *  @return BME680_OK : result in s
+     *          BME680_W_NO_NEW_DATA : not ready yet, try again later
+     *          other : error
+     */
+    int8_t tryCollect(struct bmeSample &s, float seaLevel = 0);
+
+    /*! @brief expected time the current reading is ready (0 = none started) */
+    unsigned long getMeasEnd(void);
+
+    /*! @brief current time in milli-seconds (same base as beginReading()) */
+    unsigned long getMillis(void);
+
+    /*! @brief I2C transactions and bytes since begin() */
+    void getI2Ccount(uint32_t *transactions, uint32_t *bytes);
+
+    /*! @brief I2C read and write retries since begin() */
+    uint32_t getI2Cretries(void);
+
+    /*! @brief time spent in each stage of the last reading */
+    void getTiming(struct bmeTiming *t);
+
+    /*! @brief learned conversion time (micro-seconds, 0 = not learned) */
+    uint32_t getConvTime(void);
+
+    /*! @brief I2C, polling, heater and latency counters */
+    void getStats(struct bmeStats *st);
+
+    /*! @brief effective I2C clock of the channel in Khz (after a fall
+     *  back). 0 = not set : soft_I2C (timing of the twowire library),
+     *  SPI or simulated */
+    uint16_t getI2Cclock(void);
+
+#ifdef BME680_TRACE
+    /*! @brief copy the traced I2C transfers, oldest first
+     *  @param t : array to store transfers
+     *  @param max : maximum number of transfers to store in t
+     *  @return number of transfers stored in t
+     */
+    uint16_t getTrace(struct bmeTrace *t, uint16_t max);
+
+    /*! @brief display the traced I2C transfers and clear the trace */
+    void dumpTrace(FILE *fp);
+#endif
+
+    /*! @brief enable or disable the air quality estimate (IAQ) */
+    void setAirQuality(bool enable);
+
+    /*! @brief state of the air quality estimate */
+    void getAirQuality(struct bmeIaq *q);
+
+    /*! @brief save the air quality baseline (record per sensor in file) */
+    bool saveAirQuality(const char *file);
+
+    /*! @brief restore the air quality baseline, skips the burn-in
+     *  @return true if restored, false if no (recent) record in file */
+    bool loadAirQuality(const char *file);
+
+    /*! @brief obtain chip id and calibration data (after begin()) */
+    void getCalibration(uint8_t *chip_id, struct bme680_calib_data *calib);
+
+    /*! @brief start streaming : a new reading is started as soon as the
+     *  previous one is collected. The raw results are stored in a buffer
+     *  that is allocated once.
+     *  @param capacity : number of readings the buffer can hold
+     */
+    bool startStream(uint16_t capacity);
+    
+    /*! @brief stop streaming and release the buffer */
+    void stopStream(void);
+    
+    /*! @brief collect a completed reading (if any) and start the next. Call
+     *  this at or after getMeasEnd(), does not wait.
+     * 
+     *  @return BME680_OK : reading stored in the buffer
+     *          BME680_W_NO_NEW_DATA : not ready yet, try again later
+     *          BME680_E_NOT_TRIGGERED : not streaming
+     *          other : error
+     */
+    int8_t streamService(void);
+    
+    /*! @brief number of readings in the stream buffer */
+    uint16_t streamAvailable(void);
+    
+    /*! @brief take readings from the stream buffer and compensate them
+     *  @param s : array to store results
+     *  @param max : maximum number of results to store in s
+     *  @return number of results stored in s
+     */
+    uint16_t streamRead(struct bmeSample *s, uint16_t max, float seaLevel = 0);
+    
+    /*! @brief number of readings lost as the stream buffer was full */
+    uint32_t getStreamOverrun(void);
+
+private:
+    /*! Perform a reading */
+    bool performReading(void);
+
+    /*! read and compensate new field data (if available) */
+    int8_t readField(struct bme680_field_data *data);
+
+    /*! store new measurement values */
+    void storeResults(struct bme680_field_data *data);
+
+    /*! copy the latest measurement values */
+    void fillSample(struct bmeSample &s, float seaLevel, unsigned long time);
+
+    /*! write changed configuration and start forced mode */
+    bool writeConfig(void);
+
+    /*! open (or share) I2C channel */
+    bool openBus(void);
+
+    /*! update counters */
+    void statI2Cerror(Wstatus result, bool retry);
+    void statReading(void);
+
+    /*! calibration cache : init with cached data, save new data */
+    bool initCached(void);
+    void calibSave(void);
+
+    /*! key of the file records of this sensor (cache and air quality) */
+    void recKey(struct bmeRecKey *key, const char *magic, uint8_t version);
+
+    /*! hardware interface for the Bosch driver, dev_id selects the instance */
+    static int8_t i2c_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+    static int8_t i2c_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+
+    /*! same for SPI */
+    static int8_t spi_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+    static int8_t spi_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+    bool openSPI(void);
+
+    /*! same for a simulated BME680 */
+    static int8_t sim_write(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+    static int8_t sim_read(uint16_t dev_id, uint8_t reg_addr, uint8_t *reg_data, uint16_t len);
+
     /*! values assigned after calling performReading() */
     float temperature;
     /// Pressure (Pascals) assigned after calling performReading() 
@@ -156,13 +547,97 @@ private:
     float humidity;
     /// Gas resistor (ohms) assigned after calling performReading()
     float gas_resistance;
+    /// status and heater set-point index assigned after calling performReading()
+    uint8_t _status, _gas_index;
+
+    /// ADC values assigned after calling performReading()
+    struct bme680_raw_data _raw;
 
     /*! indicate sampling value has been set and obtain result */
     bool _filterEnabled, _tempEnabled, _humEnabled, _presEnabled, _gasEnabled;
     
+    /*! heater profile (len = 0 : only setGasHeater() set-point is used) */
+    struct bme680_heatr_prof _profile;
+    uint8_t _heatrStep;
+    
+    /*! shadow of configuration registers 0x70 - 0x75 as written to the BME680 */
+    uint8_t _shadow[BME680_REG_BUFFER_LENGTH];
+    
+    /*! BME680_xxx_SEL settings changed, not yet written */
+    uint16_t _dirty;
+    
+    /*! BME680 is known to be in sleep mode */
+    bool _idle;
+    
     /*! holds the expected time for the results to be ready */
     unsigned long _meas_end;
 
+    /*! stream buffer (NULL = not streaming) */
+    struct bmeRaw *_ring;
+    uint16_t _ringSize, _ringHead, _ringCount;
+    uint32_t _ringOverrun;
+
+    /*! counters, I2C usage of the last reading */
+    struct bmeStats _stats;
+    uint32_t _startTrans, _startBytes;
+    uint16_t _sampleTrans, _sampleBytes;
+    uint32_t _tBegin;
+
+#ifdef BME680_TRACE
+    /*! I2C trace ring */
+    struct bmeTrace _trace[BME680_TRACE_SIZE];
+    uint16_t _traceHead, _traceCount;
+    void trace(uint8_t reg, uint16_t len, uint8_t write, Wstatus result, uint8_t retry);
+#endif
+
+    /*! stage timing of the last reading */
+    struct bmeTiming _timing;
+    uint32_t _tConfigEnd;
+
+    /*! adaptive conversion wait : deviation from the estimate (EWMA) */
+    bool _adaptive, _convTrack;
+    int32_t _convDev;
+    uint16_t _convEst;
+    uint8_t _convN, _convProbe;
+    uint32_t _tPoll;
+    uint32_t convWait(void);
+    void convCollected(uint32_t t);
+
+    /*! duty cycle : gas every _dutyGas ms (0 = every conversion) and
+     *  the last gas reading */
+    uint32_t _dutyGas;
+    bool _gasPlanned, _lastGasSet;
+    unsigned long _gasDue, _lastGasTime;
+    uint32_t _lastGas;
+    uint8_t _lastGasIndex;
+    void dutyPlan(void);
+
+    /*! calibration cache file (NULL = none) */
+    const char *_calibFile;
+
+    /*! altitude and dew point with the tables of bme680_derive.h */
+    bool _fastDerived;
+
+    /*! air quality estimate */
+    bool _iaqEnabled;
+    struct bmeIaq _iaq;
+    void iaqUpdate(unsigned long time);
+
+    /*! I2C settings and channel of this instance */
+    struct bmeI2C_p _i2c;
+    struct bmeBus *_bus;
+
+    /*! bus backend, simulated BME680 (NULL = I2C) */
+    uint8_t _backend;
+    const char *_replayFile;
+    float _replaySpeed;
+    struct bmeSim *_sim;
+
+    /*! SPI settings, _spiOpen = counted as a user of the SPI channel */
+    uint8_t _spiCs;
+    uint32_t _spiSpeed;
+    bool _spiOpen;
+
     /*! needed for communication with driver from Bosch */
     struct bme680_dev gas_sensor;
 };